@@ -0,0 +1,411 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// The attempt logic, independent of the user interface: selecting
+// calls, sending them in the cw thread, editing the input line and
+// scoring. Used by the ncurses UI in qrq.c and by qrqsim.
+
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include "pulseaudio.h"
+#include "morse.h"
+#include "callbase.h"
+#include "score.h"
+#include "attempt.h"
+#include "pcmcache.h"
+#include "effects.h"
+#include "rt.h"
+#include "corpus.h"
+#include "recorder.h"
+#include "metrics.h"
+#include "timeline.h"
+#include "utf8.h"
+
+typedef void *AUDIO_HANDLE;
+
+pthread_t cwthread;                     // thread for CW output, to enable
+                                        // keyboard reading at the same time
+AUDIO_HANDLE dsp_fd;
+
+atomic_int sending_complete;            // global lock for "enter" while sending
+atomic_llong starttime = 0;
+long long endtime = 0;
+unsigned long int nrofcalls = 0;
+int callnr = 0;                         // nr of actual call in attempt
+int fixedtone = 1;                      // if 1 don't change the pitch
+int ctonefreq = MYFREQ;                 // if fixedtone=1 use this freq
+int editpos = 0;                        // position of cursor in the input line
+int editmode = 1;                       // 0 = overwrite, 1 = insert
+struct callstat callstat;
+char previouscall[80] = "";             // last scored call
+
+static int ctonelist[NTONE] = {550,600,650,700};
+static int previousfreq = 0;
+static int events[2] = { -1, -1 };      // pipe from the cw thread to the UI
+static struct fxstate fx;               // receiving conditions of the cw thread
+
+static void *morse(void *arg);
+static void *finish_sending();
+static int play_segment(int seg, int rate, int fxon);
+static void post_event(int ev);
+
+
+// cw thread: render the text and play it
+// the cache holds clean signals, the effects are new on every play
+static void *morse(void *arg) {
+  char *text = arg;
+  struct cwparams cp;
+  const short *pcm;
+  void *ref;
+  int n, k, fxon, seg;
+
+  callstat.render = get_ns();
+
+  // opening the DSP device
+  dsp_fd = open_dsp();
+
+  cw_params(&cp);
+  if ((fxon = fx_active(&effects)))
+    fx_init(&fx, &effects, cp.samplerate, cp.freq, cp.speed);
+
+  // recorded calls are streamed while they play
+  if ((seg = corpus_find(text)) >= 0) {
+    callstat.written = get_ns();
+    metric_count(MC_CALLS, 1);
+    post_event(EV_START);
+    play_segment(seg, cp.samplerate, fxon);
+    return finish_sending();
+  }
+
+  // repeats and recurring texts come from the cache
+  if ((pcm = pcmcache_get(&cp, text, &n, &ref)) != NULL) {
+    if (fxon) {
+      for (k = 0; k < n; k++)
+        full_buf[k] = pcm[k];
+      full_bufpos = n * sizeof(int);
+    }
+  } else {
+    render_morse(text);
+    pcmcache_put(&cp, text, full_buf, full_bufpos / sizeof(int), NULL);
+  }
+
+  // the call is heard after what the sound server still holds
+  if (text[0])
+    tl_text(&cp, text, get_ns() + audio_latency(dsp_fd) * 1000LL);
+  if (pcm && !fxon) {
+    write_pcm(dsp_fd, pcm, n);
+  } else {
+    if (fxon)
+      fx_process(&fx, full_buf, full_bufpos / sizeof(int));
+    write_audio(dsp_fd, &full_buf[0], full_bufpos);
+  }
+  if (pcm)
+    pcmcache_release(ref);
+  callstat.written = get_ns();
+  if (callstat.written - callstat.render > audiostats.maxrender)
+    audiostats.maxrender = callstat.written - callstat.render;
+  if (!pcm)
+    metric_time(MH_RENDER, callstat.written - callstat.render);
+  if (text[0])
+    metric_count(MC_CALLS, 1);
+  post_event(EV_START);
+  return finish_sending();
+}
+
+
+// cw thread: wait until the call is played
+static void *finish_sending() {
+  int ret;
+
+  ret = close_audio(dsp_fd);
+  callstat.complete = get_ns();
+  starttime = get_ms();
+  sending_complete = 1;
+  post_event(ret < 0 ? EV_ERROR : (ret ? EV_CANCEL : EV_END));
+  return NULL;
+}
+
+
+// stream a recorded segment in 20 ms chunks, with the receiving
+// conditions. returns as stream_audio(), close_audio() drains it
+static int play_segment(int seg, int rate, int fxon) {
+  static short int pcm[MAXRATE / 50];
+  int chunk = rate / 50, ret = 0, n, i;
+  long pos;
+
+  for (pos = 0; !ret && (n = corpus_read(seg, pos, pcm, chunk, rate)); pos += n) {
+    if (fxon) {
+      for (i = 0; i < n; i++)
+        full_buf[i] = pcm[i];
+      fx_process(&fx, full_buf, n);
+      for (i = 0; i < n; i++)
+        pcm[i] = full_buf[i];
+    }
+    ret = stream_audio(dsp_fd, pcm, n);
+  }
+  corpus_done(seg);
+  return ret;
+}
+
+
+// read end of the event pipe, for poll()
+int event_fd() {
+  if (events[0] < 0) {
+    if (pipe(events)) {
+      endwin();
+      perror("Error: Unable to create event pipe");
+      exit(EXIT_FAILURE);
+    }
+    fcntl(events[0], F_SETFL, O_NONBLOCK);
+    fcntl(events[1], F_SETFL, O_NONBLOCK);
+  }
+  return events[0];
+}
+
+
+// next event from the cw thread, EV_NONE if there is none
+int read_event() {
+  unsigned char ev;
+
+  if (read(event_fd(), &ev, 1) == 1)
+    return ev;
+  return EV_NONE;
+}
+
+
+// events are dropped when nobody reads them, the state is
+// always available from sending_complete as well
+static void post_event(int ev) {
+  unsigned char c = ev;
+
+  if (write(events[1], &c, 1) < 0 && errno != EAGAIN)
+    perror("Error: Unable to post event");
+}
+
+
+// verify that thread was created OK
+void check_thread(int j) {
+  if (j) {
+    endwin();
+    perror("Error: Unable to create cwthread!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+// wait for the cw thread, then send text
+void send_text(char *text) {
+  pthread_join(cwthread, NULL);
+  event_fd();
+  cancel_audio(0);
+  rec_call(text);
+  check_thread(rt_thread(&cwthread, &morse, text));
+}
+
+
+// stop the call that is being sent, may be called from any thread
+void cancel_sending() {
+  cancel_audio(1);
+}
+
+
+// wait for the cw thread to finish
+void wait_sending() {
+  pthread_join(cwthread, NULL);
+}
+
+
+// select an unused call, pick the tone and start sending it
+// returns the index of the call
+int next_call() {
+  int i;
+
+  // wait for the cwthread of the previous call
+  pthread_join(cwthread, NULL);
+
+  // select an unused call from the calls array
+  i = select_call(nrofcalls);
+  callstat.select = get_ns();
+
+  // only relevant for callbases with less than 50 calls
+  if (nrofcalls == callnr)        // Only one call left!"
+    callnr = 51;                  // Get out after next one
+
+  // select CW tone
+  if (fixedtone)
+    freq = ctonefreq;
+  else
+    freq = ctonelist[rand() % (NTONE)];
+
+  // starting the morse output in a separate process to make
+  // keyboard input and echoing at the same time possible
+  sending_complete = 0;
+  event_fd();
+  cancel_audio(0);
+  rec_call(calls[i]);
+  check_thread(rt_thread(&cwthread, &morse, calls[i]));
+  return i;
+}
+
+
+// send the previous call again with its own tone
+// this blocks until it is sent
+void repeat_previous() {
+  int k = freq;
+
+  freq = previousfreq;
+  send_text(previouscall);
+  // wait for the CW thread before restore freq
+  pthread_join(cwthread, NULL);
+  freq = k;
+}
+
+
+// score the answer for call i and remove the call from the pool
+// returns 1 if the answer had errors, output holds the error string
+int finish_call(int i, char *input, char *output) {
+  callstat.answered = get_ns();
+  endtime = get_ms();
+  score += calc_score(calls[i], input, speed, output);
+  callstat.scored = get_ns();
+  metric_count(MC_ANSWERS, 1);
+  if (!strcmp(output, "*"))
+    metric_count(MC_CORRECT, 1);
+  if (callstat.complete > callstat.render)
+    metric_time(MH_REACTION, callstat.answered - callstat.complete);
+  strncpy(previouscall, calls[i], 80);
+  previousfreq = freq;
+  calls[i][0] = '\0';
+  return (strcmp(output, "*") != 0);
+}
+
+
+// characters allowed in the input line
+static int valid_key(int c) {
+  return ((c >= 'a' && c <= 'z') ||
+          (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') ||
+          (c == '/') || (c == '=') ||
+          (c == '.') || (c == ',') ||
+          (c == '#') || (c == '!') ||
+          (c == ';') || (c == '-') ||
+          (c == ' ') ||
+          (c == '+') || (c == '?'));
+}
+
+// characters allowed in the input line: the keys above, and all
+// characters that have a code
+static int valid_char(int c) {
+  return (c < 0x80) ? valid_key(c) : (qrq_char_alphabet(c) >= 0);
+}
+
+// apply one key to the input line, which is UTF-8. The bytes of a
+// character typed in another script come one by one and are collected,
+// the Latin letters type the letters of the alphabet with their codes.
+// editpos is in bytes, always at the start of a character; line holds
+// CALLLEN bytes, so any call of the callbase can be typed in full
+int edit_line(char *line, int c, int scp) {
+  static char seq[4];
+  static int nseq = 0, need = 0;
+  char enc[4];
+  int n;
+
+  if ((c >= 0x80) && (c < 0x100)) {
+    if (utf8_size(c) > 1) {                      // lead byte
+      seq[0] = c;
+      nseq = 1;
+      need = utf8_size(c);
+      return EDIT_OK;
+    }
+    if (!need || utf8_size(c)) {                 // stray byte
+      need = 0;
+      return EDIT_NONE;
+    }
+    seq[nseq++] = c;
+    if (nseq < need)
+      return EDIT_OK;
+    need = 0;
+    utf8_decode(seq, &c);
+  }
+  if ((c < 0x80) && isalpha(c))
+    c = qrq_alphabet_key(alphabet, c);
+  else if (c < KEY_MIN)
+    c = utf8_upper(c);
+
+  if ((c < KEY_MIN || c > KEY_MAX) && valid_char(c) &&
+      (strlen(line) + (n = utf8_encode(c, enc)) <= CALLLEN - 1)) {
+    // for single character practice
+    if (scp) {
+      memcpy(line + editpos, enc, n);
+      line[editpos + n] = '\0';
+      return EDIT_DONE;
+    }
+
+    if ((editmode == 0) && line[editpos])        // overwrite
+      memmove(line + editpos, line + editpos + utf8_size(line[editpos]),
+              strlen(line + editpos + utf8_size(line[editpos])) + 1);
+    memmove(line + editpos + n, line + editpos, strlen(line + editpos) + 1);
+    memcpy(line + editpos, enc, n);              // insert into gap
+    editpos += n;
+  } else if ((c == KEY_BACKSPACE || c == 127 || c == 9 || c == 8)
+             && editpos != 0) {                        // BACKSPACE
+    n = utf8_prev(line, editpos);
+    memmove(line + n, line + editpos, strlen(line + editpos) + 1);
+    editpos = n;
+  } else if (c == KEY_DC && line[editpos]) {           // DELETE
+    n = utf8_size(line[editpos]);
+    memmove(line + editpos, line + editpos + n, strlen(line + editpos + n) + 1);
+  } else if (c == KEY_LEFT && editpos != 0) {
+    editpos = utf8_prev(line, editpos);
+  } else if (c == KEY_RIGHT && line[editpos]) {
+    editpos += utf8_size(line[editpos]);
+  } else if (c == KEY_HOME) {
+    editpos = 0;
+  } else if (c == KEY_END) {
+    editpos = strlen(line);
+  } else if (c == KEY_IC) {                    // INS/OVR
+    editmode = !editmode;
+  } else {
+    return EDIT_NONE;
+  }
+  return EDIT_OK;
+}
+
+
+long long get_ms() {
+  struct timeval te;
+  gettimeofday(&te, NULL);
+  long long ms = te.tv_sec*1000LL + te.tv_usec/1000;
+  return ms;
+}
+
+
+// monotonic time in ns, for the stage timestamps
+long long get_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,73 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_ATTEMPT
+#define QRQ_ATTEMPT
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define NTONE 4
+
+#define EV_NONE   0      // events from the cw thread, see read_event()
+#define EV_START  1      // call rendered, playback starts
+#define EV_END    2      // playback complete
+#define EV_CANCEL 3      // playback cancelled
+#define EV_ERROR  4      // audio device failed
+
+#define EDIT_NONE 0      // key not handled by edit_line
+#define EDIT_OK   1      // line edited
+#define EDIT_DONE 2      // single character entered (scp)
+
+// timestamps (ns) of the stages of the current call
+struct callstat {
+  atomic_llong select;   // call selected, cw thread started
+  atomic_llong render;   // cw thread starts rendering
+  atomic_llong written;  // rendered, handed to the audio device
+  atomic_llong complete; // audio drained
+  atomic_llong answered; // answer entered
+  atomic_llong scored;   // answer scored
+};
+
+extern pthread_t cwthread;
+extern atomic_int sending_complete;   // global lock for "enter" while sending
+extern atomic_llong starttime;
+extern long long endtime;
+extern unsigned long int nrofcalls;
+extern int callnr;                    // nr of actual call in attempt
+extern int fixedtone;                 // if 1 don't change the pitch
+extern int ctonefreq;                 // if fixedtone=1 use this freq
+extern int editpos;                   // position of cursor in the input line
+extern int editmode;                  // 0 = overwrite, 1 = insert
+extern struct callstat callstat;
+extern char previouscall[80];         // last scored call
+
+void check_thread(int j);
+void send_text(char *text);
+void wait_sending();
+void cancel_sending();
+int  event_fd();
+int  read_event();
+int  next_call();
+void repeat_previous();
+int  finish_call(int i, char *input, char *output);
+int  edit_line(char *line, int c, int scp);
+long long get_ms();
+long long get_ns();
+
+#endif
@@ -0,0 +1,383 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqbench - reproducible microbenchmarks for the synthesis, callbase
+// loading and scoring code. Results are written to stdout as JSON.
+//
+// usage: qrqbench [callsign directory]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>      // basename
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "morse.h"
+#include "callbase.h"
+#include "cbindex.h"
+#include "dxcc.h"
+#include "score.h"
+#include "effects.h"
+
+#define REPEAT  7        // runs per benchmark, the median is reported
+#define NLARGE  3        // number of callbase files to load
+#define NSCORE  100000   // answers per calc_score run
+
+static long long now_ns();
+static long long median(long long *t, int n);
+static void report(const char *name, const char *params, long long *t, long ops);
+static void bench_tonegen();
+static void bench_morse();
+static void bench_effects();
+static void bench_callbase(char *dir);
+static void bench_cbindex(char *dir);
+static void bench_dxcc(char *dir);
+static void bench_select();
+static void bench_score();
+
+static int first = 1;                   // no comma before the first result
+
+static const char *wavenames[] = { "silence", "sine", "sawtooth", "square" };
+
+
+int main(int argc, char *argv[]) {
+  char *dir = "../callsigns";
+
+  if (argc > 1)
+    dir = argv[1];
+
+  srand(1);                             // same calls every run
+
+  printf("{\n  \"benchmarks\": [");
+  bench_tonegen();
+  bench_morse();
+  bench_effects();
+  bench_callbase(dir);
+  bench_dxcc(dir);
+  bench_cbindex(dir);
+  bench_select();
+  bench_score();
+  printf("\n  ]\n}\n");
+  return 0;
+}
+
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int cmp_ll(const void *a, const void *b) {
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+
+static long long median(long long *t, int n) {
+  qsort(t, n, sizeof(long long), cmp_ll);
+  return t[n / 2];
+}
+
+
+// print one result object, ops is the number of units in a run
+static void report(const char *name, const char *params, long long *t, long ops) {
+  long long med = median(t, REPEAT);
+
+  printf("%s\n    {\"name\": \"%s\", %s, \"repeat\": %d, "
+         "\"min_ns\": %lld, \"median_ns\": %lld, \"ops\": %ld, "
+         "\"ns_per_op\": %.2f}",
+         first ? "" : ",", name, params, REPEAT, t[0], med, ops,
+         ops ? (double)med / ops : 0.0);
+  first = 0;
+  fflush(stdout);
+}
+
+
+// one second of tone per run for each waveform
+static void bench_tonegen() {
+  long long t[REPEAT];
+  char params[80];
+  int w, r;
+
+  samplerate = 44100;
+  render_morse("");                     // sets up the rise/fall time
+
+  for (w = SILENCE; w <= SQUARE; w++) {
+    for (r = 0; r < REPEAT; r++) {
+      full_bufpos = 0;
+      t[r] = now_ns();
+      tonegen(700, samplerate, w);
+      t[r] = now_ns() - t[r];
+    }
+    snprintf(params, sizeof(params), "\"waveform\": \"%s\", \"samplerate\": %ld",
+             wavenames[w], samplerate);
+    report("tonegen", params, t, samplerate);
+  }
+}
+
+
+// a full call across the speed and sample rate range
+static void bench_morse() {
+  static const int speeds[] = { 50, 100, 200, 400, 600, 800, 1000 };
+  static const long rates[] = { 8000, 22050, 44100, 48000, 96000, 192000 };
+  long long t[REPEAT];
+  char params[80];
+  int s, k, r, n = 0;
+
+  freq = 700;
+  waveform = SINE;
+  mincharspeed = 0;
+
+  for (k = 0; k < sizeof(rates) / sizeof(rates[0]); k++) {
+    samplerate = rates[k];
+    for (s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++) {
+      speed = speeds[s];
+      for (r = 0; r < REPEAT; r++) {
+        t[r] = now_ns();
+        n = render_morse("DJ1YFK");
+        t[r] = now_ns() - t[r];
+      }
+      snprintf(params, sizeof(params), "\"speed\": %d, \"samplerate\": %ld",
+               speed, samplerate);
+      report("morse", params, t, n);
+    }
+  }
+  samplerate = 44100;
+}
+
+
+// a call with every receiving condition switched on, the chain has to
+// stay far below the time the call plays (ns_per_op is per sample)
+static void bench_effects() {
+  static const long rates[] = { 8000, 48000, 192000 };
+  struct effects all = { 50, 50, 30, 500 };
+  struct fxstate fx = { .qrm = NULL };
+  long long t[REPEAT], ti[REPEAT];
+  char params[80];
+  int k, r, n = 0;
+
+  speed = 200;
+  chirp = 30;
+  drift = 10;
+  clicks = 50;
+  for (k = 0; k < sizeof(rates) / sizeof(rates[0]); k++) {
+    samplerate = rates[k];
+    n = render_morse("DJ1YFK");
+    for (r = 0; r < REPEAT; r++) {
+      fx_free(&fx);                     // the interference is rendered too
+      ti[r] = now_ns();
+      fx_init(&fx, &all, samplerate, freq, speed);
+      ti[r] = now_ns() - ti[r];
+      t[r] = now_ns();
+      fx_process(&fx, full_buf, n);
+      t[r] = now_ns() - t[r];
+    }
+    snprintf(params, sizeof(params), "\"samplerate\": %ld", samplerate);
+    report("fx_init", params, ti, 1);
+    report("fx_process", params, t, n);
+  }
+  fx_free(&fx);
+  chirp = drift = clicks = 0;
+  samplerate = 44100;
+}
+
+
+// load the largest callbase files in dir
+static void bench_callbase(char *dir) {
+  char large[NLARGE][PATH_MAX] = { "" };
+  long size[NLARGE] = { 0 };
+  char path[PATH_MAX];
+  char params[PATH_MAX + 40];
+  long long t[REPEAT];
+  struct dirent *de;
+  struct stat st;
+  DIR *dh;
+  int i, k, r, n = 0;
+
+  if ((dh = opendir(dir)) == NULL) {
+    fprintf(stderr, "Couldn't open callsign directory %s\n", dir);
+    exit(EXIT_FAILURE);
+  }
+  while ((de = readdir(dh)) != NULL) {
+    if (!strstr(de->d_name, ".txt"))
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    if (stat(path, &st))
+      continue;
+    // keep the list sorted by size, largest first
+    for (i = 0; i < NLARGE; i++) {
+      if (st.st_size > size[i]) {
+        for (k = NLARGE - 1; k > i; k--) {
+          size[k] = size[k - 1];
+          strcpy(large[k], large[k - 1]);
+        }
+        size[i] = st.st_size;
+        strcpy(large[i], path);
+        break;
+      }
+    }
+  }
+  closedir(dh);
+
+  for (i = 0; i < NLARGE && size[i]; i++) {
+    strcpy(cbfilename, large[i]);
+    for (r = 0; r < REPEAT; r++) {
+      t[r] = now_ns();
+      n = read_callbase();
+      t[r] = now_ns() - t[r];
+    }
+    snprintf(params, sizeof(params), "\"file\": \"%s\", \"bytes\": %ld",
+             basename(large[i]), size[i]);
+    report("read_callbase", params, t, n - 1);
+  }
+  strcpy(cbfilename, large[0]);
+}
+
+
+// index all callbase files in dir, then run some drill queries
+static void bench_cbindex(char *dir) {
+  static char files[100][PATH_MAX];
+  static const char *queries[] = { "len=5 has=QYZ", "2=#", "pre=DL,DK len=5",
+                                   "dxcc=DL,F cq=14" };
+  char params[80];
+  long long t[REPEAT];
+  struct dirent *de;
+  DIR *dh;
+  int nfiles = 0, i, r, n = 0, single, total;
+
+  if ((dh = opendir(dir)) == NULL)
+    return;
+  while ((de = readdir(dh)) != NULL && nfiles < 100)
+    if (strstr(de->d_name, ".txt"))
+      snprintf(files[nfiles++], PATH_MAX, "%s/%s", dir, de->d_name);
+  closedir(dh);
+
+  for (r = 0; r < REPEAT; r++) {
+    t[r] = now_ns();
+    n = cbindex_build(files, nfiles);
+    t[r] = now_ns() - t[r];
+  }
+  snprintf(params, sizeof(params), "\"files\": %d", nfiles);
+  report("cbindex_build", params, t, n);
+
+  for (i = 0; i < 4; i++) {
+    for (r = 0; r < REPEAT; r++) {
+      t[r] = now_ns();
+      cbindex_query(queries[i], calls, MAXCALLS, &single, &total);
+      t[r] = now_ns() - t[r];
+    }
+    snprintf(params, sizeof(params), "\"query\": \"%s\"", queries[i]);
+    report("cbindex_query", params, t, total);
+  }
+}
+
+
+// compile the country file in dir, then look up the country of every
+// entry of the largest callbase
+static void bench_dxcc(char *dir) {
+  char path[PATH_MAX], params[PATH_MAX + 20];
+  long long t[REPEAT];
+  int nrofcalls, i, r, n = 0;
+
+  snprintf(path, sizeof(path), "%s/cty.dat", dir);
+  for (r = 0; r < REPEAT; r++) {
+    t[r] = now_ns();
+    n = dxcc_load(path);
+    t[r] = now_ns() - t[r];
+  }
+  if (n < 0)
+    return;
+  report("dxcc_load", "\"file\": \"cty.dat\"", t, n);
+
+  if (!cbfilename[0])
+    return;
+  nrofcalls = read_callbase() - 1;
+  for (r = 0; r < REPEAT; r++) {
+    t[r] = now_ns();
+    for (i = n = 0; i < nrofcalls; i++)
+      n += (dxcc_find(calls[i]) != NULL);
+    t[r] = now_ns() - t[r];
+  }
+  snprintf(params, sizeof(params), "\"file\": \"%s\", \"found\": %d",
+           basename(cbfilename), n);
+  report("dxcc_find", params, t, nrofcalls);
+}
+
+
+// draw every call of the largest callbase, like a full attempt
+static void bench_select() {
+  long long t[REPEAT];
+  char params[PATH_MAX + 20];
+  int nrofcalls = 0, callnr, r;
+
+  if (!cbfilename[0])
+    return;
+
+  for (r = 0; r < REPEAT; r++) {
+    nrofcalls = read_callbase();
+    t[r] = now_ns();
+    for (callnr = 1; callnr < nrofcalls; callnr++)
+      calls[select_call(nrofcalls)][0] = '\0';
+    t[r] = now_ns() - t[r];
+  }
+  snprintf(params, sizeof(params), "\"file\": \"%s\"", basename(cbfilename));
+  report("select_call", params, t, nrofcalls - 1);
+}
+
+
+// score a mix of correct answers, typos and dropped characters
+static void bench_score() {
+  static char answers[MAXCALLS][CALLLEN];
+  long long t[REPEAT];
+  char output[80];
+  char params[PATH_MAX + 20];
+  int nrofcalls, i, k, r;
+
+  if (!cbfilename[0])
+    return;
+
+  nrofcalls = read_callbase() - 1;
+  for (i = 0; i < nrofcalls; i++) {
+    strcpy(answers[i], calls[i]);
+    switch (i % 3) {
+    case 1:                             // one wrong character
+      answers[i][strlen(answers[i]) / 2] = '?';
+      break;
+    case 2:                             // first character missed
+      memmove(answers[i], answers[i] + 1, strlen(answers[i]));
+      break;
+    }
+  }
+
+  fixspeed = 1;
+  for (r = 0; r < REPEAT; r++) {
+    score = errornr = 0;
+    t[r] = now_ns();
+    for (k = 0; k < NSCORE; k++) {
+      i = k % nrofcalls;
+      score += calc_score(calls[i], answers[i], speed, output);
+    }
+    t[r] = now_ns() - t[r];
+  }
+  snprintf(params, sizeof(params), "\"file\": \"%s\"", basename(cbfilename));
+  report("calc_score", params, t, NSCORE);
+}
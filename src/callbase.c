@@ -0,0 +1,137 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "callbase.h"
+#include "cbindex.h"
+#include "corpus.h"
+#include "morse.h"
+#include "utf8.h"
+
+char calls[MAXCALLS][CALLLEN];                 // call array
+char cbfilename[PATH_MAX] = "";           // filename and path to callbase
+int scp = 0;                              // for single character practice
+int alphabet = 0;                         // the Latin letters type this one
+int alphabetauto = 1;                     // alphabet follows the callbase
+
+
+// read the callbase file into the calls array, or draw the segments
+// of the recorded corpora, or the entries of all files that match
+// cbquery. returns the number of calls + 1
+int read_callbase() {
+  int nr;
+
+  if (corpus_size())
+    nr = corpus_calls(calls, MAXCALLS, &scp);
+  else if (cbquery[0])
+    nr = cbindex_query(cbquery, calls, MAXCALLS, &scp, NULL);
+  else
+    nr = load_callbase(cbfilename, calls, MAXCALLS, &scp);
+
+  if (nr < 0) {
+    endwin();
+    fprintf(stderr, "Couldn't read call file %s\n", cbfilename);
+    exit(EXIT_FAILURE);
+  }
+  if (!nr) {
+    endwin();
+    printf("\nError: %s is empty\n", cbfilename);
+    exit(EXIT_FAILURE);
+  }
+  if (alphabetauto)
+    alphabet = callbase_alphabet(nr + 1);
+  return nr+1;
+}
+
+
+// read up to max calls from file into out, sets *single for
+// single character practice. returns the number of calls or -1
+int load_callbase(const char *file, char (*out)[CALLLEN], int max, int *single) {
+  FILE *fh;
+  int c, i, k, n;
+  int maxlen = 0, maxchars = 0;
+  char tmp[80] = "";
+  int nr = 0;
+
+  if ((fh = fopen(file, "r")) == NULL)
+    return -1;
+
+  // count the lines/calls and lengths, in bytes and in characters
+  i = k = 0;
+  while ((c = getc(fh)) != EOF) {
+    i++;
+    k += ((c & 0xc0) != 0x80);
+    if (c == '\n') {
+      nr++;
+      maxlen = (i > maxlen) ? i : maxlen;
+      maxchars = (k > maxchars) ? k : maxchars;
+      i = k = 0;
+    }
+  }
+  maxlen++;
+  // for single character practice
+  *single = (maxchars == 2);
+
+  rewind(fh);
+
+  nr = 0;
+  while ((nr < max) && (fgets(tmp, maxlen, fh) != NULL)) {
+    for (i = 0; i < strlen(tmp); i += n) {
+      n = utf8_decode(tmp + i, &c);
+      if (utf8_upper(c) != c)
+        utf8_encode(utf8_upper(c), tmp + i);  // of the same size
+    }
+    tmp[i - 1] = '\0';              // remove newline
+    if (tmp[i - 2] == '\r')         // also for DOS files
+      tmp[i - 2] = '\0';
+    n = utf8_fit(tmp, CALLLEN - 1);
+    memcpy(out[nr], tmp, n);
+    out[nr][n] = '\0';
+    nr++;
+  }
+  fclose(fh);
+  return nr;
+}
+
+
+// select an unused call from the calls array
+int select_call(int nrofcalls) {
+  int i;
+  do i = rand() % (nrofcalls - 1);
+  while (calls[i][0] == '\0');
+  return i;
+}
+
+
+// the alphabet of the calls: the one of the first character that is
+// not in the ITU alphabet, 0 (ITU) if there is none
+int callbase_alphabet(int nrofcalls) {
+  int i, k, n, c, a;
+
+  for (i = 0; i < nrofcalls - 1; i++)
+    for (k = 0; calls[i][k]; k += n) {
+      n = utf8_decode(calls[i] + k, &c);
+      if ((a = qrq_char_alphabet(c)) > 0)
+        return a;
+    }
+  return 0;
+}
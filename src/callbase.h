@@ -0,0 +1,38 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_CALLBASE
+#define QRQ_CALLBASE
+
+#include <limits.h>      // PATH_MAX
+
+#define MAXCALLS 5000
+#define CALLLEN  16              // bytes of a call, UTF-8 and the 0
+
+extern char calls[MAXCALLS][CALLLEN];
+extern char cbfilename[PATH_MAX];     // filename and path to callbase
+extern int scp;                       // for single character practice
+extern int alphabet;                  // the Latin letters type this one
+extern int alphabetauto;              // alphabet follows the callbase
+
+int read_callbase();
+int load_callbase(const char *file, char (*out)[CALLLEN], int max, int *single);
+int select_call(int nrofcalls);
+int callbase_alphabet(int nrofcalls);
+
+#endif
@@ -0,0 +1,356 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// The callbase query index, see cbindex.h. Built once from every
+// callbase file, a query then takes some microseconds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "callbase.h"
+#include "cbindex.h"
+#include "dxcc.h"
+
+#define CBSYM  47        // characters of the symbols string
+#define CBLEN  (CALLLEN - 1)  // longest entry, as in calls[]
+
+// a node of the prefix trie, its entries are a range of the sorted list
+struct cbnode {
+  int lo, hi;            // entries with this prefix
+  int child, next;       // first child, next sibling, 0 if none
+  char sym;
+};
+
+char cbquery[CBQUERY] = "";
+
+static const char symbols[] = " !#+,-./0123456789;=?ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static signed char symbol[256];        // index in symbols, -1 if none
+
+static int n = 0;                      // entries
+static int words;                      // 64 bit words in a bitset
+static char (*entry)[CALLLEN];       // sorted, every entry once
+static uint64_t *has;                  // [CBSYM] contains the character
+static uint64_t *at;                   // [CBLEN][CBSYM] character at position
+static uint64_t *len;                  // [CBLEN + 1] length
+static uint64_t *result, *term;        // query bitsets
+static struct cbnode *trie;            // node 0 is the root, every entry
+static const struct dxcc **dx;         // country of every entry, or NULL
+
+static int add_file(const char *file, int size);
+static void build_trie(int nodes);
+static int add_term(char *t);
+static int add_set(uint64_t *set, const char *chars);
+static int add_country(const char *t, char *v);
+static void add_range(int lo, int hi);
+
+#define SET(b, i)  ((b)[(i) >> 6] |= 1ULL << ((i) & 63))
+
+
+static int cmp_entry(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+
+// read all files into the index, an entry in several files is kept once
+// returns the number of entries or -1
+int cbindex_build(char (*files)[PATH_MAX], int nfiles) {
+  int size = 0, i, k, s, l, chars = 0;
+
+  memset(symbol, -1, sizeof(symbol));
+  for (i = 0; i < CBSYM; i++)
+    symbol[(unsigned char)symbols[i]] = i;
+
+  free(entry);
+  entry = NULL;
+  for (i = n = 0; i < nfiles; i++)
+    if ((size = add_file(files[i], size)) < 0)
+      return -1;
+
+  qsort(entry, n, sizeof(*entry), cmp_entry);
+  for (i = k = 0; i < n; i++)
+    if (!k || strcmp(entry[i], entry[k - 1]))
+      memmove(entry[k++], entry[i], sizeof(*entry));
+  n = k;
+
+  words = (n + 63) / 64;
+  free(has);
+  has = calloc((size_t)words * (CBSYM + CBLEN * CBSYM + CBLEN + 3), 8);
+  if (!has)
+    return -1;
+  at = has + (size_t)words * CBSYM;
+  len = at + (size_t)words * CBLEN * CBSYM;
+  result = len + (size_t)words * (CBLEN + 1);
+  term = result + words;
+
+  for (i = 0; i < n; i++) {
+    for (l = 0; entry[i][l]; l++) {
+      if ((s = symbol[(unsigned char)entry[i][l]]) < 0)
+        continue;
+      SET(has + (size_t)s * words, i);
+      SET(at + ((size_t)l * CBSYM + s) * words, i);
+    }
+    SET(len + (size_t)l * words, i);
+    chars += l;
+  }
+  build_trie(chars + 1);
+
+  // the country is looked up once, a query only compares it
+  free(dx);
+  if ((dx = malloc((n ? n : 1) * sizeof(*dx))) == NULL)
+    return -1;
+  for (i = 0; i < n; i++)
+    dx[i] = dxcc_call(entry[i]);
+  return trie ? n : -1;
+}
+
+
+// number of entries in the index, 0 before it is built
+int cbindex_size() {
+  return n;
+}
+
+
+// append the entries of a file, the array holds size entries
+// returns the new size or -1
+static int add_file(const char *file, int size) {
+  static char tmp[MAXCALLS][CALLLEN];
+  int nr, single, i;
+  void *p;
+
+  if ((nr = load_callbase(file, tmp, MAXCALLS, &single)) < 0)
+    return -1;
+  if (n + nr > size) {
+    size = 2 * size + nr;
+    if ((p = realloc(entry, (size_t)size * sizeof(*entry))) == NULL)
+      return -1;
+    entry = p;
+  }
+  for (i = 0; i < nr; i++)
+    if (tmp[i][0])
+      memcpy(entry[n++], tmp[i], sizeof(*entry));
+  return size;
+}
+
+
+// insert the sorted entries one after the other, an entry shares the
+// path of its common prefix with the one before
+static void build_trie(int nodes) {
+  int path[CBLEN + 1];
+  int i, d, l, c, k = 1;
+
+  free(trie);
+  if ((trie = calloc(nodes, sizeof(*trie))) == NULL)
+    return;
+  trie[0].hi = n;
+  path[0] = 0;
+
+  for (i = 0; i < n; i++) {
+    d = 0;
+    if (i)
+      while (entry[i][d] && entry[i][d] == entry[i - 1][d])
+        d++;
+    for (c = 1; c <= d; c++)
+      trie[path[c]].hi = i + 1;
+    for (l = d; entry[i][l]; l++) {
+      // siblings are added in sorted order, after the one of the last entry
+      if (i && l == d && l < strlen(entry[i - 1]))
+        trie[path[l + 1]].next = k;
+      else
+        trie[path[l]].child = k;
+      trie[k].lo = i;
+      trie[k].hi = i + 1;
+      trie[k].sym = entry[i][l];
+      path[l + 1] = k++;
+    }
+  }
+}
+
+
+// evaluate the query, puts up to max matching entries into out, a random
+// choice if there are more. total is set to the number of matches
+// returns the number put into out or -1 if the query is not valid
+int cbindex_query(const char *query, char (*out)[CALLLEN], int max,
+                  int *single, int *total) {
+  char q[CBQUERY], *t, *save;
+  uint64_t bits;
+  int i, w, j, neg, count = 0, maxlen = 0;
+
+  if (!n)
+    return -1;
+  memset(result, 0xff, words * 8);
+  if (n & 63)
+    result[words - 1] = (1ULL << (n & 63)) - 1;
+
+  strncpy(q, query, CBQUERY - 1);
+  q[CBQUERY - 1] = '\0';
+  for (t = strtok_r(q, " ", &save); t; t = strtok_r(NULL, " ", &save)) {
+    if ((neg = (*t == '!')))
+      t++;
+    memset(term, 0, words * 8);
+    if (add_term(t) < 0)
+      return -1;
+    for (w = 0; w < words; w++)
+      result[w] &= neg ? ~term[w] : term[w];
+  }
+
+  for (w = 0; w < words; w++) {
+    for (bits = result[w]; bits; bits &= bits - 1) {
+      i = w * 64 + __builtin_ctzll(bits);
+      if (count < max)
+        j = count;
+      else if ((j = rand() % (count + 1)) >= max)
+        j = -1;
+      if (j >= 0)
+        strcpy(out[j], entry[i]);
+      count++;
+    }
+  }
+
+  for (i = 0; i < count && i < max; i++)
+    if (strlen(out[i]) > maxlen)
+      maxlen = strlen(out[i]);
+  *single = (maxlen == 1);
+  if (total)
+    *total = count;
+  return count < max ? count : max;
+}
+
+
+// set the entries that match one term in term
+// returns -1 if it is not valid
+static int add_term(char *t) {
+  char *v = strchr(t, '='), *p, *save;
+  int lo, hi, l, k;
+
+  if (!v || !v[1])
+    return -1;
+  *v++ = '\0';
+  for (p = v; *p; p++)
+    *p = toupper(*p);
+
+  if (!strcmp(t, "len")) {
+    if ((k = sscanf(v, "%d-%d", &lo, &hi)) < 1)
+      return -1;
+    if (k == 1)
+      hi = lo;
+    if (lo < 0 || hi > CBLEN || lo > hi)
+      return -1;
+    for (l = lo; l <= hi; l++)
+      for (k = 0; k < words; k++)
+        term[k] |= len[(size_t)l * words + k];
+    return 0;
+  }
+  if (!strcmp(t, "has"))
+    return add_set(has, v);
+  if (isdigit(t[0]) && !t[1]) {
+    if ((l = t[0] - '1') < 0 || l >= CBLEN)
+      return -1;
+    return add_set(at + (size_t)l * CBSYM * words, v);
+  }
+  if (!strcmp(t, "pre")) {
+    for (p = strtok_r(v, ",", &save); p; p = strtok_r(NULL, ",", &save)) {
+      // walk down the trie, the node of the prefix has its range
+      for (k = 0; *p && k >= 0; p++) {
+        for (k = trie[k].child; k && trie[k].sym != *p; k = trie[k].next)
+          ;
+        if (!k)
+          k = -1;
+      }
+      if (k >= 0)
+        add_range(trie[k].lo, trie[k].hi);
+    }
+    return 0;
+  }
+  if (!strcmp(t, "dxcc") || !strcmp(t, "cq") || !strcmp(t, "cont"))
+    return add_country(t, v);
+  return -1;
+}
+
+
+// set the entries of the countries given by prefixes (dxcc=DL,F), of
+// CQ zones (cq=14 or cq=14-16) or of continents (cont=EU,AS)
+// returns -1 if it is not valid
+static int add_country(const char *t, char *v) {
+  const struct dxcc *want[16];
+  char *p, *save;
+  int i, k, nwant = 0, lo, hi;
+
+  if (!dxcc_entities())
+    return -1;
+  if (!strcmp(t, "cq")) {
+    if ((k = sscanf(v, "%d-%d", &lo, &hi)) < 1)
+      return -1;
+    if (k == 1)
+      hi = lo;
+    for (i = 0; i < n; i++)
+      if (dx[i] && (dx[i]->cq >= lo) && (dx[i]->cq <= hi))
+        SET(term, i);
+    return 0;
+  }
+  for (p = strtok_r(v, ",", &save); p; p = strtok_r(NULL, ",", &save)) {
+    if (!strcmp(t, "cont")) {
+      for (i = 0; i < n; i++)
+        if (dx[i] && !strcmp(dx[i]->cont, p))
+          SET(term, i);
+    } else if ((nwant < 16) && (want[nwant] = dxcc_find(p)) != NULL) {
+      nwant++;
+    }
+  }
+  // an entity with several zones has one name for all of them
+  for (i = 0; i < n; i++)
+    for (k = 0; dx[i] && (k < nwant); k++)
+      if (dx[i]->name == want[k]->name)
+        SET(term, i);
+  return 0;
+}
+
+
+// or the bitsets of the characters in chars into term, # is any digit
+// and @ any letter. returns -1 for a character that is not indexed
+static int add_set(uint64_t *set, const char *chars) {
+  uint64_t *b;
+  int s, k;
+
+  for (; *chars; chars++) {
+    for (s = 0; s < CBSYM; s++) {
+      if (*chars == '#' ? isdigit(symbols[s]) :
+          *chars == '@' ? isalpha(symbols[s]) : *chars == symbols[s]) {
+        b = set + (size_t)s * words;
+        for (k = 0; k < words; k++)
+          term[k] |= b[k];
+      }
+    }
+    if (symbol[(unsigned char)*chars] < 0 && *chars != '@')
+      return -1;
+  }
+  return 0;
+}
+
+
+// set the entries lo..hi-1 in term
+static void add_range(int lo, int hi) {
+  for (; lo < hi && (lo & 63); lo++)
+    SET(term, lo);
+  for (; lo + 64 <= hi; lo += 64)
+    term[lo >> 6] = ~0ULL;
+  for (; lo < hi; lo++)
+    SET(term, lo);
+}
@@ -0,0 +1,51 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_CBINDEX
+#define QRQ_CBINDEX
+
+// A query index over all callbase files. Every entry is kept once, with a
+// bitset of the entries for every character, every character at every
+// position and every length, and a prefix trie. A query only combines
+// bitsets, the files are read once when the index is built.
+//
+// A query is a list of terms that must all match, ! in front negates one:
+//   len=5  len=4-6       length of the entry
+//   has=QYZ              contains one of the characters
+//   2=#                  character at position 1..9 is one of
+//   pre=DL,DK            starts with one of the prefixes
+//   dxcc=DL,F            a call of one of these countries, see dxcc.h
+//   cq=14  cq=14-16      a call of these CQ zones
+//   cont=EU,AS           a call of one of the continents
+// In a character set # is any digit and @ any letter. The countries are
+// looked up when the index is built, they need a country file.
+
+#include <limits.h>      // PATH_MAX
+
+#include "callbase.h"
+
+#define CBQUERY  48      // longest query
+
+extern char cbquery[CBQUERY];          // query of the virtual callbase
+
+int cbindex_build(char (*files)[PATH_MAX], int nfiles);
+int cbindex_size();
+int cbindex_query(const char *query, char (*out)[CALLLEN], int max,
+                  int *single, int *total);
+
+#endif
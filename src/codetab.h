@@ -0,0 +1,53 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// The morse code tables, generated by mkcodes from alphabets.txt. All
+// characters of all alphabets are in one minimal perfect hash: the
+// bucket of a character is qrq_codehash(c, 0), its slot in qrq_codes
+// qrq_codehash(c, displacement of the bucket). One lookup, one compare.
+
+#ifndef QRQ_CODETAB
+#define QRQ_CODETAB
+
+// a character and its code
+struct qrq_codeent {
+  int c;                         // Unicode code point
+  int alphabet;                  // the alphabet that has it
+  const char *code;              // dots and dashes, " " for the word space
+};
+
+// keys[] are the characters typed with the Latin letters A to Z
+struct qrq_alphabet {
+  const char *name;
+  const int *keys;
+};
+
+extern const int qrq_ncodes, qrq_nbuckets, qrq_nalphabets;
+extern const unsigned short qrq_codedisp[];
+extern const struct qrq_codeent qrq_codes[];
+extern const struct qrq_alphabet qrq_alphabets[];
+
+static inline unsigned int qrq_codehash(unsigned int c, unsigned int seed) {
+  unsigned int h = (c ^ (seed * 0x9e3779b9u)) * 0x85ebca6bu;
+
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  return h ^ (h >> 16);
+}
+
+#endif
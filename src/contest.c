@@ -0,0 +1,349 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Contest mode: the calls of a run are sent back to back on one audio
+// stream, contestgap ms apart, while the student types. The play thread
+// never waits for the student. Answers go into a queue and a scoring
+// thread finds the call each one belongs to: of the first calls heard
+// and not answered yet, the one closest to the answer. The calls in
+// front of it were missed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "pulseaudio.h"
+#include "effects.h"
+#include "score.h"
+#include "attempt.h"
+#include "contest.h"
+#include "metrics.h"
+#include "timeline.h"
+#include "rt.h"
+
+// The scoring thread has its own score and speed, the play thread and
+// the UI only read the copies in the atomics below.
+
+// a call of the run
+struct ccall {
+  char text[CALLLEN];
+  int speed;                     // it was sent at
+  long start;                    // first sample
+};
+
+int contestgap = 400;
+int contestcalls = 100;
+
+static struct ccall run[MAXCALLS];
+static int ncalls = 0;
+static atomic_int sent;          // calls the play thread has started
+static atomic_long heard;        // samples played by the sound card
+static long latency = 0;         // samples the sound server holds
+static int scored = 0;           // calls scored or missed, scoring thread
+static struct scorestate st;     // scoring thread
+
+// the totals, written by the play and scoring threads
+static struct {
+  atomic_long sent, answered, correct, missed, extra;
+  atomic_int score, speed;
+} tot;
+
+// answers, from the UI to the scoring thread
+static char answers[ANSWERQ][16];
+static long answerpos[ANSWERQ];  // heard when it was typed
+static unsigned int ahead = 0, atail = 0;
+
+// results, from the scoring thread to the UI
+static struct contestresult results[RESULTQ];
+static atomic_uint rhead, rtail;
+
+static atomic_int stop = 0, finished = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t playthread, scorethread;
+
+static void *play(void *arg);
+static int  send_chunk(void *dsp, int *buf, short *pcm, int n,
+                       struct fxstate *fx, long *pos);
+static void *scorer(void *arg);
+static void score_answer(const char *typed, long pos);
+static void result(int i, const char *input);
+static void halt();
+
+
+// draw ncalls calls from the callbase and start sending them
+int contest_start(int n) {
+  int i;
+
+  if (n > (int)nrofcalls - 1)
+    n = nrofcalls - 1;
+  if (n > MAXCALLS)
+    n = MAXCALLS;
+  for (ncalls = 0; ncalls < n; ncalls++) {
+    i = select_call(nrofcalls);
+    strcpy(run[ncalls].text, calls[i]);
+    calls[i][0] = '\0';
+  }
+
+  st.score = st.maxspeed = st.errornr = 0;
+  st.speed = speed;
+  st.fixspeed = fixspeed;
+  st.mode = scoremode;
+  tot.sent = tot.answered = tot.correct = tot.missed = tot.extra = 0;
+  tot.score = 0;
+  tot.speed = st.speed;
+  sent = heard = scored = 0;
+  ahead = atail = rhead = rtail = 0;
+  stop = finished = 0;
+  cancel_audio(0);
+  if (pthread_create(&scorethread, NULL, scorer, NULL))
+    return -1;
+  if (rt_thread(&playthread, play, NULL)) {
+    halt();                              // there is no play thread
+    pthread_join(scorethread, NULL);
+    return -1;
+  }
+  return 0;
+}
+
+
+// stop sending, score the answers typed so far and wait for the threads
+void contest_stop() {
+  halt();
+  cancel_audio(1);
+  pthread_join(playthread, NULL);
+  pthread_join(scorethread, NULL);
+  cancel_audio(0);
+}
+
+
+// tell the threads to stop and wake them
+static void halt() {
+  pthread_mutex_lock(&mutex);
+  stop = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// queue an answer, it is scored in the background
+void contest_answer(const char *typed) {
+  pthread_mutex_lock(&mutex);
+  if (ahead - atail < ANSWERQ) {
+    strncpy(answers[ahead % ANSWERQ], typed, 15);
+    answers[ahead % ANSWERQ][15] = '\0';
+    answerpos[ahead % ANSWERQ] = heard;
+    ahead++;
+    pthread_cond_signal(&cond);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// the next scored call, returns 0 if there is none
+int contest_result(struct contestresult *r) {
+  unsigned int t = atomic_load_explicit(&rtail, memory_order_relaxed);
+
+  if (t == atomic_load_explicit(&rhead, memory_order_acquire))
+    return 0;
+  *r = results[t % RESULTQ];
+  atomic_store_explicit(&rtail, t + 1, memory_order_release);
+  return 1;
+}
+
+
+// 1 when all calls were played
+int contest_done() {
+  return finished;
+}
+
+
+// a copy of the running totals
+void contest_totals(struct conteststats *t) {
+  t->sent = tot.sent;
+  t->answered = tot.answered;
+  t->correct = tot.correct;
+  t->missed = tot.missed;
+  t->extra = tot.extra;
+  t->score = tot.score;
+  t->speed = tot.speed;
+}
+
+
+// after contest_stop(): the calls sent but not answered are missed
+void contest_finish() {
+  while (scored < sent)
+    result(scored++, "");
+}
+
+
+// play thread: one synthesizer and one stream for the whole run. The
+// speed of every call is the one the answers so far have left
+static void *play(void *arg) {
+  static int buf[MAXRATE / 50];
+  static short pcm[MAXRATE / 50];
+  static struct qrq_synth synth;
+  struct cwparams cp;
+  struct fxstate fx = { .qrm = NULL };
+  void *dsp = open_dsp();
+  long pos = 0;
+  int k, n, gap, fxon, ret = 0, chunk;
+
+  cw_params(&cp);
+  cp.speed = tot.speed;
+  chunk = cp.samplerate / 50;
+  qrq_synth_init(&synth, &cp);
+  if ((fxon = fx_active(&effects)))
+    fx_init(&fx, &effects, cp.samplerate, cp.freq, cp.speed);
+
+  for (k = 0; !ret && !stop && (k < ncalls); k++) {
+    cw_params(&cp);
+    cp.speed = tot.speed;
+    qrq_synth_params(&synth, &cp);
+    run[k].speed = cp.speed;
+    run[k].start = pos;
+    atomic_store(&sent, k + 1);
+    tot.sent = k + 1;
+    metric_count(MC_CALLS, 1);
+    qrq_synth_queue(&synth, run[k].text);
+
+    // the call, then the gap
+    // the silence after a call is streamed as well, the positions of
+    // the synthesizer follow the stream for the timeline
+    for (gap = 0; !ret && !stop; ) {
+      synth.pos = pos;
+      n = qrq_synth_render_int(&synth, buf, chunk);
+      ret = send_chunk(dsp, buf, pcm, chunk, fxon ? &fx : NULL, &pos);
+      tl_synth(&synth, get_ns() + (latency - pos) * 1000000000LL /
+               cp.samplerate);
+      if (n < chunk) {
+        if (gap)
+          break;
+        gap = 1;
+        qrq_synth_tone(&synth, 0, cp.samplerate * contestgap / 1000, SILENCE);
+      }
+    }
+  }
+  if (!ret && !stop)
+    close_audio(dsp);                     // drain
+  fx_free(&fx);
+  heard = pos;
+  finished = 1;
+  return NULL;
+}
+
+
+// stream n samples with the receiving conditions. Once a second the
+// latency of the sound server is asked, heard is what was played
+static int send_chunk(void *dsp, int *buf, short *pcm, int n,
+                      struct fxstate *fx, long *pos) {
+  long rate = samplerate;
+  int i, ret;
+
+  if (fx)
+    fx_process(fx, buf, n);
+  for (i = 0; i < n; i++)
+    pcm[i] = buf[i];
+  ret = stream_audio(dsp, pcm, n);
+  if ((*pos / n) % 50 == 0)
+    latency = audio_latency(dsp) * rate / 1000000;
+  *pos += n;
+  heard = (*pos > latency) ? *pos - latency : 0;
+  return ret;
+}
+
+
+// scoring thread: one answer after the other, until stopped and all
+// answers are scored
+static void *scorer(void *arg) {
+  char typed[16];
+  long pos;
+
+  pthread_mutex_lock(&mutex);
+  while (1) {
+    while (!stop && (ahead == atail))
+      pthread_cond_wait(&cond, &mutex);
+    if (ahead == atail)
+      break;
+    strcpy(typed, answers[atail % ANSWERQ]);
+    pos = answerpos[atail % ANSWERQ];
+    atail++;
+    pthread_mutex_unlock(&mutex);
+    score_answer(typed, pos);
+    pthread_mutex_lock(&mutex);
+  }
+  pthread_mutex_unlock(&mutex);
+  return NULL;
+}
+
+
+// the call an answer typed at sample pos is for
+static void score_answer(const char *typed, long pos) {
+  int n, k, d, best = 0, bestd = INT_MAX;
+  int s = atomic_load(&sent);
+
+  for (n = 0; (scored + n < s) && (run[scored + n].start <= pos); n++)
+    ;                                     // calls heard
+  if (!n) {
+    tot.extra++;
+    return;
+  }
+  for (k = 0; (k < n) && (k < MATCHAHEAD); k++) {
+    d = edit_distance(run[scored + k].text, typed);
+    if (d < bestd) {
+      bestd = d;
+      best = k;
+    }
+  }
+  for (k = 0; k < best; k++)
+    result(scored + k, "");
+  result(scored + best, typed);
+  scored += best + 1;
+}
+
+
+// score call i of the run, input "" if it was missed
+static void result(int i, const char *input) {
+  unsigned int h = atomic_load_explicit(&rhead, memory_order_relaxed);
+  struct contestresult r;
+
+  strcpy(r.call, run[i].text);
+  strcpy(r.input, input);
+  r.speed = run[i].speed;
+  r.points = score_call(&st, r.call, r.input, r.speed, r.output);
+  st.score += r.points;
+  tot.score = st.score;
+  tot.speed = st.speed;
+  if (!input[0])
+    tot.missed++;
+  else
+    tot.answered++;
+  metric_count(MC_ANSWERS, 1);
+  if (!strcmp(r.output, "*")) {
+    tot.correct++;
+    metric_count(MC_CORRECT, 1);
+  }
+
+  if (h - atomic_load_explicit(&rtail, memory_order_acquire) < RESULTQ) {
+    results[h % RESULTQ] = r;
+    atomic_store_explicit(&rhead, h + 1, memory_order_release);
+  }
+}
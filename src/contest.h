@@ -0,0 +1,60 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_CONTEST
+#define QRQ_CONTEST
+
+#include "morse.h"
+#include "callbase.h"
+
+#define ANSWERQ   64             // answers typed but not scored yet
+#define RESULTQ   64             // scored answers not shown yet
+#define MATCHAHEAD 4             // calls heard that an answer may be for
+
+// running totals of a contest run
+struct conteststats {
+  long sent;                     // calls started
+  long answered;
+  long correct;
+  long missed;                   // no answer for it
+  long extra;                    // answers before any call was heard
+  int score;
+  int speed;                     // of the next call, cpm
+};
+
+// one scored call, for the display
+struct contestresult {
+  char call[CALLLEN];
+  char input[16];                // "" if it was missed
+  char output[80];               // as calc_score(), "*" = correct
+  int points;
+  int speed;
+};
+
+extern int contestgap;           // ms between calls, from qrqrc
+extern int contestcalls;         // calls per run, from qrqrc
+
+int  contest_start(int ncalls);
+void contest_stop();
+void contest_answer(const char *typed);
+int  contest_result(struct contestresult *r);
+int  contest_done();
+void contest_totals(struct conteststats *t);
+void contest_finish();
+
+#endif
@@ -0,0 +1,294 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Recorded corpora, see corpus.h. A WAV file is only mapped when it is
+// opened, the index is read into memory.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "callbase.h"
+#include "corpus.h"
+
+// a mapped WAV file
+struct corpus {
+  char name[PATH_MAX];
+  const unsigned char *map;
+  size_t maplen;
+  const unsigned char *data;        // first frame
+  long frames;
+  int channels;
+  long rate;
+};
+
+// a recorded item
+struct segment {
+  int file;                         // corpus
+  long start, len;                  // frames
+  char text[CALLLEN];                    // transcript
+};
+
+static struct corpus corpora[MAXCORPUS];
+static int ncorpus = 0;
+static struct segment *segs = NULL;
+static int nsegs = 0, segsize = 0;
+static int drawn[MAXCALLS];         // segment of every call drawn
+static char (*drawnto)[CALLLEN] = NULL;  // .. and where they were put
+static int ndrawn = 0;
+
+static int read_header(struct corpus *c);
+static int read_index(const char *file, int k);
+static int frame(const struct corpus *c, long k);
+static void advise(int seg, int advice);
+
+
+static unsigned long get32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+
+static int get16(const unsigned char *p) {
+  return p[0] | p[1] << 8;
+}
+
+
+// map a WAV file and read its index
+// returns the number of segments or -1
+int corpus_open(const char *file) {
+  struct corpus *c = &corpora[ncorpus];
+  char idx[PATH_MAX];
+  struct stat st;
+  char *dot;
+  int fd, n;
+
+  if ((ncorpus == MAXCORPUS) || ((fd = open(file, O_RDONLY)) < 0))
+    return -1;
+  if (fstat(fd, &st) || (st.st_size < 44)) {
+    close(fd);
+    return -1;
+  }
+  c->maplen = st.st_size;
+  c->map = mmap(NULL, c->maplen, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (c->map == MAP_FAILED)
+    return -1;
+
+  strncpy(idx, file, PATH_MAX - 5);
+  idx[PATH_MAX - 5] = '\0';
+  if ((dot = strrchr(idx, '.')) && !strchr(dot, '/'))
+    *dot = '\0';
+  strcat(idx, ".idx");
+  if (read_header(c) || ((n = read_index(idx, ncorpus)) < 0)) {
+    munmap((void *)c->map, c->maplen);
+    return -1;
+  }
+  strncpy(c->name, file, PATH_MAX - 1);
+  ncorpus++;
+  return n;
+}
+
+
+// segments of all corpora
+int corpus_size() {
+  return nsegs;
+}
+
+
+// file name of the first corpus, for the display
+const char *corpus_name() {
+  const char *s = strrchr(corpora[0].name, '/');
+
+  return s ? s + 1 : corpora[0].name;
+}
+
+
+// find the format and the audio of a WAV file, 16 bit PCM only. All
+// of the file after the start of the data chunk is audio, the length
+// is wrong in files over 4 GB. returns 0 or -1
+static int read_header(struct corpus *c) {
+  const unsigned char *p = c->map + 12, *end = c->map + c->maplen;
+  unsigned long len;
+  int fmt = 0, bits = 0;
+
+  if ((memcmp(c->map, "RIFF", 4) && memcmp(c->map, "RF64", 4)) ||
+      memcmp(c->map + 8, "WAVE", 4))
+    return -1;
+  c->data = NULL;
+  while ((p + 8 <= end) && !c->data) {
+    len = get32(p + 4);
+    if (!memcmp(p, "fmt ", 4) && (p + 24 <= end)) {
+      fmt = get16(p + 8);
+      c->channels = get16(p + 10);
+      c->rate = get32(p + 12);
+      bits = get16(p + 22);
+    } else if (!memcmp(p, "data", 4) && fmt) {
+      c->data = p + 8;
+    }
+    p += 8 + len + (len & 1);
+  }
+  if (!c->data || ((fmt != 1) && (fmt != 0xfffe)) || (bits != 16) ||
+      (c->channels < 1) || (c->rate < 1000))
+    return -1;
+  c->frames = (end - c->data) / (2 * c->channels);
+  return 0;
+}
+
+
+// add the segments in the index of corpus k, lines that are no segment
+// of the file are skipped. returns their number or -1
+static int read_index(const char *file, int k) {
+  struct corpus *c = &corpora[k];
+  struct segment *s;
+  char line[256], text[80];
+  long start, len;
+  FILE *fh;
+  int n = 0, i;
+  void *p;
+
+  if ((fh = fopen(file, "r")) == NULL)
+    return -1;
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    if ((line[0] == '#') ||
+        (sscanf(line, "%ld %ld %79[^\r\n]", &start, &len, text) != 3))
+      continue;
+    for (i = strlen(text); i && (text[i - 1] == ' '); i--)
+      text[i - 1] = '\0';
+    if ((start < 0) || (len <= 0) || (start + len > c->frames) ||
+        (strlen(text) > CALLLEN - 1))
+      continue;
+    if (nsegs == segsize) {
+      segsize = 2 * segsize + 1024;
+      if ((p = realloc(segs, segsize * sizeof(*segs))) == NULL)
+        break;
+      segs = p;
+    }
+    s = &segs[nsegs++];
+    s->file = k;
+    s->start = start;
+    s->len = len;
+    for (i = 0; text[i]; i++)
+      s->text[i] = toupper(text[i]);
+    s->text[i] = '\0';
+    n++;
+  }
+  fclose(fh);
+  return n;
+}
+
+
+// draw up to max segments at random and put their transcripts into
+// out, like load_callbase(). returns the number of calls
+int corpus_calls(char (*out)[CALLLEN], int max, int *single) {
+  int i, j, maxlen = 0;
+
+  if (max > MAXCALLS)
+    max = MAXCALLS;
+  for (i = 0; i < nsegs; i++) {
+    j = (i < max) ? i : rand() % (i + 1);
+    if (j < max)
+      drawn[j] = i;
+  }
+  ndrawn = (nsegs < max) ? nsegs : max;
+  for (i = 0; i < ndrawn; i++) {
+    strcpy(out[i], segs[drawn[i]].text);
+    if (strlen(out[i]) > maxlen)
+      maxlen = strlen(out[i]);
+  }
+  drawnto = out;
+  *single = (maxlen == 1);
+  return ndrawn;
+}
+
+
+// segment of a call put there by corpus_calls(), or of another drawn
+// segment with the same transcript. -1 if there is none
+int corpus_find(const char *text) {
+  int i;
+
+  if (drawnto && (text >= drawnto[0]) && (text < drawnto[ndrawn]))
+    return drawn[(text - drawnto[0]) / sizeof(*drawnto)];
+  for (i = 0; i < ndrawn; i++)
+    if (!strcmp(segs[drawn[i]].text, text))
+      return drawn[i];
+  return -1;
+}
+
+
+// length of a segment in frames at rate
+long corpus_length(int seg, long rate) {
+  return (double)segs[seg].len * rate / corpora[segs[seg].file].rate;
+}
+
+
+// n frames from frame pos of a segment, mono and resampled to rate.
+// returns the number of frames, less at the end of the segment
+int corpus_read(int seg, long pos, short int *pcm, int n, long rate) {
+  struct segment *s = &segs[seg];
+  struct corpus *c = &corpora[s->file];
+  double step = (double)c->rate / rate, x;
+  long len = corpus_length(seg, rate), k;
+  int i, a, b;
+
+  if (pos == 0)                     // read ahead
+    advise(seg, MADV_WILLNEED);
+  if (pos + n > len)
+    n = (pos < len) ? len - pos : 0;
+  for (i = 0; i < n; i++) {
+    x = (pos + i) * step;
+    k = x;
+    a = frame(c, s->start + k);
+    b = (k + 1 < s->len) ? frame(c, s->start + k + 1) : a;
+    pcm[i] = a + (b - a) * (x - k);
+  }
+  return n;
+}
+
+
+// frame k of a corpus, the channels mixed
+static int frame(const struct corpus *c, long k) {
+  const unsigned char *p = c->data + (size_t)k * 2 * c->channels;
+  int ch, sum = 0;
+
+  for (ch = 0; ch < c->channels; ch++, p += 2)
+    sum += (short int)get16(p);
+  return sum / c->channels;
+}
+
+
+// the segment was played, its pages are no longer needed
+void corpus_done(int seg) {
+  advise(seg, MADV_DONTNEED);
+}
+
+
+// madvise() the pages of a segment
+static void advise(int seg, int advice) {
+  struct segment *s = &segs[seg];
+  struct corpus *c = &corpora[s->file];
+  size_t a = (c->data - c->map) + (size_t)s->start * 2 * c->channels;
+  size_t b = a + (size_t)s->len * 2 * c->channels;
+
+  a -= a % sysconf(_SC_PAGESIZE);
+  madvise((void *)(c->map + a), b - a, advice);
+}
@@ -0,0 +1,43 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_CORPUS
+#define QRQ_CORPUS
+
+// Recorded corpora: a 16 bit PCM WAV file with an index next to it, the
+// same name ending in .idx. Every line of the index is a segment
+//   <first frame> <frames> <transcript>
+// in frames of the WAV file, # starts a comment. Segments are drawn like
+// the calls of a callbase, transcripts longer than a call are skipped.
+// The WAV file is mapped, only the pages of the segment playing now are
+// read and they are dropped when it is done.
+
+#include "callbase.h"
+
+#define MAXCORPUS  16    // corpus files
+
+int  corpus_open(const char *file);
+int  corpus_size();
+const char *corpus_name();
+int  corpus_calls(char (*out)[CALLLEN], int max, int *single);
+int  corpus_find(const char *text);
+long corpus_length(int seg, long rate);
+int  corpus_read(int seg, long pos, short int *pcm, int n, long rate);
+void corpus_done(int seg);
+
+#endif
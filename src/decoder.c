@@ -0,0 +1,307 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// CW decoder
+//
+// A Goertzel filterbank covers MINFREQ..MAXFREQ in DEC_STEP steps. It is
+// run every hop over the last win samples (one period of MINFREQ), the
+// bin with the most energy is taken as the tone and its magnitude as the
+// envelope. The envelope is sliced with hysteresis against the peak
+// level into marks and gaps.
+//
+// Marks and gaps are kept until both dots and dashes were seen, then the
+// dot length is estimated with 2-means and followed while decoding. The
+// elements are mapped back to characters with the table of morse_code().
+
+#include <string.h>
+#include <math.h>
+
+#include "decoder.h"
+
+#define MINLEVEL  300.0            // lowest tone amplitude, of 32767
+#define EOTSEC    0.5              // min. silence after a transmission
+
+static char codechar[128];         // dots and dashes -> character
+
+static void build_table();
+static void hop(struct decoder *d, char *out, int size, int *n);
+static void event(struct decoder *d, int len, char *out, int size, int *n);
+static void element(struct decoder *d, int ismark, int len,
+                    char *out, int size, int *n);
+static int  estimate(struct decoder *d, int force,
+                     char *out, int size, int *n);
+static void end_char(struct decoder *d, char *out, int size, int *n);
+static void emit(int c, char *out, int size, int *n);
+
+
+void decoder_init(struct decoder *d, long samplerate) {
+  int k;
+
+  build_table();
+  memset(d, 0, sizeof(*d));
+  d->samplerate = samplerate;
+  d->win = samplerate / MINFREQ;
+  if (d->win > DEC_MAXWIN)
+    d->win = DEC_MAXWIN;
+  d->hop = d->win / 4;
+  for (k = 0; k < DEC_NBINS; k++)
+    d->coef[k] = 2 * cos(2 * PI * (MINFREQ + k * DEC_STEP) / samplerate);
+  d->code = 1;
+}
+
+
+// decode n samples, the text found so far is appended to out
+// returns the number of characters written
+int decoder_feed(struct decoder *d, const short *pcm, int n,
+                 char *out, int size) {
+  int i, nout = 0;
+
+  for (i = 0; i < n; i++) {
+    d->ring[d->rpos] = pcm[i];
+    d->rpos = (d->rpos + 1) % d->win;
+    if (d->fill < d->win)
+      d->fill++;
+    if ((++d->since >= d->hop) && (d->fill == d->win)) {
+      d->since = 0;
+      hop(d, out, size, &nout);
+    }
+  }
+  if (size > 0)
+    out[nout < size ? nout : size - 1] = '\0';
+  return nout;
+}
+
+
+// end of input, decode what is left
+int decoder_flush(struct decoder *d, char *out, int size) {
+  int nout = 0;
+
+  if (d->started && !d->eot) {
+    if (d->mark)
+      event(d, d->run, out, size, &nout);
+    if (!d->unit)
+      estimate(d, 1, out, size, &nout);
+    end_char(d, out, size, &nout);
+    d->eot = 1;
+  }
+  if (size > 0)
+    out[nout < size ? nout : size - 1] = '\0';
+  return nout;
+}
+
+
+// estimated speed in cpm, 0 if not known yet
+int decoder_speed(const struct decoder *d) {
+  if (!d->unit)
+    return 0;
+  return (int)(6.0 * d->samplerate / (d->unit * d->hop) + 0.5);
+}
+
+
+int decoder_freq(const struct decoder *d) {
+  return MINFREQ + d->bin * DEC_STEP;
+}
+
+
+static void build_table() {
+  const char *chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789/=.!,;#+-?";
+  const char *code;
+  int i, idx;
+
+  if (codechar[1])
+    return;
+  memset(codechar, '?', sizeof(codechar));
+  for (i = 0; chars[i]; i++) {
+    code = morse_code(chars[i]);
+    for (idx = 1; *code; code++)
+      idx = 2 * idx + (*code == '-');
+    codechar[idx] = chars[i];
+  }
+}
+
+
+// one step of the filterbank and the slicer
+static void hop(struct decoder *d, char *out, int size, int *n) {
+  decvec c[DEC_NVEC], v1[DEC_NVEC], v2[DEC_NVEC], v0;
+  double s1[DEC_NVEC * DEC_LANES], s2[DEC_NVEC * DEC_LANES];
+  double x, p, best = 0, env, thr;
+  int i, j, k;
+
+  // all bins at once, DEC_LANES of them per vector. The bins past
+  // DEC_NBINS have a coefficient of 0 and are not looked at
+  memset(c, 0, sizeof(c));
+  memcpy(c, d->coef, sizeof(d->coef));
+  memset(v1, 0, sizeof(v1));
+  memset(v2, 0, sizeof(v2));
+  for (i = 0, j = d->rpos; i < d->win; i++) {
+    x = d->ring[j];
+    if (++j == d->win)
+      j = 0;
+    for (k = 0; k < DEC_NVEC; k++) {
+      v0 = x + c[k] * v1[k] - v2[k];
+      v2[k] = v1[k];
+      v1[k] = v0;
+    }
+  }
+  memcpy(s1, v1, sizeof(s1));
+  memcpy(s2, v2, sizeof(s2));
+  for (k = 0; k < DEC_NBINS; k++) {
+    p = s1[k] * s1[k] + s2[k] * s2[k] - d->coef[k] * s1[k] * s2[k];
+    d->energy[k] = 0.95 * d->energy[k] + p;
+    if (d->energy[k] > best) {
+      best = d->energy[k];
+      d->bin = k;
+    }
+  }
+  k = d->bin;
+  p = s1[k] * s1[k] + s2[k] * s2[k] - d->coef[k] * s1[k] * s2[k];
+  env = 2 * sqrt(p > 0 ? p : 0) / d->win;                   // amplitude
+
+  // the peak falls to half in a second, noise is followed in gaps
+  d->peak *= pow(0.5, (double)d->hop / d->samplerate);
+  if (env > d->peak)
+    d->peak = env;
+  if (!d->mark)
+    d->noise += 0.01 * (env - d->noise);
+  thr = 0.5 * d->peak;
+  if (thr < 3 * d->noise)
+    thr = 3 * d->noise;
+  if (thr < MINLEVEL)
+    thr = MINLEVEL;
+
+  d->hops++;
+  d->run++;
+  if ((!d->mark && (env > thr)) || (d->mark && (env < 0.8 * thr))) {
+    if (d->started && !d->eot)
+      event(d, d->run, out, size, n);
+    d->mark = !d->mark;
+    d->started = 1;
+    d->eot = 0;
+    d->run = 0;
+  } else if (!d->mark && d->started && !d->eot &&
+             (d->run * d->hop > EOTSEC * d->samplerate) &&
+             (!d->unit || d->run > 14 * d->unit)) {
+    // long silence, the transmission is over
+    if (!d->unit)
+      estimate(d, 1, out, size, n);
+    end_char(d, out, size, n);
+    emit('\n', out, size, n);
+    d->eot = 1;
+  }
+}
+
+
+// a mark (when d->mark is set) or gap has ended
+static void event(struct decoder *d, int len, char *out, int size, int *n) {
+  if (d->unit) {
+    element(d, d->mark, len, out, size, n);
+    return;
+  }
+  if (d->nev < DEC_MAXEV)
+    d->ev[d->nev++] = len;
+  if (d->mark)
+    estimate(d, d->nev >= DEC_MAXEV - 1, out, size, n);
+}
+
+
+// classify a mark or gap with the known unit
+static void element(struct decoder *d, int ismark, int len,
+                    char *out, int size, int *n) {
+  if (ismark) {
+    if (len > 2 * d->unit) {
+      d->code = 2 * d->code + 1;
+      d->unit += 0.2 * (len / 3.0 - d->unit);
+    } else {
+      d->code = 2 * d->code;
+      d->unit += 0.2 * (len - d->unit);
+    }
+    if (d->code >= 128)
+      d->code = 0;                  // too long, ends as '?'
+  } else if (len > 2 * d->unit) {
+    end_char(d, out, size, n);
+    if (len > 5 * d->unit)
+      emit(' ', out, size, n);
+  }
+}
+
+
+// find the unit from the waiting marks, then decode them
+// without force, dots and dashes must both have been seen
+static int estimate(struct decoder *d, int force,
+                    char *out, int size, int *n) {
+  double lo = 1e9, hi = 0, c1, c2, s1, s2, t;
+  int i, it, n1, n2, ev[DEC_MAXEV], nev = d->nev;
+
+  for (i = 0; i < d->nev; i += 2) {
+    if (d->ev[i] < lo) lo = d->ev[i];
+    if (d->ev[i] > hi) hi = d->ev[i];
+  }
+  if (!d->nev)
+    return 0;
+
+  if (hi > 2 * lo) {
+    c1 = lo;
+    c2 = hi;
+    for (it = 0; it < 8; it++) {
+      t = (c1 + c2) / 2;
+      s1 = s2 = n1 = n2 = 0;
+      for (i = 0; i < d->nev; i += 2) {
+        if (d->ev[i] < t) {
+          s1 += d->ev[i];
+          n1++;
+        } else {
+          s2 += d->ev[i];
+          n2++;
+        }
+      }
+      c1 = s1 / n1;
+      c2 = s2 / n2;
+    }
+    d->unit = (s1 + s2 / 3) / (n1 + n2);
+  } else if (force) {
+    // only one kind of mark, the element gap tells which
+    for (i = 1; i < d->nev; i += 2)
+      if (d->ev[i] < lo)
+        lo = d->ev[i];
+    d->unit = lo;
+  } else {
+    return 0;
+  }
+
+  if (d->unit < 1)
+    d->unit = 1;
+  for (i = 0; i < nev; i++)
+    ev[i] = d->ev[i];
+  d->nev = 0;
+  for (i = 0; i < nev; i++)
+    element(d, !(i & 1), ev[i], out, size, n);
+  return 1;
+}
+
+
+static void end_char(struct decoder *d, char *out, int size, int *n) {
+  if (d->code != 1)
+    emit(d->code ? codechar[d->code] : '?', out, size, n);
+  d->code = 1;
+}
+
+
+static void emit(int c, char *out, int size, int *n) {
+  if (n && (*n < size - 1))
+    out[(*n)++] = c;
+}
@@ -0,0 +1,62 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_DECODER
+#define QRQ_DECODER
+
+#include "morse.h"
+
+#define DEC_STEP   25                                 // filterbank spacing, Hz
+#define DEC_NBINS  ((MAXFREQ - MINFREQ) / DEC_STEP + 1)
+#define DEC_MAXWIN (MAXRATE / MINFREQ)                // one period at MINFREQ
+#define DEC_MAXEV  256                                // undecided marks + gaps
+#define DEC_LANES  4                                  // doubles per vector
+#define DEC_NVEC   ((DEC_NBINS + DEC_LANES - 1) / DEC_LANES)
+
+typedef double decvec __attribute__((vector_size(DEC_LANES * sizeof(double))));
+
+// state of one CW decoder, all lengths are counted in hops
+struct decoder {
+  long samplerate;
+  int win;                         // Goertzel window, samples
+  int hop;                         // samples between two windows
+  double coef[DEC_NBINS];          // 2 cos(w) of every bin
+  double energy[DEC_NBINS];        // smoothed power, selects the tone bin
+  int bin;                         // current tone bin
+  float ring[DEC_MAXWIN];          // the last win samples
+  int rpos, fill, since;
+  double peak, noise;              // signal and noise level
+  int mark;                        // tone on
+  int started;                     // first mark seen
+  int eot;                         // end of transmission reported
+  long run;                        // length of the current mark or gap
+  double unit;                     // dot length, 0 = not known yet
+  int ev[DEC_MAXEV];               // marks and gaps waiting for the unit
+  int nev;
+  int code;                        // character being received, 1 = empty
+  long hops;
+};
+
+void decoder_init(struct decoder *d, long samplerate);
+int  decoder_feed(struct decoder *d, const short *pcm, int n,
+                  char *out, int size);
+int  decoder_flush(struct decoder *d, char *out, int size);
+int  decoder_speed(const struct decoder *d);
+int  decoder_freq(const struct decoder *d);
+
+#endif
@@ -0,0 +1,345 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// The country file compiled into a prefix trie, see dxcc.h. The file is
+// parsed in place, the names of the entities point into it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "dxcc.h"
+
+#define DXSYM  37        // characters of the symbols string
+
+// a node of the trie, its children are node[first..] in the order of
+// the bits set in kids
+struct dxnode {
+  uint64_t kids;         // bit of every symbol that has a child
+  int first;             // index of the first child
+  short pre, exact;      // entity + 1 of the prefix / exact call, 0 if none
+};
+
+// a prefix or exact call of the file
+struct dxkey {
+  const char *s;
+  int seq;               // order in the file, qsort() is not stable
+  short info;            // index in info
+  char exact;
+};
+
+static const char symbols[] = "/0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static signed char symbol[256];        // index in symbols, -1 if none
+
+static char *text = NULL;              // the file, names point into it
+static struct dxcc *info = NULL;       // every entity with its zones
+static int ninfo = 0, infosize = 0, entities = 0;
+static struct dxkey *key = NULL;
+static int nkeys = 0, keysize = 0;
+static struct dxnode *node = NULL;     // node 0 is the root
+static int nnodes = 0;
+
+static int grow(void *array, int *size, int n, size_t elem);
+static int parse(char *rec);
+static int add_key(char *item, int entity);
+static void build(int k, int lo, int hi, int d);
+static int walk(const char *s, int exact);
+
+
+// by prefix, equal prefixes in the order of the file
+static int cmp_key(const void *a, const void *b) {
+  const struct dxkey *x = a, *y = b;
+  int c = strcmp(x->s, y->s);
+
+  return c ? c : x->seq - y->seq;
+}
+
+
+// read a country file and compile it
+// returns the number of entities or -1
+int dxcc_load(const char *file) {
+  FILE *fh;
+  char *rec, *end;
+  long size;
+  int i, chars = 0;
+
+  memset(symbol, -1, sizeof(symbol));
+  for (i = 0; i < DXSYM; i++)
+    symbol[(unsigned char)symbols[i]] = i;
+
+  free(text);
+  free(info);
+  free(key);
+  free(node);
+  text = NULL;
+  info = NULL;
+  key = NULL;
+  node = NULL;
+  ninfo = infosize = entities = nkeys = keysize = nnodes = 0;
+
+  if ((fh = fopen(file, "r")) == NULL)
+    return -1;
+  fseek(fh, 0, SEEK_END);
+  size = ftell(fh);
+  rewind(fh);
+  if ((size <= 0) || ((text = malloc(size + 1)) == NULL) ||
+      (fread(text, 1, size, fh) != size)) {
+    fclose(fh);
+    return -1;
+  }
+  fclose(fh);
+  text[size] = '\0';
+
+  // an entity is a header line and its prefixes, up to a ;
+  for (rec = text; (end = strchr(rec, ';')) != NULL; rec = end + 1) {
+    *end = '\0';
+    if (parse(rec) < 0)
+      return -1;
+  }
+  if (!nkeys)
+    return -1;
+
+  qsort(key, nkeys, sizeof(*key), cmp_key);
+  for (i = 0; i < nkeys; i++)
+    chars += strlen(key[i].s);
+  if ((node = calloc(chars + 1, sizeof(*node))) == NULL)
+    return -1;
+  nnodes = 1;
+  build(0, 0, nkeys, 0);
+
+  // the keys point into text, only the trie is kept
+  free(key);
+  key = NULL;
+  return entities;
+}
+
+
+// number of entities loaded, 0 if there is no country file
+int dxcc_entities() {
+  return node ? entities : 0;
+}
+
+
+// make room for one more element in the array *array of *size
+// returns -1 if out of memory
+static int grow(void *array, int *size, int n, size_t elem) {
+  void *p;
+
+  if (n < *size)
+    return 0;
+  if ((p = realloc(*(void **)array, (n ? 2 * n : 64) * elem)) == NULL)
+    return -1;
+  *(void **)array = p;
+  *size = n ? 2 * n : 64;
+  return 0;
+}
+
+
+// parse one entity:
+// Name: CQ: ITU: Continent: Lat: Lon: TZ: Main prefix: item, item, ...
+// returns -1 if out of memory
+static int parse(char *rec) {
+  char *field[8], *p, *item, *save;
+  struct dxcc *d;
+  int f;
+
+  for (f = 0, p = rec; f < 8; f++) {
+    while (isspace((unsigned char)*p))
+      p++;
+    field[f] = p;
+    if ((p = strchr(p, ':')) == NULL)
+      return 0;                         // not an entity, e.g. the end
+    *p++ = '\0';
+  }
+
+  if (grow(&info, &infosize, ninfo, sizeof(*info)) < 0)
+    return -1;
+  d = &info[ninfo++];
+  d->name = field[0];
+  d->prefix = field[7] + (field[7][0] == '*');  // * is only for the WAE
+  d->cq = atoi(field[1]);
+  d->itu = atoi(field[2]);
+  snprintf(d->cont, sizeof(d->cont), "%s", field[3]);
+  entities++;
+
+  for (item = strtok_r(p, ", \t\r\n", &save); item;
+       item = strtok_r(NULL, ", \t\r\n", &save))
+    if (add_key(item, ninfo - 1) < 0)
+      return -1;
+  return 0;
+}
+
+
+// add a prefix or exact call with its zones, (CQ) [ITU] {continent},
+// <lat/lon> and ~TZ~ are ignored. The zones that differ from those of
+// the entity are one more info
+// returns -1 if out of memory
+static int add_key(char *item, int entity) {
+  struct dxcc d = info[entity];
+  char *p, *q;
+  int i, exact = 0;
+
+  if (*item == '=') {
+    exact = 1;
+    item++;
+  }
+  for (p = item; *p && (symbol[(unsigned char)*p] >= 0); p++)
+    ;
+  if ((p == item) || (p - item >= DXCALL))
+    return 0;
+  for (q = p; *q; q++) {
+    if (*q == '(')
+      d.cq = atoi(q + 1);
+    else if (*q == '[')
+      d.itu = atoi(q + 1);
+    else if ((*q == '{') && q[1] && q[2])
+      snprintf(d.cont, sizeof(d.cont), "%.2s", q + 1);
+  }
+  *p = '\0';
+
+  // the infos of an entity are the last ones
+  for (i = ninfo - 1; i > entity; i--)
+    if ((info[i].cq == d.cq) && (info[i].itu == d.itu) &&
+        !strcmp(info[i].cont, d.cont))
+      break;
+  if ((i == entity) && ((d.cq != info[entity].cq) ||
+      (d.itu != info[entity].itu) || strcmp(d.cont, info[entity].cont))) {
+    if (grow(&info, &infosize, ninfo, sizeof(*info)) < 0)
+      return -1;
+    info[i = ninfo++] = d;
+  }
+
+  if (grow(&key, &keysize, nkeys, sizeof(*key)) < 0)
+    return -1;
+  key[nkeys].s = item;
+  key[nkeys].seq = nkeys;
+  key[nkeys].info = i;
+  key[nkeys++].exact = exact;
+  return 0;
+}
+
+
+// make the children of node k from the sorted keys lo..hi-1, which
+// share their first d characters and are longer than that
+static void build(int k, int lo, int hi, int d) {
+  uint64_t kids = 0, bit;
+  int i, j, m, c;
+
+  for (i = lo; i < hi; i++)
+    kids |= 1ULL << symbol[(unsigned char)key[i].s[d]];
+  node[k].kids = kids;
+  node[k].first = nnodes;
+  nnodes += __builtin_popcountll(kids);
+
+  for (i = lo; i < hi; i = j) {
+    bit = 1ULL << symbol[(unsigned char)key[i].s[d]];
+    c = node[k].first + __builtin_popcountll(kids & (bit - 1));
+    for (j = i; (j < hi) && (key[j].s[d] == key[i].s[d]); j++)
+      ;
+    // the keys that end here sort first, a later one of the same
+    // prefix wins as in the file
+    for (m = i; (m < j) && !key[m].s[d + 1]; m++) {
+      if (key[m].exact)
+        node[c].exact = key[m].info + 1;
+      else
+        node[c].pre = key[m].info + 1;
+    }
+    if (m < j)
+      build(c, m, j, d + 1);
+  }
+}
+
+
+// the info of the longest prefix of s, or of s if it is an exact call
+// (only that with exact set). returns -1 if there is none
+static int walk(const char *s, int exact) {
+  uint64_t bit;
+  int k = 0, best = -1, c;
+
+  for (; *s; s++) {
+    if ((c = symbol[(unsigned char)*s]) < 0)
+      return exact ? -1 : best;
+    bit = 1ULL << c;
+    if (!(node[k].kids & bit))
+      return exact ? -1 : best;
+    k = node[k].first + __builtin_popcountll(node[k].kids & (bit - 1));
+    if (node[k].pre && !exact)
+      best = node[k].pre - 1;
+  }
+  return node[k].exact ? node[k].exact - 1 : exact ? -1 : best;
+}
+
+
+// the country of a call, NULL if it is not known
+const struct dxcc *dxcc_find(const char *call) {
+  static const char *portable[] = { "P", "M", "A", "QRP", "LH", NULL };
+  char buf[DXCALL], *a, *b;
+  int i;
+
+  if (!node || (strlen(call) >= DXCALL))
+    return NULL;
+  if (!strchr(call, '/')) {
+    i = walk(call, 0);
+    return (i < 0) ? NULL : &info[i];
+  }
+  if ((i = walk(call, 1)) >= 0)
+    return &info[i];
+
+  // drop /P, /QRP, /4, ... at the end, then the shorter part is the
+  // country, the first one if they are equal
+  strcpy(buf, call);
+  while ((b = strrchr(buf, '/')) != NULL) {
+    if (!strcmp(b, "/MM") || !strcmp(b, "/AM"))
+      return NULL;
+    for (i = 0; portable[i] && strcmp(b + 1, portable[i]); i++)
+      ;
+    if (!portable[i] && !(isdigit((unsigned char)b[1]) && !b[2]))
+      break;
+    *b = '\0';
+  }
+  a = buf;
+  if ((b = strchr(buf, '/')) != NULL) {
+    *b++ = '\0';
+    if (strlen(b) < strlen(a))
+      a = b;
+  }
+  i = *a ? walk(a, 0) : -1;
+  return (i < 0) ? NULL : &info[i];
+}
+
+
+// the country of s if it looks like a callsign: 3 to 15 characters,
+// letters, digits and /, at least one of each letters and digits
+// returns NULL for other entries of a callbase, e.g. words
+const struct dxcc *dxcc_call(const char *s) {
+  int l, digit = 0, alpha = 0;
+
+  for (l = 0; s[l]; l++) {
+    if (isdigit((unsigned char)s[l]))
+      digit = 1;
+    else if (isupper((unsigned char)s[l]))
+      alpha = 1;
+    else if (s[l] != '/')
+      return NULL;
+  }
+  if ((l < 3) || (l >= DXCALL) || !digit || !alpha)
+    return NULL;
+  return dxcc_find(s);
+}
@@ -0,0 +1,45 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_DXCC
+#define QRQ_DXCC
+
+// The country of a callsign: DXCC entity, CQ and ITU zone and continent,
+// from a country file in the format of cty.dat (see callsigns/cty.dat).
+// The prefixes and the exact calls (=) are compiled into a trie when the
+// file is loaded, of 16 byte nodes whose children are one block found
+// with a bit mask, so a lookup reads one node per character.
+//
+// A portable call is looked up by the part that names the country:
+// DL/K1ABC is in DL, K1ABC/P and K1ABC/4 in K, /MM and /AM are in none.
+
+#define DXCALL  16       // longest call that is looked up
+
+struct dxcc {
+  const char *name;      // entity, the same pointer for all of its zones
+  const char *prefix;    // main prefix
+  short cq, itu;         // zones
+  char cont[3];          // continent
+};
+
+int dxcc_load(const char *file);
+int dxcc_entities();
+const struct dxcc *dxcc_find(const char *call);
+const struct dxcc *dxcc_call(const char *s);
+
+#endif
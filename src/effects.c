@@ -0,0 +1,249 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Receiving conditions: noise, fading (QSB), an interfering station
+// (QRM) and the receiver's bandpass filter, applied to rendered samples
+// block by block. Everything but the filter works on whole vectors of
+// FXLANES floats, the filter is recursive and runs per sample.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "morse.h"
+#include "effects.h"
+
+#define IHMEAN   510.0f          // sum of four random bytes: mean
+#define IHSD     147.8f          // and standard deviation
+
+struct effects effects = { 0, 0, 0, 0 };
+
+static unsigned int seed = 1;           // own sequence, rand() picks the calls
+
+union fxblock {
+  fxvec v[FXBLOCK / FXLANES];
+  fxivec i[FXBLOCK / FXLANES];
+  float f[FXBLOCK];
+  int n[FXBLOCK];
+};
+
+static void render_qrm(struct fxstate *st, long samplerate, int freq,
+                       int speed);
+static void bandpass(struct biquad *bq, long samplerate, int freq, double q);
+static double qsb_gain(const struct fxstate *st, double t);
+
+
+// state of the random sequence, the next fx_init() starts from it
+unsigned int fx_seed() {
+  return seed;
+}
+
+
+// continue the random sequence from s
+void fx_reseed(unsigned int s) {
+  seed = s;
+}
+
+
+// 1 if any effect is switched on
+int fx_active(const struct effects *fx) {
+  return fx->noise || fx->qsb || fx->qrm || fx->filter;
+}
+
+
+// start a new signal at freq, st keeps the interference between calls
+void fx_init(struct fxstate *st, const struct effects *fx, long samplerate,
+             int freq, int speed) {
+  double noise, width;
+  int k;
+
+  st->fx = *fx;
+  st->samplerate = samplerate;
+  st->t = 0;
+  for (k = 0; k < FXLANES; k++)
+    st->rng[k] = rand_r(&seed) | 1;
+  for (k = 0; k < 2; k++) {
+    st->qsbrate[k] = (k ? 0.05 : 0.15) + 0.1 * rand_r(&seed) / RAND_MAX;
+    st->qsbphase[k] = 2 * PI * rand_r(&seed) / RAND_MAX;
+  }
+
+  // two equal sections, each one wider so the pair has the bandwidth
+  memset(st->bq, 0, sizeof(st->bq));
+  if (fx->filter > 0) {
+    bandpass(&st->bq[0], samplerate, freq, freq / (fx->filter * 1.554));
+    st->bq[1] = st->bq[0];
+  }
+
+  // leave room for the noise peaks that get through the filter
+  noise = fx->noise / 100.0 * M_SQRT1_2;
+  if (fx->filter > 0) {
+    width = 2.0 * fx->filter / samplerate;
+    noise *= sqrt(width < 1.0 ? width : 1.0);
+  }
+  st->gain = 1.0 / (1.0 + fx->qrm / 100.0 + 4.0 * noise);
+
+  if (fx->qrm) {
+    if (!st->qrm || (st->qrmrate != samplerate) || (st->qrmfreq != freq))
+      render_qrm(st, samplerate, freq, speed);
+    if (st->qrmlen)
+      st->qrmpos = rand_r(&seed) % st->qrmlen;
+  }
+}
+
+
+// run n samples of buf through the chain, in place
+void fx_process(struct fxstate *st, int *buf, int n) {
+  const fxvec ramp = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  union fxblock x, q;
+  struct effects *fx = &st->fx;
+  float g0, g1, lvl, v;
+  float nscale = fx->noise / 100.0 * M_SQRT1_2 * 32500.0 / IHSD;
+  fxuvec r, s;
+  int pos, m, i, j, k;
+
+  for (pos = 0; pos < n; pos += m) {
+    m = (n - pos < FXBLOCK) ? n - pos : FXBLOCK;
+    memset(&x, 0, sizeof(x));
+    memcpy(x.n, buf + pos, m * sizeof(int));
+    for (j = 0; j < FXBLOCK / FXLANES; j++)
+      x.v[j] = __builtin_convertvector(x.i[j], fxvec);
+
+    // fading, the gain is interpolated across the block
+    if (fx->qsb) {
+      g0 = qsb_gain(st, st->t);
+      g1 = qsb_gain(st, st->t + (double)FXBLOCK / st->samplerate);
+      for (j = 0; j < FXBLOCK / FXLANES; j++)
+        x.v[j] *= g0 + (g1 - g0) * (ramp + (float)(j * FXLANES)) / (float)FXBLOCK;
+    }
+
+    // the interfering station, looped
+    if (fx->qrm && st->qrmlen) {
+      for (i = 0; i < FXBLOCK; i += k) {
+        k = st->qrmlen - st->qrmpos;
+        if (k > FXBLOCK - i)
+          k = FXBLOCK - i;
+        memcpy(&q.f[i], &st->qrm[st->qrmpos], k * sizeof(float));
+        st->qrmpos = (st->qrmpos + k) % st->qrmlen;
+      }
+      st->qrmpos = (st->qrmpos + m - FXBLOCK + st->qrmlen) % st->qrmlen;
+      lvl = fx->qrm / 100.0;
+      for (j = 0; j < FXBLOCK / FXLANES; j++)
+        x.v[j] += lvl * q.v[j];
+    }
+
+    // white noise, a sum of four random bytes is close to gaussian
+    if (fx->noise) {
+      r = st->rng;
+      for (j = 0; j < FXBLOCK / FXLANES; j++) {
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        s = (r & 255) + ((r >> 8) & 255) + ((r >> 16) & 255) + (r >> 24);
+        x.v[j] += (__builtin_convertvector(s, fxvec) - IHMEAN) * nscale;
+      }
+      st->rng = r;
+    }
+
+    for (i = 0; i < m; i++) {
+      v = x.f[i];
+      if (fx->filter > 0) {
+        for (k = 0; k < 2; k++) {
+          struct biquad *b = &st->bq[k];
+          float y = b->b0 * v + b->z1;
+          b->z1 = -b->a1 * y + b->z2;
+          b->z2 = b->b2 * v - b->a2 * y;
+          v = y;
+        }
+      }
+      v *= st->gain;
+      if (v > 32767.0f)
+        v = 32767.0f;
+      else if (v < -32767.0f)
+        v = -32767.0f;
+      buf[pos + i] = (int)v;
+    }
+    st->t += (double)m / st->samplerate;
+  }
+}
+
+
+void fx_free(struct fxstate *st) {
+  free(st->qrm);
+  st->qrm = NULL;
+  st->qrmlen = 0;
+}
+
+
+// QSB: two slow sines with random rates, 1 = no fading
+static double qsb_gain(const struct fxstate *st, double t) {
+  double fade = 0.5 + 0.3 * sin(2 * PI * st->qsbrate[0] * t + st->qsbphase[0]) +
+                0.2 * sin(2 * PI * st->qsbrate[1] * t + st->qsbphase[1]);
+  return 1.0 - st->fx.qsb / 100.0 * fade;
+}
+
+
+// bandpass with 0 dB at freq (RBJ cookbook), direct form II transposed
+static void bandpass(struct biquad *bq, long samplerate, int freq, double q) {
+  double w0 = 2 * PI * freq / samplerate;
+  double alpha = sin(w0) / (2 * q);
+  double a0 = 1 + alpha;
+
+  bq->b0 = alpha / a0;
+  bq->b2 = -alpha / a0;
+  bq->a1 = -2 * cos(w0) / a0;
+  bq->a2 = (1 - alpha) / a0;
+  bq->z1 = bq->z2 = 0;
+}
+
+
+// another station close by: random groups, a bit slower or faster,
+// 150..350 Hz off the signal
+static void render_qrm(struct fxstate *st, long samplerate, int freq,
+                       int speed) {
+  static const char groupchars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  struct cwparams cp = { samplerate, speed, 0, freq, SINE, 4.0, 0, 0, 0 };
+  struct cwbuf out;
+  char text[64];
+  unsigned int qseed = samplerate ^ (freq * 2654435761u);
+  int i, k;
+
+  // the same station for a rate and frequency, so that a recorded
+  // signal can be made again from the seed of fx_init()
+  fx_free(st);
+  st->qrmrate = samplerate;
+  st->qrmfreq = freq;
+  out.size = QRMSEC * samplerate;
+  out.len = 0;
+  if ((out.buf = malloc(out.size * sizeof(int))) == NULL)
+    return;
+
+  cp.speed = speed * (70 + rand_r(&qseed) % 61) / 100;
+  k = 150 + rand_r(&qseed) % 201;
+  cp.freq = (rand_r(&qseed) & 1) ? freq + k : freq - k;
+  for (i = 0; i < sizeof(text) - 1; i++)
+    text[i] = (i % 6 == 5) ? ' ' : groupchars[rand_r(&qseed) % 36];
+  text[i] = '\0';
+  render_chars(&cp, text, &out);
+
+  if ((st->qrm = malloc(out.len * sizeof(float))) != NULL) {
+    for (i = 0; i < out.len; i++)
+      st->qrm[i] = out.buf[i];
+    st->qrmlen = out.len;
+  }
+  free(out.buf);
+}
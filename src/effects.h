@@ -0,0 +1,68 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_EFFECTS
+#define QRQ_EFFECTS
+
+#define FXBLOCK  256             // samples per processing block
+#define FXLANES  8               // floats per vector
+#define QRMSEC   8               // seconds of interference, played in a loop
+
+typedef float fxvec __attribute__((vector_size(FXLANES * sizeof(float))));
+typedef unsigned int fxuvec __attribute__((vector_size(FXLANES * sizeof(int))));
+typedef int fxivec __attribute__((vector_size(FXLANES * sizeof(int))));
+
+// receiving conditions, applied to the rendered samples
+struct effects {
+  int noise;                     // noise, % of the signal level (0 = off)
+  int qsb;                       // depth of the fading in %
+  int qrm;                       // level of an interfering station in %
+  int filter;                    // receiver bandwidth in Hz (0 = off)
+};
+
+struct biquad {
+  float b0, b2, a1, a2;          // b1 is 0 for a bandpass
+  float z1, z2;
+};
+
+// one signal going through the chain
+struct fxstate {
+  struct effects fx;
+  long samplerate;
+  fxuvec rng;                    // xorshift32 per lane
+  double t;                      // seconds processed
+  double qsbrate[2], qsbphase[2];
+  float gain;                    // headroom for noise and interference
+  struct biquad bq[2];
+  float *qrm;                    // the interfering station
+  long qrmrate;                  // qrm was rendered for this rate
+  int qrmfreq;                   // and this frequency
+  int qrmlen, qrmpos;
+};
+
+extern struct effects effects;
+
+int  fx_active(const struct effects *fx);
+unsigned int fx_seed();
+void fx_reseed(unsigned int s);
+void fx_init(struct fxstate *st, const struct effects *fx, long samplerate,
+             int freq, int speed);
+void fx_process(struct fxstate *st, int *buf, int n);
+void fx_free(struct fxstate *st);
+
+#endif
@@ -0,0 +1,202 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Null and file audio output with the same interface as pulseaudio.c.
+// Without a file name the audio is discarded, otherwise it is appended
+// to a mono 16 bit WAV file. Used by the headless driver qrqsim.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "pulseaudio.h"
+#include "morse.h"
+#include "fileaudio.h"
+#include "waterfall.h"
+
+char *sinkfile = NULL;      // WAV file to write to, NULL = discard audio
+int sinkpace = 0;           // 1 = block for the duration of the audio
+struct audiostats audiostats; // a file never runs out of samples
+
+static FILE *fh = NULL;
+static short int buf[FULLBUF];
+static int bufpos = 0;
+static unsigned long datalen = 0;   // bytes of audio in the file
+static atomic_int cancelled = 0;
+
+static void write_header();
+static long long now_ns();
+
+
+void *open_dsp() {
+  static int opened = 0;
+
+  // open the file and leave it open
+  if (opened) return fh;
+
+  if (sinkfile && ((fh = fopen(sinkfile, "w+b")) == NULL)) {
+    fprintf(stderr, "Couldn't open audio file %s\n", sinkfile);
+    exit(EXIT_FAILURE);
+  }
+  if (fh)
+    write_header();
+
+  audiostats.rate = samplerate;           // a file has no rate of its own
+  opened = 1;
+  return fh;
+}
+
+// write sample into the buffer
+void write_audio(void *bla, int *in, int size) {
+  int i = 0;
+  for (i = 0; (i < size / sizeof(int)) && (bufpos < FULLBUF); i++) {
+    buf[bufpos] = (short int)in[i];
+    bufpos++;
+  }
+}
+
+// add n samples that are already 16 bit to the buffer
+void write_pcm(void *bla, const short int *pcm, int n) {
+  if (n > FULLBUF - bufpos)
+    n = FULLBUF - bufpos;
+  memcpy(&buf[bufpos], pcm, n * sizeof(short int));
+  bufpos += n;
+}
+
+// append the buffer to the file, optionally in real time (20 ms chunks)
+// returns 0, 1 if cancelled or -1 if the file can't be written
+int close_audio(void *s) {
+  struct timespec ts = { 0, 20000000L };
+  int i, n, ret = 0;
+  int chunk = samplerate / 50;
+
+  for (i = 0; i < bufpos; i += n) {
+    if (atomic_load(&cancelled)) {
+      ret = 1;
+      break;
+    }
+    n = (bufpos - i < chunk) ? bufpos - i : chunk;
+    if (s) {
+      fseek(s, 0, SEEK_END);
+      if (fwrite(&buf[i], sizeof(short int), n, s) != n)
+        ret = -1;
+      datalen += n * sizeof(short int);
+    }
+    wf_feed(&buf[i], n, now_ns());
+    if (sinkpace)
+      nanosleep(&ts, NULL);
+  }
+  if (s) {
+    write_header();
+    fflush(s);
+  }
+  bufpos = 0;
+  return ret;
+}
+
+// append n samples of a continuous stream, paced in real time
+// returns 0, 1 if cancelled or -1 if the file can't be written
+int stream_audio(void *s, short int *pcm, int n) {
+  struct timespec ts = { 0, 0 };
+  int ret = 0;
+
+  if (atomic_load(&cancelled))
+    return 1;
+  if (s) {
+    fseek(s, 0, SEEK_END);
+    if (fwrite(pcm, sizeof(short int), n, s) != n)
+      ret = -1;
+    datalen += n * sizeof(short int);
+  }
+  wf_feed(pcm, n, now_ns());
+  if (sinkpace) {
+    ts.tv_nsec = 1000000000L / samplerate * n;
+    nanosleep(&ts, NULL);
+  }
+  return ret;
+}
+
+// a file has no latency
+long audio_latency(void *s) {
+  return 0;
+}
+
+// live audio goes to the same file
+void *open_live(long rate, int period) {
+  return open_dsp();
+}
+
+void close_live(void *s) {
+}
+
+// nothing to capture from
+void *open_capture(long rate) {
+  return NULL;
+}
+
+int read_capture(void *s, short int *pcm, int n) {
+  return -1;
+}
+
+void close_capture(void *s) {
+}
+
+// stop (1) or allow (0) playback, may be called from any thread
+void cancel_audio(int on) {
+  atomic_store(&cancelled, on);
+}
+
+// the playback buffer and its size in samples, for locking it
+short int *audio_buffer(long *n) {
+  *n = FULLBUF;
+  return buf;
+}
+
+
+static void put32(unsigned char *p, unsigned long v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// (re)write the WAV header for the current data length
+static void write_header() {
+  unsigned char h[44];
+
+  memcpy(h, "RIFF", 4);
+  put32(h + 4, 36 + datalen);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put32(h + 16, 16);                  // fmt chunk size
+  h[20] = 1; h[21] = 0;               // PCM
+  h[22] = 1; h[23] = 0;               // mono
+  put32(h + 24, samplerate);
+  put32(h + 28, samplerate * 2);      // bytes per second
+  h[32] = 2; h[33] = 0;               // bytes per frame
+  h[34] = 16; h[35] = 0;              // bits per sample
+  memcpy(h + 36, "data", 4);
+  put32(h + 40, datalen);
+
+  fseek(fh, 0, SEEK_SET);
+  fwrite(h, 1, sizeof(h), fh);
+}
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,395 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Live sidetone keyer for sending practice. A generator thread makes
+// the sidetone in periods of KEYPERIOD ms and writes them to a stream
+// of its own that the sound server keeps short, so a key is heard a
+// few ms after it is pressed.
+//
+// Keys come from an input event device (keyer= in qrqrc, left and right
+// Ctrl are the paddles) with press and release times, or from the
+// terminal. The terminal only reports presses, every press is one
+// element and held keys repeat; a straight key needs the device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <linux/input.h>
+
+#include "pulseaudio.h"
+#include "attempt.h"
+#include "keyer.h"
+#include "rt.h"
+
+#define TAPQ      64             // terminal presses not sent yet
+
+enum { IDLE, MARK, SPACE };
+
+int keyermode = KEYER_IAMBIC_B;
+char keyerdevice[KEYDEVLEN] = "";
+
+static struct cwparams params;
+static void *audio = NULL;
+static pthread_t genthread, devthread;
+static int devfd = -1;
+static atomic_int stop = 0;
+static atomic_int mode, dotlen;
+static atomic_int paddles = 0;
+static atomic_llong pressed = 0;        // time of the last press while idle
+
+// presses from the terminal, one element each
+static atomic_int taps[TAPQ];
+static atomic_int taphead = 0, taptail = 0;
+
+// decoded text and latencies, shared with the UI
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static char text[MAXKEYTEXT];
+static int textlen = 0;
+static long lat[KEYLAT];
+static long nlat = 0, npress = 0;
+
+static void *generate(void *arg);
+static void *read_device(void *arg);
+static void decoded(int c);
+static int  lookup(const char *code);
+static void close_device();
+
+
+// open the live stream and start the generator
+// returns 0 or -1 if there is no audio
+int keyer_start(const struct cwparams *cp) {
+  int period;
+
+  params = *cp;
+  period = params.samplerate * KEYPERIOD / 1000;
+  if ((audio = open_live(params.samplerate, period)) == NULL)
+    return -1;
+  stop = 0;
+  paddles = 0;
+  taphead = taptail = 0;
+  textlen = 0;
+  nlat = npress = 0;
+  keyer_set(keyermode, params.speed);
+  cancel_audio(0);
+
+  if (keyerdevice[0] && ((devfd = open(keyerdevice, O_RDONLY)) >= 0)) {
+    int clk = CLOCK_MONOTONIC;
+    ioctl(devfd, EVIOCSCLOCKID, &clk);
+    if (pthread_create(&devthread, NULL, read_device, NULL)) {
+      close(devfd);
+      devfd = -1;
+    }
+  }
+  if (rt_thread(&genthread, generate, NULL)) {
+    stop = 1;                            // there is no generator thread
+    close_device();
+    close_live(audio);
+    audio = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+
+void keyer_stop() {
+  stop = 1;
+  pthread_join(genthread, NULL);
+  close_device();
+  close_live(audio);
+  audio = NULL;
+}
+
+
+// wait for the thread reading the keyer device, if it was started
+static void close_device() {
+  if (devfd >= 0) {
+    pthread_join(devthread, NULL);
+    close(devfd);
+    devfd = -1;
+  }
+}
+
+
+// change mode and speed (cpm) while the keyer runs
+void keyer_set(int m, int speed) {
+  keyermode = m;
+  mode = m;
+  dotlen = params.samplerate * 6 / (speed > 10 ? speed : 10);
+}
+
+
+// both paddles at time t (ns, CLOCK_MONOTONIC), for keys that report
+// press and release
+void keyer_paddles(int p, long long t) {
+  if (p & ~atomic_exchange(&paddles, p))
+    pressed = t;
+}
+
+
+// a key that was pressed at t, for keys without a release
+void keyer_tap(int paddle, long long t) {
+  int h = taphead;
+
+  if (h - taptail >= TAPQ)
+    return;
+  taps[h % TAPQ] = paddle;
+  taphead = h + 1;
+  pressed = t;
+}
+
+
+// characters decoded from the keying since the last call
+int keyer_text(char *out, int size) {
+  int n;
+
+  pthread_mutex_lock(&mutex);
+  n = (textlen < size - 1) ? textlen : size - 1;
+  memcpy(out, text, n);
+  out[n] = '\0';
+  memmove(text, text + n, textlen - n);
+  textlen -= n;
+  pthread_mutex_unlock(&mutex);
+  return n;
+}
+
+
+static int cmp_long(const void *a, const void *b) {
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+
+// mean, median, 95th percentile and maximum of the last KEYLAT presses
+void keyer_stats(struct keyerstats *st) {
+  long v[KEYLAT], sum = 0;
+  int i, n;
+
+  pthread_mutex_lock(&mutex);
+  n = (nlat < KEYLAT) ? nlat : KEYLAT;
+  memcpy(v, lat, n * sizeof(long));
+  st->presses = npress;
+  st->n = nlat;
+  pthread_mutex_unlock(&mutex);
+
+  st->period = params.samplerate * KEYPERIOD / 1000;
+  st->mean = st->p50 = st->p95 = st->max = 0;
+  if (!n)
+    return;
+  qsort(v, n, sizeof(long), cmp_long);
+  for (i = 0; i < n; i++)
+    sum += v[i];
+  st->mean = sum / n;
+  st->p50 = v[n / 2];
+  st->p95 = v[n * 95 / 100];
+  st->max = v[n - 1];
+}
+
+
+// generator thread: keyer state machine, sidetone and decoding, one
+// period at a time. The latency of a press is measured at the first
+// sample of its tone: the time it is written plus what the sound
+// server still has to play.
+static void *generate(void *arg) {
+  static short pcm[MAXRATE * KEYPERIOD / 1000];
+  long sr = params.samplerate;
+  int period = sr * KEYPERIOD / 1000;
+  int ed = sr * params.edge / 1000.0;
+  int state = IDLE, elem = 0, last = PADDLE_DAH, mem = 0, hand = 0;
+  int m, p, i, start, dot, t;
+  long left = 0, idle = 1L << 30, marklen = 0;
+  double cyc = 0, env = 0, val = 0;
+  char code[8] = "";
+  int ncode = 0, word = 1;
+  long long now, press, gen;
+
+  if (ed < 1)
+    ed = 1;
+  while (!stop) {
+    m = mode;
+    dot = dotlen;
+    p = paddles;
+    start = -1;
+    gen = get_ns();
+
+    for (i = 0; i < period; i++) {
+      // a straight key is down as long as it is held
+      if ((m == KEYER_STRAIGHT) && (p || hand)) {
+        if (p && (state != MARK)) {
+          state = MARK;
+          hand = 1;
+          marklen = 0;
+          start = (start < 0) ? i : start;
+        } else if (!p) {
+          code[ncode < 7 ? ncode++ : 7] = (marklen < 2 * dot) ? '.' : '-';
+          code[ncode] = '\0';
+          state = IDLE;
+          hand = 0;
+          idle = 0;
+        }
+      } else {
+        // timed elements: paddles and terminal presses
+        if ((state == MARK) && (m != KEYER_STRAIGHT))
+          mem |= p & ~elem;
+        if ((state != IDLE) && (--left <= 0)) {
+          if (state == MARK) {
+            code[ncode < 7 ? ncode++ : 7] = (elem == PADDLE_DIT) ? '.' : '-';
+            code[ncode] = '\0';
+            state = SPACE;
+            left = dot;
+          } else {
+            state = IDLE;
+          }
+          idle = 0;
+        }
+        if (state == IDLE) {
+          t = (m == KEYER_STRAIGHT) ? 0 : p;
+          if (m == KEYER_IAMBIC_B)
+            t |= mem;
+          mem = 0;
+          if (t == (PADDLE_DIT | PADDLE_DAH))
+            elem = (last == PADDLE_DIT) ? PADDLE_DAH : PADDLE_DIT;
+          else if (t)
+            elem = t;
+          else if (taptail != taphead)
+            elem = taps[taptail++ % TAPQ];
+          else
+            elem = 0;
+          if (elem) {
+            if (idle > dot)
+              start = (start < 0) ? i : start;
+            state = MARK;
+            marklen = 0;
+            left = (elem == PADDLE_DIT) ? dot : 3 * dot;
+            last = elem;
+          }
+        }
+      }
+
+      // characters end after 2 dots of silence, words after 5
+      if (state == MARK) {
+        marklen++;
+      } else {
+        idle++;
+        if (ncode && (idle > 2 * dot)) {
+          decoded(lookup(code));
+          ncode = 0;
+          code[0] = '\0';
+          word = 0;
+        } else if (!word && (idle > 5 * dot)) {
+          decoded(' ');
+          word = 1;
+        }
+      }
+
+      // sidetone with the rise/fall time of the calls
+      if (state == MARK)
+        env = (env + 1.0 / ed > 1.0) ? 1.0 : env + 1.0 / ed;
+      else
+        env = (env - 1.0 / ed < 0.0) ? 0.0 : env - 1.0 / ed;
+      if (env > 0) {
+        cyc += (double)params.freq / sr;
+        cyc -= floor(cyc);
+        switch (params.waveform) {
+        case SAWTOOTH:
+          val = cyc - 0.5;
+          break;
+        case SQUARE:
+          val = ceil(sin(2 * PI * cyc)) - 0.5;
+          break;
+        default:
+          val = sin(2 * PI * cyc);
+        }
+        val *= pow(sin(PI * env / 2.0), 2);
+      } else {
+        cyc = val = 0;
+      }
+      pcm[i] = (short)(val * 32500.0);
+    }
+
+    // a press while sending belongs to no tone that can be measured
+    if ((start < 0) && (state != IDLE))
+      pressed = 0;
+    now = get_ns();
+    if (now - gen > audiostats.maxrender)
+      audiostats.maxrender = now - gen;
+    if ((start >= 0) && ((press = atomic_exchange(&pressed, 0)) != 0)) {
+      now += audio_latency(audio) * 1000LL + start * 1000000000LL / sr;
+      pthread_mutex_lock(&mutex);
+      lat[nlat++ % KEYLAT] = (now - press) / 1000;
+      npress++;
+      pthread_mutex_unlock(&mutex);
+    }
+    if (stream_audio(audio, pcm, period) < 0)
+      break;
+  }
+  return NULL;
+}
+
+
+// input event thread: left Ctrl is the dit paddle, right Ctrl the dah
+// paddle, either one is the straight key
+static void *read_device(void *arg) {
+  struct pollfd pfd = { devfd, POLLIN, 0 };
+  struct input_event ev;
+  int p = 0;
+
+  while (!stop) {
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+    if (read(devfd, &ev, sizeof(ev)) != sizeof(ev))
+      break;
+    if ((ev.type != EV_KEY) || (ev.value == 2))     // no auto repeat
+      continue;
+    if (ev.code == KEY_LEFTCTRL)
+      p = ev.value ? (p | PADDLE_DIT) : (p & ~PADDLE_DIT);
+    else if (ev.code == KEY_RIGHTCTRL)
+      p = ev.value ? (p | PADDLE_DAH) : (p & ~PADDLE_DAH);
+    else
+      continue;
+    keyer_paddles(p, ev.time.tv_sec * 1000000000LL +
+                  ev.time.tv_usec * 1000LL);
+  }
+  return NULL;
+}
+
+
+static void decoded(int c) {
+  pthread_mutex_lock(&mutex);
+  if (textlen < MAXKEYTEXT)
+    text[textlen++] = c;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// the character sent as code, '*' if there is none
+static int lookup(const char *code) {
+  static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789/=.!,;#+-";
+  int i;
+
+  for (i = 0; chars[i]; i++)
+    if (!strcmp(morse_code(chars[i]), code))
+      return chars[i];
+  return strcmp(code, "..--..") ? '*' : '?';
+}
@@ -0,0 +1,55 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_KEYER
+#define QRQ_KEYER
+
+#include "morse.h"
+
+#define KEYER_STRAIGHT 0
+#define KEYER_IAMBIC_A 1
+#define KEYER_IAMBIC_B 2
+
+#define PADDLE_DIT   1
+#define PADDLE_DAH   2
+
+#define KEYPERIOD    2           // ms of audio per write
+#define KEYLAT       1024        // latencies kept for the percentiles
+#define MAXKEYTEXT   256         // decoded characters not fetched yet
+#define KEYDEVLEN    256
+
+// keypress to sound, in us
+struct keyerstats {
+  long presses;                  // key downs that started a tone
+  long n;                        // latencies measured
+  long mean, p50, p95, max;
+  int period;                    // samples per write
+};
+
+extern int keyermode;
+extern char keyerdevice[KEYDEVLEN];       // input event device, "" = terminal keys
+
+int  keyer_start(const struct cwparams *cp);
+void keyer_stop();
+void keyer_set(int mode, int speed);
+void keyer_paddles(int paddles, long long t);
+void keyer_tap(int paddle, long long t);
+int  keyer_text(char *out, int size);
+void keyer_stats(struct keyerstats *st);
+
+#endif
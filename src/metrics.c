@@ -0,0 +1,309 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Metrics in per thread slots, added up when they are read. A thread
+// takes a free slot the first time it counts and gives it back when it
+// ends, the next thread goes on with its totals. Only the owner writes
+// to a slot, so an update is a load and a store. When all slots are
+// taken the threads share one with atomic adds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+
+struct histogram {
+  atomic_ullong bin[METRICBINS + 1];   // < 2^k us, the last one above
+  atomic_ullong sum;                   // ns
+};
+
+struct slot {
+  atomic_ullong count[MC_N];
+  struct histogram hist[MH_N];
+} __attribute__((aligned(64)));
+
+static const char *countname[MC_N][2] = {
+  { "qrq_calls_total", "Calls played or sent." },
+  { "qrq_answers_total", "Answers scored." },
+  { "qrq_correct_answers_total", "Answers without a mistake." },
+};
+
+static const char *histname[MH_N][2] = {
+  { "qrq_render_seconds", "Rendering a call." },
+  { "qrq_sink_write_seconds", "One write to the sound server." },
+  { "qrq_sink_drain_seconds", "Waiting until the sound server played a call." },
+  { "qrq_reaction_seconds", "From the end of a call to the answer." },
+};
+
+static struct slot slots[METRICSLOTS + 1];      // the last one is shared
+static atomic_ullong used;                      // bit per slot
+static __thread struct slot *mine;
+static pthread_key_t key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static int listener = -1;
+static char *dumpfile = NULL;
+static void (*extra)(FILE *f) = NULL;
+static long perminute = 0;                      // answers in the last minute
+
+static struct slot *claim();
+static void release(void *p);
+static void make_key();
+static void add(struct slot *s, atomic_ullong *v, unsigned long long n);
+static void *serve(void *arg);
+static void reply(int fd);
+static void dump();
+static void per_minute();
+
+
+void metric_count(int c, long n) {
+  struct slot *s = mine ? mine : claim();
+  add(s, &s->count[c], n);
+}
+
+
+void metric_time(int h, long long ns) {
+  struct slot *s = mine ? mine : claim();
+  unsigned long long us = (ns > 0) ? ns / 1000 : 0;
+  int k = us ? 64 - __builtin_clzll(us) : 0;
+
+  add(s, &s->hist[h].bin[k < METRICBINS ? k : METRICBINS], 1);
+  add(s, &s->hist[h].sum, ns > 0 ? ns : 0);
+}
+
+
+// the slot of this thread
+static struct slot *claim() {
+  unsigned long long u = atomic_load(&used);
+  int k;
+
+  pthread_once(&once, make_key);
+  do {
+    if (!~u)
+      return mine = &slots[METRICSLOTS];
+    k = __builtin_ctzll(~u);
+  } while (!atomic_compare_exchange_weak(&used, &u, u | (1ULL << k)));
+  mine = &slots[k];
+  pthread_setspecific(key, mine);
+  return mine;
+}
+
+
+// the thread ends, its slot is free again
+static void release(void *p) {
+  atomic_fetch_and(&used, ~(1ULL << ((struct slot *)p - slots)));
+}
+
+
+static void make_key() {
+  pthread_key_create(&key, release);
+}
+
+
+static void add(struct slot *s, atomic_ullong *v, unsigned long long n) {
+  if (s == &slots[METRICSLOTS])
+    atomic_fetch_add_explicit(v, n, memory_order_relaxed);
+  else
+    atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+
+// the sum of all slots
+static unsigned long long total(atomic_ullong *first) {
+  unsigned long long n = 0;
+  long off = (char *)first - (char *)&slots[0];
+  int i;
+
+  for (i = 0; i <= METRICSLOTS; i++)
+    n += atomic_load_explicit((atomic_ullong *)((char *)&slots[i] + off),
+                              memory_order_relaxed);
+  return n;
+}
+
+
+// all metrics in the Prometheus text format
+void metrics_write(FILE *f) {
+  unsigned long long n;
+  long pages = 0;
+  int c, h, k;
+  FILE *fh;
+
+  for (c = 0; c < MC_N; c++) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", countname[c][0],
+            countname[c][1], countname[c][0], countname[c][0],
+            total(&slots[0].count[c]));
+  }
+  for (h = 0; h < MH_N; h++) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", histname[h][0],
+            histname[h][1], histname[h][0]);
+    for (n = 0, k = 0; k < METRICBINS; k++) {
+      n += total(&slots[0].hist[h].bin[k]);
+      fprintf(f, "%s_bucket{le=\"%g\"} %llu\n", histname[h][0],
+              (1ULL << k) / 1e6, n);
+    }
+    n += total(&slots[0].hist[h].bin[METRICBINS]);
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n", histname[h][0], n);
+    fprintf(f, "%s_sum %.6f\n%s_count %llu\n", histname[h][0],
+            total(&slots[0].hist[h].sum) / 1e9, histname[h][0], n);
+  }
+  fprintf(f, "# HELP qrq_answers_per_minute Answers in the last minute.\n"
+          "# TYPE qrq_answers_per_minute gauge\nqrq_answers_per_minute %ld\n",
+          perminute);
+
+  if ((fh = fopen("/proc/self/statm", "r")) != NULL) {
+    if (fscanf(fh, "%*d %ld", &pages) != 1)
+      pages = 0;
+    fclose(fh);
+  }
+  fprintf(f, "# HELP qrq_resident_bytes Memory in use.\n"
+          "# TYPE qrq_resident_bytes gauge\nqrq_resident_bytes %ld\n",
+          pages * sysconf(_SC_PAGESIZE));
+  if (extra)
+    extra(f);
+}
+
+
+// start serving and dumping in a thread of its own. returns 0 or -1
+int metrics_start(const char *endpoint, const char *dump, void (*fn)(FILE *f)) {
+  struct sockaddr_un un;
+  struct sockaddr_in in;
+  pthread_t t;
+  int on = 1;
+
+  extra = fn;
+  if (dump && dump[0])
+    dumpfile = strdup(dump);
+  if (endpoint && endpoint[0] && (endpoint[strspn(endpoint, "0123456789")])) {
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, endpoint, sizeof(un.sun_path) - 1);
+    unlink(endpoint);
+    if (((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) ||
+        bind(listener, (struct sockaddr *)&un, sizeof(un)))
+      return -1;
+  } else if (endpoint && endpoint[0]) {
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons(atoi(endpoint));
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+      return -1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listener, (struct sockaddr *)&in, sizeof(in)))
+      return -1;
+  }
+  if ((listener >= 0) && listen(listener, 8))
+    return -1;
+  if ((listener < 0) && !dumpfile)
+    return 0;
+  if (pthread_create(&t, NULL, serve, NULL))
+    return -1;
+  pthread_detach(t);
+  return 0;
+}
+
+
+// metrics thread: answer scrapes, once a second count the answers of
+// the last minute, every METRICSDUMP seconds write the dump
+static void *serve(void *arg) {
+  struct pollfd p = { listener, POLLIN, 0 };
+  time_t now, last = 0;
+  int fd;
+
+  while (1) {
+    if (poll(&p, (listener >= 0), 1000) > 0) {
+      if ((fd = accept(listener, NULL, NULL)) >= 0)
+        reply(fd);
+    }
+    now = time(NULL);
+    if (now != last) {
+      per_minute();
+      if (dumpfile && (now / METRICSDUMP != last / METRICSDUMP))
+        dump();
+      last = now;
+    }
+  }
+  return NULL;
+}
+
+
+// an HTTP answer, whatever was asked. Waits 200 ms for the request
+static void reply(int fd) {
+  struct pollfd p = { fd, POLLIN, 0 };
+  char req[1024], *body = NULL, head[128];
+  size_t len = 0;
+  FILE *f;
+
+  if (poll(&p, 1, 200) > 0)
+    if (read(fd, req, sizeof(req)) < 0)
+      req[0] = '\0';
+  if ((f = open_memstream(&body, &len)) != NULL) {
+    metrics_write(f);
+    fclose(f);
+    snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; "
+             "version=0.0.4\r\nContent-Length: %zu\r\n\r\n", len);
+    // no SIGPIPE when the client has gone, that would end qrq
+    if (send(fd, head, strlen(head), MSG_NOSIGNAL) == strlen(head))
+      send(fd, body, len, MSG_NOSIGNAL);
+    free(body);
+  }
+  close(fd);
+}
+
+
+// write the dump file in one go, a reader never sees half of it
+static void dump() {
+  char tmp[4096];
+  FILE *f;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", dumpfile);
+  if ((f = fopen(tmp, "w")) == NULL)
+    return;
+  metrics_write(f);
+  if (fclose(f) == 0)
+    rename(tmp, dumpfile);
+}
+
+
+// answers now minus answers a minute ago, sampled once a second
+static void per_minute() {
+  static unsigned long long ring[60];
+  static time_t last = 0;
+  unsigned long long n = total(&slots[0].count[MC_ANSWERS]);
+  time_t now = time(NULL), t;
+
+  if (last)
+    for (t = (now - last > 60) ? now - 60 : last + 1; t < now; t++)
+      ring[t % 60] = ring[last % 60];
+  perminute = n - ring[now % 60];
+  ring[now % 60] = n;
+  last = now;
+}
@@ -0,0 +1,56 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_METRICS
+#define QRQ_METRICS
+
+// Counters and histograms in the Prometheus text format, served on a
+// UNIX socket or 127.0.0.1:port (HTTP) and written to a file every
+// METRICSDUMP seconds. Every thread counts in a slot of its own, the
+// slots are added up when they are read: counting is a few stores,
+// without locks or shared cache lines.
+
+#include <stdio.h>
+
+#define METRICSLOTS  64          // threads counting at the same time
+#define METRICBINS   26          // histogram buckets, 1 us .. 33 s
+#define METRICSDUMP  10          // seconds between dumps
+
+// counters
+#define MC_CALLS     0           // calls played or sent
+#define MC_ANSWERS   1
+#define MC_CORRECT   2
+#define MC_N         3
+
+// histograms of times
+#define MH_RENDER    0           // rendering a call
+#define MH_WRITE     1           // one write to the sound server
+#define MH_DRAIN     2           // until the sound server has played a call
+#define MH_REACTION  3           // from the end of a call to the answer
+#define MH_N         4
+
+void metric_count(int c, long n);
+void metric_time(int h, long long ns);
+
+// endpoint is a path for a UNIX socket or a TCP port, dump a file, either
+// may be NULL. extra() adds lines of the program. returns 0 or -1
+int  metrics_start(const char *endpoint, const char *dump,
+                   void (*extra)(FILE *f));
+void metrics_write(FILE *f);
+
+#endif
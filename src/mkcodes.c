@@ -0,0 +1,237 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// mkcodes: compile alphabets.txt into codetab.c, see codetab.h
+//
+//   ./mkcodes alphabets.txt > codetab.c
+//
+// The hash is built by hash and displace: the characters are put into
+// buckets of about four, the largest bucket first gets the smallest
+// displacement that puts all its characters into free slots.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utf8.h"
+#include "codetab.h"
+
+#define MAXCODES 1024
+#define MAXALPHA 32
+#define MAXDISP  65535
+
+struct entry {
+  int c, alphabet;
+  char code[16];
+};
+
+static struct entry entries[MAXCODES];
+static int nentries = 0;
+static char names[MAXALPHA][32];
+static int keys[MAXALPHA][26];
+static int nalpha = 0;
+
+static void add(int c, int alphabet, const char *code, int line);
+static int  is_code(const char *s);
+static const char *code_of(int c);
+static void make_keys();
+static int  make_hash(int nb, int *slot, unsigned short *disp);
+
+
+int main(int argc, char **argv) {
+  char buf[256], ch[8], code[64], extra[8];
+  unsigned short disp[MAXCODES];
+  int slot[MAXCODES];
+  int i, k, c, nb, line = 0;
+  FILE *f;
+
+  if ((argc != 2) || !(f = fopen(argv[1], "r"))) {
+    fprintf(stderr, "usage: mkcodes alphabets.txt > codetab.c\n");
+    return 1;
+  }
+  while (fgets(buf, sizeof(buf), f)) {
+    line++;
+    if ((sscanf(buf, "[%31[^]]]", names[nalpha]) == 1) && (nalpha < MAXALPHA)) {
+      nalpha++;
+      continue;
+    }
+    if ((sscanf(buf, "%7s %63s %7s", ch, code, extra) != 2) ||
+        !is_code(code) || (utf8_decode(ch, &c) != strlen(ch)))
+      continue;                           // a comment
+    if (!nalpha) {
+      fprintf(stderr, "line %d: no [alphabet] before it\n", line);
+      return 1;
+    }
+    add(c, nalpha - 1, code, line);
+    if (utf8_lower(c) != c)
+      add(utf8_lower(c), nalpha - 1, code, line);
+  }
+  fclose(f);
+  if (!nalpha) {
+    fprintf(stderr, "%s: no alphabets\n", argv[1]);
+    return 1;
+  }
+  add(' ', 0, " ", line);
+  make_keys();
+
+  for (nb = (nentries + 3) / 4; !make_hash(nb, slot, disp); nb++)
+    if (nb >= nentries) {
+      fprintf(stderr, "no perfect hash found\n");
+      return 1;
+    }
+
+  printf("// generated from alphabets.txt by mkcodes, do not edit\n\n");
+  printf("#include \"codetab.h\"\n\n");
+  printf("const int qrq_ncodes = %d;\n", nentries);
+  printf("const int qrq_nbuckets = %d;\n", nb);
+  printf("const int qrq_nalphabets = %d;\n\n", nalpha);
+  printf("const unsigned short qrq_codedisp[] = {");
+  for (i = 0; i < nb; i++)
+    printf("%s%5u,", (i % 10) ? "" : "\n ", disp[i]);
+  printf("\n};\n\nconst struct qrq_codeent qrq_codes[] = {\n");
+  for (i = 0; i < nentries; i++) {
+    for (k = 0; slot[k] != i; k++)
+      ;
+    c = entries[k].c;
+    ch[utf8_encode(c, ch)] = '\0';
+    printf("  { 0x%04x, %d, \"%s\" },%*s// %s\n", c, entries[k].alphabet,
+           entries[k].code, 9 - (int)strlen(entries[k].code), "",
+           (c == ' ') ? "space" : ch);
+  }
+  printf("};\n");
+  for (i = 0; i < nalpha; i++) {
+    printf("\nstatic const int keys_%s[] = {", names[i]);
+    for (k = 0; k < 26; k++)
+      printf("%s0x%04x,", (k % 8) ? " " : "\n  ", keys[i][k]);
+    printf("\n};\n");
+  }
+  printf("\nconst struct qrq_alphabet qrq_alphabets[] = {\n");
+  for (i = 0; i < nalpha; i++)
+    printf("  { \"%s\", keys_%s },\n", names[i], names[i]);
+  printf("};\n");
+  return 0;
+}
+
+
+// a character once, with the same code wherever it is listed
+static void add(int c, int alphabet, const char *code, int line) {
+  const char *old = code_of(c);
+
+  if (old) {
+    if (strcmp(old, code)) {
+      fprintf(stderr, "line %d: U+%04X is %s already\n", line, c, old);
+      exit(1);
+    }
+    return;
+  }
+  if (nentries == MAXCODES) {
+    fprintf(stderr, "line %d: more than %d characters\n", line, MAXCODES);
+    exit(1);
+  }
+  entries[nentries].c = c;
+  entries[nentries].alphabet = alphabet;
+  strcpy(entries[nentries++].code, code);
+}
+
+
+static int is_code(const char *s) {
+  int n = strspn(s, ".-");
+  return (n > 0) && (n < 16) && !s[n];
+}
+
+
+static const char *code_of(int c) {
+  int i;
+
+  for (i = 0; i < nentries; i++)
+    if (entries[i].c == c)
+      return entries[i].code;
+  return NULL;
+}
+
+
+// A to Z of an alphabet: its own character with the code of the letter,
+// the letter itself if there is none
+static void make_keys() {
+  const char *code;
+  int a, k, i;
+
+  for (a = 0; a < nalpha; a++)
+    for (k = 0; k < 26; k++) {
+      keys[a][k] = 'A' + k;
+      code = code_of('A' + k);
+      for (i = 0; code && (i < nentries); i++)
+        if ((entries[i].alphabet == a) && (a > 0) &&
+            (utf8_upper(entries[i].c) == entries[i].c) &&
+            !strcmp(entries[i].code, code)) {
+          keys[a][k] = entries[i].c;
+          break;
+        }
+    }
+}
+
+
+// hash and displace with nb buckets, returns 0 if a bucket found no
+// displacement
+static int make_hash(int nb, int *slot, unsigned short *disp) {
+  int bucket[MAXCODES], order[MAXCODES], size[MAXCODES], used[MAXCODES];
+  int i, k, j, b, d, n, ok;
+
+  memset(size, 0, sizeof(size));
+  memset(used, 0, sizeof(used));
+  for (i = 0; i < nentries; i++)
+    size[bucket[i] = qrq_codehash(entries[i].c, 0) % nb]++;
+
+  // largest bucket first
+  for (b = 0; b < nb; b++)
+    order[b] = b;
+  for (i = 1; i < nb; i++)
+    for (k = i; (k > 0) && (size[order[k]] > size[order[k - 1]]); k--) {
+      j = order[k];
+      order[k] = order[k - 1];
+      order[k - 1] = j;
+    }
+
+  for (i = 0; i < nb; i++) {
+    b = order[i];
+    disp[b] = 0;
+    if (!size[b])
+      continue;
+    for (d = 1; d <= MAXDISP; d++) {
+      // the slots of the bucket must be free and differ
+      for (ok = 1, n = k = 0; ok && (k < nentries); k++) {
+        if (bucket[k] != b)
+          continue;
+        slot[k] = qrq_codehash(entries[k].c, d) % nentries;
+        ok = !used[slot[k]];
+        for (j = 0; ok && (j < k); j++)
+          ok = (bucket[j] != b) || (slot[j] != slot[k]);
+        n++;
+      }
+      if (ok)
+        break;
+    }
+    if (d > MAXDISP)
+      return 0;
+    disp[b] = d;
+    for (k = 0; k < nentries; k++)
+      if (bucket[k] == b)
+        used[slot[k]] = 1;
+  }
+  return 1;
+}
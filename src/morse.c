@@ -0,0 +1,135 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrq's global settings and buffers on top of libqrqsynth
+
+#include <string.h>
+
+#include "morse.h"
+
+#define CHUNK    1024            // samples pulled from the synthesizer at once
+
+long samplerate = 44100;
+int nativerate = 1;                     // render at the rate of the sound card
+int speed = 200;                        // current speed in cpm
+int mincharspeed = 0;                   // min. char. speed, below: farnsworth
+int freq = MYFREQ;                      // current cw sidetone freq
+int waveform = SINE;                    // waveform: (0 = none)
+double edge = 2.0;                      // rise/fall time in milliseconds
+int chirp = 0;                          // Hz off frequency at key down
+int drift = 0;                          // Hz of slow frequency wander
+int clicks = 0;                         // % of hard keying, key clicks
+int full_buf[FULLBUF];                  // 20 second max buffer
+int full_bufpos = 0;
+
+static double ed = 2.0;                 // rise/fall time of tonegen()
+
+static void pull_all(struct qrq_synth *s, struct cwbuf *out, const char *text);
+
+
+// map a character to its dots and dashes
+const char *morse_code(int c) {
+  return qrq_morse_code(c);
+}
+
+
+// the current global settings
+void cw_params(struct cwparams *cp) {
+  cp->samplerate = samplerate;
+  cp->speed = speed;
+  cp->mincharspeed = mincharspeed;
+  cp->freq = freq;
+  cp->waveform = waveform;
+  cp->edge = edge;
+  cp->chirp = chirp;
+  cp->drift = drift;
+  cp->clicks = clicks;
+}
+
+
+// render text into full_buf, returns the number of samples
+int render_morse(const char *text) {
+  struct cwparams cp;
+  struct cwbuf out = { full_buf, 0, FULLBUF };
+
+  cw_params(&cp);
+  ed = edge;
+  render_text(&cp, text, &out);
+  full_bufpos = out.len * sizeof(int);
+  return out.len;
+}
+
+
+// render text with explicit settings, appends to out
+// returns the number of samples in out
+int render_text(const struct cwparams *cp, const char *text, struct cwbuf *out) {
+  int n = LEADIN(cp->samplerate);
+
+  // some silence
+  if (n > out->size - out->len)
+    n = out->size - out->len;
+  if (n > 0) {
+    memset(out->buf + out->len, 0, n * sizeof(int));
+    out->len += n;
+  }
+  return render_chars(cp, text, out);
+}
+
+
+// like render_text(), without the silence in front
+int render_chars(const struct cwparams *cp, const char *text, struct cwbuf *out) {
+  struct qrq_synth s;
+
+  qrq_synth_init(&s, cp);
+  pull_all(&s, out, text);
+  return out->len;
+}
+
+
+// generate a tone of frequency and length into full_buf, with the
+// rise/fall time of the last render_morse()
+int tonegen(int freq, int len, int waveform) {
+  struct cwparams cp;
+  struct cwbuf out = { full_buf, full_bufpos / sizeof(int), FULLBUF };
+  struct qrq_synth s;
+
+  cw_params(&cp);
+  cp.edge = ed;
+  qrq_synth_init(&s, &cp);
+  qrq_synth_tone(&s, freq, len, waveform);
+  pull_all(&s, &out, "");
+  full_bufpos = out.len * sizeof(int);
+  return 0;
+}
+
+
+// everything s has to send and all of text, appended to out
+// anything beyond the size of out is dropped
+static void pull_all(struct qrq_synth *s, struct cwbuf *out, const char *text) {
+  int n, k;
+
+  s->pos = out->len;                    // the drift goes on
+  while (out->len < out->size) {
+    text += qrq_synth_queue(s, text);
+    n = (out->size - out->len < CHUNK) ? out->size - out->len : CHUNK;
+    k = qrq_synth_render_int(s, out->buf + out->len, n);
+    out->len += k;
+    if ((k < n) && !*text)
+      break;
+  }
+}
@@ -0,0 +1,61 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_MORSE
+#define QRQ_MORSE
+
+#include "qrqsynth.h"
+
+#define PI       M_PI
+
+#define MYFREQ   700     // default tone frequency
+#define MAXFREQ  800     // max tone frequency
+#define MINFREQ  400     // min tone frequency
+
+#define MAXRATE  192000          // highest supported sample rate
+#define FULLBUF  (20 * MAXRATE)  // 20 second max buffer
+#define LEADIN(rate) ((rate) / 4 - 1)  // silence before a call, samples
+
+// rendered samples
+struct cwbuf {
+  int *buf;
+  int len;                       // samples in buf
+  int size;                      // max. samples
+};
+
+extern long samplerate;
+extern int nativerate;
+extern int speed;                // current speed in cpm
+extern int mincharspeed;         // min. char. speed, below: farnsworth
+extern int freq;                 // current cw sidetone freq
+extern int waveform;             // waveform: (0 = none)
+extern double edge;              // rise/fall time in milliseconds
+extern int chirp;                // Hz off frequency at key down
+extern int drift;                // Hz of slow frequency wander
+extern int clicks;               // % of hard keying, key clicks
+extern int full_buf[FULLBUF];
+extern int full_bufpos;          // in bytes
+
+const char *morse_code(int c);
+void cw_params(struct cwparams *cp);
+int  tonegen(int freq, int length, int waveform);
+int  render_morse(const char *text);
+int  render_text(const struct cwparams *cp, const char *text, struct cwbuf *out);
+int  render_chars(const struct cwparams *cp, const char *text, struct cwbuf *out);
+
+#endif
@@ -0,0 +1,236 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Cache of rendered calls, so repeats and recurring texts are played
+// without rendering them again.
+//
+// Entries are keyed by the text and every setting of the rendering and
+// hold the samples as 16 bit PCM. The least recently used entries are
+// dropped when the memory budget is exceeded. Entries in use by a
+// caller (see ref) are freed only after pcmcache_release().
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pcmcache.h"
+
+#define NBUCKET 1024
+#define MAXTEXT 80
+
+struct pcmentry {
+  struct cwparams cp;
+  char text[MAXTEXT];
+  unsigned int hash;
+  int refs;                      // callers using pcm, +1 while cached
+  int len;                       // samples
+  short *pcm;
+  struct pcmentry *next;         // in the bucket
+  struct pcmentry *newer, *older;
+};
+
+static struct pcmentry *buckets[NBUCKET];
+static struct pcmentry *newest = NULL, *oldest = NULL;
+static long budget = 0, used = 0;
+static struct pcmstats stats;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void unlink_lru(struct pcmentry *e);
+static void drop(struct pcmentry *e);
+
+
+// set the memory budget in bytes, 0 turns the cache off
+void pcmcache_init(long bytes) {
+  pthread_mutex_lock(&mutex);
+  budget = bytes;
+  while (oldest && (used > budget))
+    drop(oldest);
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// FNV-1a over the settings and the text
+static unsigned int hash(const struct cwparams *cp, const char *text) {
+  unsigned int h = 2166136261u;
+  long key[8] = { cp->samplerate, cp->speed, cp->mincharspeed, cp->freq,
+                  cp->waveform, cp->chirp, cp->drift, cp->clicks };
+  const unsigned char *p = (const unsigned char *)key;
+  int i;
+
+  for (i = 0; i < sizeof(key); i++)
+    h = (h ^ p[i]) * 16777619u;
+  p = (const unsigned char *)&cp->edge;
+  for (i = 0; i < sizeof(cp->edge); i++)
+    h = (h ^ p[i]) * 16777619u;
+  for (p = (const unsigned char *)text; *p; p++)
+    h = (h ^ *p) * 16777619u;
+  return h;
+}
+
+
+static int same(const struct cwparams *a, const struct cwparams *b) {
+  return (a->samplerate == b->samplerate) && (a->speed == b->speed) &&
+         (a->mincharspeed == b->mincharspeed) && (a->freq == b->freq) &&
+         (a->waveform == b->waveform) && (a->edge == b->edge) &&
+         (a->chirp == b->chirp) && (a->drift == b->drift) &&
+         (a->clicks == b->clicks);
+}
+
+
+// the samples of text rendered with cp, NULL if not cached.
+// *ref has to be given to pcmcache_release() when done with them
+const short *pcmcache_get(const struct cwparams *cp, const char *text,
+                          int *len, void **ref) {
+  unsigned int h = hash(cp, text);
+  struct pcmentry *e;
+
+  pthread_mutex_lock(&mutex);
+  for (e = buckets[h % NBUCKET]; e; e = e->next)
+    if ((e->hash == h) && same(&e->cp, cp) && !strcmp(e->text, text))
+      break;
+  if (!e) {
+    stats.misses++;
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+  }
+  stats.hits++;
+  unlink_lru(e);                        // now the newest
+  e->older = newest;
+  e->newer = NULL;
+  if (newest)
+    newest->newer = e;
+  newest = e;
+  if (!oldest)
+    oldest = e;
+  e->refs++;
+  pthread_mutex_unlock(&mutex);
+
+  *len = e->len;
+  *ref = e;
+  return e->pcm;
+}
+
+
+// add len samples of text rendered with cp. With ref, the entry is
+// kept for the caller like after pcmcache_get() and its samples are
+// returned. NULL (and *ref NULL) if it was not cached
+const short *pcmcache_put(const struct cwparams *cp, const char *text,
+                          const int *buf, int len, void **ref) {
+  long size = len * sizeof(short) + sizeof(struct pcmentry);
+  struct pcmentry *e, *o;
+  int i;
+
+  if (ref)
+    *ref = NULL;
+  if ((size > budget) || (strlen(text) >= MAXTEXT))
+    return NULL;
+  if ((e = malloc(sizeof(struct pcmentry))) == NULL)
+    return NULL;
+  if ((e->pcm = malloc(len * sizeof(short))) == NULL) {
+    free(e);
+    return NULL;
+  }
+  for (i = 0; i < len; i++)
+    e->pcm[i] = (short)buf[i];
+  e->cp = *cp;
+  strcpy(e->text, text);
+  e->hash = hash(cp, text);
+  e->len = len;
+  e->refs = ref ? 2 : 1;
+
+  pthread_mutex_lock(&mutex);
+  // rendered twice at the same time, keep the first one
+  for (o = buckets[e->hash % NBUCKET]; o; o = o->next)
+    if ((o->hash == e->hash) && same(&o->cp, cp) && !strcmp(o->text, text))
+      break;
+  if (o) {
+    pthread_mutex_unlock(&mutex);
+    free(e->pcm);
+    free(e);
+    return NULL;
+  }
+  e->next = buckets[e->hash % NBUCKET];
+  buckets[e->hash % NBUCKET] = e;
+  e->older = newest;
+  e->newer = NULL;
+  if (newest)
+    newest->newer = e;
+  newest = e;
+  if (!oldest)
+    oldest = e;
+  used += size;
+  stats.entries++;
+  while (used > budget)
+    drop(oldest);
+  pthread_mutex_unlock(&mutex);
+  if (!ref)
+    return NULL;
+  *ref = e;
+  return e->pcm;
+}
+
+
+void pcmcache_release(void *ref) {
+  struct pcmentry *e = ref;
+
+  if (!e)
+    return;
+  pthread_mutex_lock(&mutex);
+  if (--e->refs == 0) {
+    free(e->pcm);
+    free(e);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+void pcmcache_stats(struct pcmstats *st) {
+  pthread_mutex_lock(&mutex);
+  *st = stats;
+  st->bytes = used;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+static void unlink_lru(struct pcmentry *e) {
+  if (e->newer)
+    e->newer->older = e->older;
+  else
+    newest = e->older;
+  if (e->older)
+    e->older->newer = e->newer;
+  else
+    oldest = e->newer;
+}
+
+
+// remove an entry from the cache, it is freed when nobody uses it
+static void drop(struct pcmentry *e) {
+  struct pcmentry **p;
+
+  for (p = &buckets[e->hash % NBUCKET]; *p != e; p = &(*p)->next)
+    ;
+  *p = e->next;
+  unlink_lru(e);
+  used -= e->len * sizeof(short) + sizeof(struct pcmentry);
+  stats.entries--;
+  if (--e->refs == 0) {
+    free(e->pcm);
+    free(e);
+  }
+}
@@ -0,0 +1,39 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_PCMCACHE
+#define QRQ_PCMCACHE
+
+#include "morse.h"
+
+#define PCMCACHE_MB 16           // default memory budget
+
+struct pcmstats {
+  long hits, misses;
+  long entries, bytes;
+};
+
+void pcmcache_init(long budget);
+const short *pcmcache_get(const struct cwparams *cp, const char *text,
+                          int *len, void **ref);
+const short *pcmcache_put(const struct cwparams *cp, const char *text,
+                          const int *buf, int len, void **ref);
+void pcmcache_release(void *ref);
+void pcmcache_stats(struct pcmstats *st);
+
+#endif
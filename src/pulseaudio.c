@@ -16,21 +16,54 @@
 
 #include <ncurses.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <pulse/simple.h>
 #include <pulse/error.h>
+#include <pulse/mainloop.h>
+#include <pulse/context.h>
+#include <pulse/introspect.h>
 
-extern long samplerate;
-extern void *dsp_fd;
+#include "pulseaudio.h"
+#include "morse.h"
+#include "metrics.h"
+#include "waterfall.h"
 
-short int buf[441000];      // 10 second buffer
+short int buf[FULLBUF];     // 20 second buffer
 int bufpos = 0;
 
+struct audiostats audiostats;
+
+static atomic_int cancelled = 0;
+static long long lastwrite = 0;   // ns, last write of a playing stream
+static long long dry = 0;         // ns, when its queued audio runs out
+
+// the answer to sink_spec()
+struct sinkquery {
+  int done;                       // 1 found, -1 failed
+  pa_sample_spec spec;
+};
+
+static long long now_ns();
+static void check_write(void *s, int n);
+static void wrote(void *s, long long t, int n);
+static void tap(void *s, const short int *pcm, int n);
+static int sink_spec(pa_sample_spec *spec);
+static void server_info(pa_context *c, const pa_server_info *i, void *q);
+static void sink_info(pa_context *c, const pa_sink_info *i, int eol, void *q);
+
+// with nativerate the calls are rendered at the rate of the default
+// sink, the sound server then plays them as they are instead of
+// resampling every buffer. samplerate changes before anything is
+// rendered, open_dsp() is called at startup
 void *open_dsp() {
   static int opened = 0;
+  static pa_simple *s = NULL;
 
   // open the device and leave it open
-  if (opened) return dsp_fd;
+  if (opened) return s;
 
   // sample format
   static pa_sample_spec ss = {
@@ -38,10 +71,18 @@ void *open_dsp() {
     .rate      = 8000,
     .channels  = 1
   };
-  ss.rate = samplerate;
-  pa_simple *s = NULL;
+  pa_sample_spec native;
   int error;
 
+  if (sink_spec(&native) == 0) {
+    audiostats.nativerate = native.rate;
+    audiostats.nativeformat = pa_sample_format_to_string(native.format);
+    if (nativerate && (native.rate >= 8000) && (native.rate <= MAXRATE))
+      samplerate = native.rate;
+  }
+  ss.rate = samplerate;
+  audiostats.rate = samplerate;
+
   if (!(s = pa_simple_new(NULL, "qrq", PA_STREAM_PLAYBACK, NULL,
                           "playback", &ss, NULL, NULL, &error)))
     fprintf(stderr, "pa_simple_new() failed: %s\n",
@@ -54,16 +95,244 @@ void *open_dsp() {
 // write sample into the buffer
 void write_audio(void *bla, int *in, int size) {
   int i = 0;
-  for (i = 0; i < size / sizeof(int); i++) {
+  for (i = 0; (i < size / sizeof(int)) && (bufpos < FULLBUF); i++) {
     buf[bufpos] = (short int)in[i];
     bufpos++;
   }
 }
 
-// close audio
-void close_audio(void *s) {
-  int e;
-  pa_simple_write(s, buf, bufpos * sizeof(short int), &e);
-  pa_simple_drain(s, &e);
+// add n samples that are already 16 bit to the buffer
+void write_pcm(void *bla, const short int *pcm, int n) {
+  if (n > FULLBUF - bufpos)
+    n = FULLBUF - bufpos;
+  memcpy(&buf[bufpos], pcm, n * sizeof(short int));
+  bufpos += n;
+}
+
+// play the buffer in 20 ms chunks and wait until it is played
+// returns 0, 1 if cancelled or -1 if the sound server failed
+int close_audio(void *s) {
+  int e, i, n, ret = 0;
+  int chunk = samplerate / 50;
+  long long t;
+
+  for (i = 0; s && (i < bufpos); i += n) {
+    if (atomic_load(&cancelled))
+      break;
+    n = (bufpos - i < chunk) ? bufpos - i : chunk;
+    check_write(s, n);
+    t = now_ns();
+    if (pa_simple_write(s, &buf[i], n * sizeof(short int), &e) < 0)
+      break;
+    wrote(s, t, n);
+    tap(s, &buf[i], n);
+  }
+  t = now_ns();
+  if (!s || (i < bufpos && !atomic_load(&cancelled)))
+    ret = -1;
+  else if (atomic_load(&cancelled)) {
+    pa_simple_flush(s, &e);
+    ret = 1;
+  } else if (pa_simple_drain(s, &e) < 0)
+    ret = -1;
+  else
+    metric_time(MH_DRAIN, now_ns() - t);
   bufpos = 0;
+  lastwrite = 0;
+  return ret;
+}
+
+// play n samples of a continuous stream, blocks while the sound
+// server's buffer is full. close_audio() drains the stream at the end.
+// returns 0, 1 if cancelled or -1 if the sound server failed
+int stream_audio(void *s, short int *pcm, int n) {
+  long long t;
+  int e;
+
+  if (!s)
+    return -1;
+  if (atomic_load(&cancelled))
+    return 1;
+  check_write(s, n);
+  t = now_ns();
+  if (pa_simple_write(s, pcm, n * sizeof(short int), &e) < 0)
+    return -1;
+  wrote(s, t, n);
+  tap(s, pcm, n);
+  return 0;
+}
+
+// time until a sample written now is heard, in us
+long audio_latency(void *s) {
+  int e;
+  pa_usec_t us = s ? pa_simple_get_latency(s, &e) : 0;
+  return (us == (pa_usec_t)-1) ? 0 : (long)us;
+}
+
+// stop (1) or allow (0) playback, may be called from any thread
+void cancel_audio(int on) {
+  atomic_store(&cancelled, on);
+}
+
+// the playback buffer and its size in samples, for locking it
+short int *audio_buffer(long *n) {
+  *n = FULLBUF;
+  return buf;
+}
+
+// the sample spec of the default sink, asked from the sound server
+// returns 0 or -1 if there is none
+static int sink_spec(pa_sample_spec *spec) {
+  struct sinkquery q = { 0 };
+  pa_mainloop *m;
+  pa_context *c = NULL;
+  pa_context_state_t st;
+  pa_operation *o;
+  int asked = 0;
+
+  if ((m = pa_mainloop_new()) == NULL)
+    return -1;
+  if ((c = pa_context_new(pa_mainloop_get_api(m), "qrq")) &&
+      (pa_context_connect(c, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL) >= 0)) {
+    while (!q.done && (pa_mainloop_iterate(m, 1, NULL) >= 0)) {
+      st = pa_context_get_state(c);
+      if (!PA_CONTEXT_IS_GOOD(st))
+        break;
+      if ((st == PA_CONTEXT_READY) && !asked) {
+        asked = 1;
+        if ((o = pa_context_get_server_info(c, server_info, &q)) == NULL)
+          break;
+        pa_operation_unref(o);
+      }
+    }
+    pa_context_disconnect(c);
+  }
+  if (c)
+    pa_context_unref(c);
+  pa_mainloop_free(m);
+  *spec = q.spec;
+  return (q.done == 1) ? 0 : -1;
+}
+
+// the name of the default sink, then its sample spec
+static void server_info(pa_context *c, const pa_server_info *i, void *q) {
+  pa_operation *o = NULL;
+
+  if (i && i->default_sink_name)
+    o = pa_context_get_sink_info_by_name(c, i->default_sink_name,
+                                         sink_info, q);
+  if (o)
+    pa_operation_unref(o);
+  else
+    ((struct sinkquery *)q)->done = -1;
+}
+
+static void sink_info(pa_context *c, const pa_sink_info *i, int eol, void *q) {
+  struct sinkquery *sq = q;
+
+  if (i) {
+    sq->spec = i->sample_spec;
+    sq->done = 1;
+  } else if (eol && !sq->done) {
+    sq->done = -1;
+  }
+}
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// before a chunk of n samples is written to a playing stream: if the
+// audio queued at the last write has run out it is an underrun, else a
+// chunk more than a chunk period after the last write is late
+static void check_write(void *s, int n) {
+  long long now;
+
+  if (!lastwrite)
+    return;
+  now = now_ns();
+  if (now > dry)
+    audiostats.underruns++;
+  else if (now - lastwrite > 1000000000LL * n / samplerate)
+    audiostats.late++;
+}
+
+// after a write that started at t. The stream plays once a write
+// blocks, from then on the queue is measured after every write
+static void wrote(void *s, long long t, int n) {
+  long long now = now_ns();
+
+  metric_time(MH_WRITE, now - t);
+  if (!lastwrite && (now - t < 500000000LL * n / samplerate))
+    return;
+  lastwrite = now;
+  dry = now + audio_latency(s) * 1000LL;
+}
+
+// the waterfall sees every chunk, with the time its end is heard
+static void tap(void *s, const short int *pcm, int n) {
+  if (wf_output())
+    wf_feed(pcm, n, now_ns() + audio_latency(s) * 1000LL);
+}
+
+// open a playback stream for live audio written in periods of period
+// samples. The sound server starts with one period and keeps about
+// two, so what is written is heard soon. NULL on error
+void *open_live(long rate, int period) {
+  pa_sample_spec ss = {
+    .format    = PA_SAMPLE_S16LE,
+    .rate      = rate,
+    .channels  = 1
+  };
+  pa_buffer_attr ba = {
+    .maxlength = (uint32_t)-1,
+    .tlength   = 2 * period * sizeof(short int),
+    .prebuf    = period * sizeof(short int),
+    .minreq    = period * sizeof(short int),
+    .fragsize  = (uint32_t)-1
+  };
+  pa_simple *s;
+  int error;
+
+  if (!(s = pa_simple_new(NULL, "qrq", PA_STREAM_PLAYBACK, NULL,
+                          "keyer", &ss, NULL, &ba, &error)))
+    fprintf(stderr, "pa_simple_new() failed: %s\n",
+            pa_strerror(error));
+  return s;
+}
+
+void close_live(void *s) {
+  if (s)
+    pa_simple_free(s);
+  lastwrite = 0;
+}
+
+// open a capture stream, mono 16 bit at rate, NULL on error
+void *open_capture(long rate) {
+  pa_sample_spec ss = {
+    .format    = PA_SAMPLE_S16LE,
+    .rate      = rate,
+    .channels  = 1
+  };
+  pa_simple *s;
+  int error;
+
+  if (!(s = pa_simple_new(NULL, "qrq", PA_STREAM_RECORD, NULL,
+                          "capture", &ss, NULL, NULL, &error)))
+    fprintf(stderr, "pa_simple_new() failed: %s\n",
+            pa_strerror(error));
+  return s;
+}
+
+// blocking read of n samples, returns 0 or -1
+int read_capture(void *s, short int *pcm, int n) {
+  int e;
+  return pa_simple_read(s, pcm, n * sizeof(short int), &e) < 0 ? -1 : 0;
+}
+
+void close_capture(void *s) {
+  if (s)
+    pa_simple_free(s);
 }
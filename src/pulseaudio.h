@@ -17,9 +17,39 @@
 #ifndef QRQ_PA
 #define QRQ_PA
 
+#include <stdatomic.h>
+
+// counted while a stream is playing, shown in the UI and at exit
+struct audiostats {
+  atomic_long underruns;     // the sound server ran out of samples
+  atomic_long late;          // a chunk came more than a chunk period late
+  atomic_llong maxrender;    // longest render of a call or period, ns
+
+  // set when the device is opened
+  long rate;                 // of the playback stream
+  long nativerate;           // of the sound card, 0 = unknown
+  const char *nativeformat;
+};
+
+extern struct audiostats audiostats;
+
 void *open_dsp ();
 void write_audio (void *bla, int *in, int size);
-void close_audio (void *s);
+void write_pcm (void *bla, const short int *pcm, int n);
+int  close_audio (void *s);
+int  stream_audio (void *s, short int *pcm, int n);
+long audio_latency (void *s);
+void cancel_audio (int on);
+short int *audio_buffer (long *n);
+
+// a separate stream for live audio, short buffering
+void *open_live (long rate, int period);
+void close_live (void *s);
+
+// capture, only with PulseAudio
+void *open_capture (long rate);
+int  read_capture (void *s, short int *pcm, int n);
+void close_capture (void *s);
 
 #endif
 
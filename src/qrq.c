@@ -32,36 +32,35 @@
 #include <sys/stat.h>    // mkdir
 #include <sys/types.h>
 #include <errno.h>
-
-#define PI       M_PI
-#define SILENCE  0       // for the tone generator
-#define SINE     1
-#define SAWTOOTH 2
-#define SQUARE   3
-
-#define MYFREQ   700     // default tone frequency
-#define MAXFREQ  800     // max tone frequency
-#define MINFREQ  400     // min tone frequency
+#include <poll.h>
+#include <locale.h>      // UTF-8 in the terminal
 
 #define DESTDIR "/usr"
 #define CALLDIR "/qrq/callsigns/"
 #define VERSION  "0.3.1x"
 
 #include "pulseaudio.h"
-typedef void *AUDIO_HANDLE;
-
-// call array
-static char calls[5000][10];
-
-const static char *codetable[] = {
-  ".-",    "-...", "-.-.",  "-..",  ".",   "..-.",  "--.", "....",  "..",   ".---",
-  "-.-",   ".-..", "--",  "-.",  "---",   ".--.",  "--.-", ".-.",  "...",   "-",   "..-","...-",
-  ".--",   "-..-", "-.--",  "--..", "-----", ".----", "..---", "...--", "....-", ".....",
-  "-....", "--...", "---..", "----."
-};
+#include "morse.h"
+#include "callbase.h"
+#include "cbindex.h"
+#include "score.h"
+#include "attempt.h"
+#include "textmode.h"
+#include "contest.h"
+#include "pcmcache.h"
+#include "effects.h"
+#include "keyer.h"
+#include "rt.h"
+#include "corpus.h"
+#include "recorder.h"
+#include "metrics.h"
+#include "timeline.h"
+#include "utf8.h"
+#include "waterfall.h"
+#include "dxcc.h"
 
 static char cblist[100][PATH_MAX];              // List of available callbase files
-static char mycall[15] = "DJ1YFK";              // user callsign read from qrqrc
+static char mycall[CALLLEN] = "DJ1YFK";         // user callsign read from qrqrc
 static char dspdevice[PATH_MAX] = "/dev/dsp";   // DSP device is read from qrqrc
 static char *homedir = NULL;
 
@@ -70,75 +69,113 @@ static int cbptr   = 0;                         // callbase pointer
 static int page    = 0;                         // callbase display page
 static int maxpage = 0;                         // max callbase display page
 static int crpos   = 0;                         // cursor position
-static int score = 0;                           // session score
-static int sending_complete;                    // global lock for "enter" while sending
-static int scp = 0;                             // for single character practice
-static int callnr = 0;                          // nr of actual call in attempt
+static char cbmsg[60] = "";                     // result of the last filter
 static int initialspeed = 200;                  // initial speed. to be read from file
-static int mincharspeed = 0;                    // min. char. speed, below: farnsworth
-static int speed = 200;                         // current speed in cpm
-static int maxspeed = 0;
-static int errornr = 0;                         // number of errors in attempt
-static int p = 0;                               // position of cursor, relative to x
 static int status = 1;                          // 1= attempt, 2=config
-static int mode = 1;                            // 0 = overwrite, 1 = insert
-static int j = 0;                               // counter etc.
-static int fixedtone = 1;                       // if 1 don't change the pitch
-static int ctonefreq = MYFREQ;                  // if fixedtone=1 use this freq
-static int freq = MYFREQ;                       // current cw sidetone freq
 static int unlimitedrepeat = 0;                 // allow unlimited repeats
-static int fixspeed = 0;                        // keep speed fixed, regardless of err
 static int mstime = 0;                          // millisecond timer
+static char *textfile = NULL;                   // text copy mode with this file
+static char *replayfile = NULL;                 // --replay, a recorded attempt
+static int keyer = 0;                           // --keyer
+static int contest = 0;                         // --contest
+static int profile = 0;                         // --startup-profile
+static int showsending = 0;                     // show the call as it is heard
+static int waterfall = WF_OFF;                  // source of the waterfall
+static long cachemb = PCMCACHE_MB;              // rendered call cache, MB
+static char metricsat[PATH_MAX] = "";           // socket path or port
+static char metricsdump[PATH_MAX] = "";         // file for the metrics
+static char ctyfile[PATH_MAX] = "cty.dat";      // country file in CALLDIR
+static int country = 0;                         // --country
+
+// receiving conditions, set in qrqrc and the F5 dialog
+static struct {
+  const char *key;                // in qrqrc
+  const char *name;
+  int *val;
+  int step, max;
+  int down, up;                   // keys in the F5 dialog
+} fxsettings[] = {
+  { "noise=",  "noise (%)",       &effects.noise,  10,  200, 'n', 'N' },
+  { "qsb=",    "QSB (%)",         &effects.qsb,    10,  100, 'q', 'Q' },
+  { "qrm=",    "QRM (%)",         &effects.qrm,    10,  100, 'r', 'R' },
+  { "filter=", "filter (Hz)",     &effects.filter, 100, 3000, 'b', 'B' },
+  { "chirp=",  "chirp (Hz)",      &chirp,          10,  200, 'c', 'C' },
+  { "drift=",  "drift (Hz)",      &drift,          5,   100, 't', 'T' },
+  { "clicks=", "key clicks (%)",  &clicks,         10,  100, 'x', 'X' },
+};
+#define NFXSET (sizeof(fxsettings) / sizeof(fxsettings[0]))
+
+// startup phases in ns, for --startup-profile
+static struct {
+  long long start;                // process start
+  long long main, files, config;  // end of the phase
+  long long audio, prewarm;       // durations of the parallel phases
+  long long callbase, toplist;
+  long long parallel;             // end of all of them
+  long long ready;                // first screen shown
+  long long keywait;              // waiting for keys before the first tone
+  long long firsttone;            // first tone audible
+  long latency;                   // of the sound server, us
+} prof;
 
-static unsigned long int nrofcalls = 0;
-static long long starttime = 0;
-static long long endtime = 0;
 
-long samplerate = 44100;
 static long long_i;
-static int waveform = SINE;             // waveform: (0 = none)
 static char wavename[10] = "Sine    ";  // Name of the waveform
-static double edge = 2.0;               // rise/fall time in milliseconds
-static int ed;                          // risetime, normalized to samplerate
 static short buffer[88200];
-static int full_buf[882000];            // 20 second max buffer
-static int full_bufpos = 0;
-
-#define NTONE 4
-static int ctonelist[NTONE] = {550,600,650,700};
-
-AUDIO_HANDLE dsp_fd;
 
 static int  display_toplist();
-static int  calc_score(char *realcall, char *input, int speed, char *output);
 static int  update_score();
 static int  show_error(char *realcall, char *wrongcall);
 static int  clear_display();
 static int  read_config();
-static int  tonegen(int freq, int length, int waveform);
-static void *morse(void *arg);
-static int  add_to_buf(void *data, int size);
 static int  readline(WINDOW *win, int y, int x, char *line, int scp);
-static void check_thread(int j);
+static int  readline_key(WINDOW *win, char *line, int c, int scp);
+static void show_sending(WINDOW *win, int ev);
+static int  show_timeline();
+static void open_waterfall();
+static int  show_waterfall();
+static int  sooner(int a, int b);
 static int  find_files();
 static int  statistics();
-static int  read_callbase();
 static void select_callbase();
+static int  filter_callbase();
+static const char *cbname();
 static void check_tone();
 static void exit_program();
-static long long get_ms();
 static void help();
 static void callbase_dialog();
 static void parameter_dialog();
+static int  fx_setting(const char *line);
+static int  fx_key(int c);
 static int  clear_parameter_display();
 static void update_parameter_dialog();
-
-pthread_t cwthread;            // thread for CW output, to enable
-pthread_attr_t cwattr;         // keyboard reading at the same time
+static unsigned long written_bytes();
+static void update_screen();
+static void text_attempt(char *file);
+static void text_copy(struct textresult *r, char *typed, int res);
+static void contest_attempt();
+static void contest_row(struct contestresult *r);
+static void country_attempt();
+static void add_row(const char *row);
+static void load_countries();
+static void keyer_attempt();
+static void replay_attempt(char *file);
+static int  session_file(char *file);
+static int  load_toplist();
+static void *open_audio_thread(void *arg);
+static void *callbase_thread(void *arg);
+static void *toplist_thread(void *arg);
+static long long process_start();
+static void startup_report();
+static void log_answer(int spd, char *input);
+static void show_audiostats();
+static void audio_metrics(FILE *f);
 
 char rcfilename[PATH_MAX] = "";  // filename and path to qrqrc
 char tlfilename[PATH_MAX] = "";  // filename and path to toplist
-char cbfilename[PATH_MAX] = "";  // filename and path to callbase
+char hsfilename[PATH_MAX] = "";  // every answer, next to the toplist
+char sessiondir[PATH_MAX] = "";  // recorded attempts, next to the toplist
+static FILE *histfh = NULL;
 
 char destdir[PATH_MAX] = "";
 
@@ -149,18 +186,72 @@ WINDOW *conf_w;                 // parameter config display
 WINDOW *bot_w;                  // user input line
 WINDOW *inf_w;                  // info window for param displ
 WINDOW *right_w;                // highscore list/settings
+WINDOW *wf_w = NULL;            // waterfall, below the others
+WINDOW *wfrows_w = NULL;        // its rows, inside the box
+
+// screen state, to skip repaints that change nothing
+static unsigned int mid_rows = 0;       // rows of mid_w with text
+static int conf_clear = 1;              // conf_w has to be cleared
+static int shown_score = -1;            // score and time in top_w
+static int shown_mstime = -1;
+static time_t shown_toplist = 0;        // mtime of the toplist shown
+
+// the toplist as read from disk
+static char toplines[20][35];
+static int ntoplines = 0;
+static time_t toplist_mtime = 0;
+
+// bytes written to the terminal
+static unsigned long termbytes = 0;
+static unsigned long keybytes = 0;      // .. while handling keys
+static unsigned long nrofkeys = 0;
 
 
 int main(int argc, char *argv[]) {
   strcpy(destdir, DESTDIR);
   char tmp[80] = "";
-  char input[15] = "";
-  int i = 0, j = 0, k = 0;
-  char previouscall[80] = "";
-  int previousfreq = 0;
-  // check if help is needed
-  if (argc > 1)
-    help();
+  char input[CALLLEN] = "";
+  char recfile[PATH_MAX];
+  int i = 0, j = 0, spd, ncalls = 0;
+  long long t;
+  pthread_t audiothread, cbthread, tlthread;
+
+  prof.main = get_ns();
+  prof.start = process_start();
+
+  // text copy mode, keyer, recorded corpora, startup profile, or help
+  for (i = 1; i < argc; i++) {
+    if ((!strcmp(argv[i], "--text") || !strcmp(argv[i], "-t")) &&
+        (i + 1 < argc))
+      textfile = argv[++i];
+    else if ((!strcmp(argv[i], "--corpus") || !strcmp(argv[i], "-c")) &&
+             (i + 1 < argc)) {
+      if (corpus_open(argv[++i]) < 0) {
+        fprintf(stderr, "Couldn't open corpus %s or its index\n", argv[i]);
+        exit(EXIT_FAILURE);
+      }
+    } else if ((!strcmp(argv[i], "--replay") || !strcmp(argv[i], "-r")) &&
+             (i + 1 < argc))
+      replayfile = argv[++i];
+    else if ((!strcmp(argv[i], "--export") || !strcmp(argv[i], "-e")) &&
+             (i + 1 < argc)) {
+      if (rec_export(argv[++i]) < 0) {
+        fprintf(stderr, "Couldn't export %s\n", argv[i]);
+        exit(EXIT_FAILURE);
+      }
+      printf("Exported %s to .csv and .wav\n", argv[i]);
+      exit(0);
+    } else if (!strcmp(argv[i], "--keyer") || !strcmp(argv[i], "-k"))
+      keyer = 1;
+    else if (!strcmp(argv[i], "--contest") || !strcmp(argv[i], "-C"))
+      contest = 1;
+    else if (!strcmp(argv[i], "--country") || !strcmp(argv[i], "-d"))
+      country = 1;
+    else if (!strcmp(argv[i], "--startup-profile"))
+      profile = 1;
+    else
+      help();
+  }
   // get $HOME env var
   homedir = getenv("HOME");
   if (!homedir) {
@@ -168,6 +259,7 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Couldn't find HOME\n");
     exit(0);
   }
+  setlocale(LC_CTYPE, "");
   initscr();
   cbreak();
   noecho();
@@ -180,6 +272,7 @@ int main(int argc, char *argv[]) {
 
   // search for toplist and qrqrc
   find_files();
+  prof.files = get_ns();
 
   // buffer for audio
   for (long_i = 0; long_i < 88200; long_i++) {
@@ -189,21 +282,54 @@ int main(int argc, char *argv[]) {
   // random seed
   srand((unsigned)time(NULL));
 
-  // Initialize cwthread. We have to wait for the cwthread to finish before
-  // the next cw output can be made, this will be done with pthread_join
-  pthread_attr_init(&cwattr);
-  pthread_attr_setdetachstate(&cwattr, PTHREAD_CREATE_JOINABLE);
-
   printw("\nReading configuration file qrqrc \n");
   read_config();
-
-  // read the call database
-  nrofcalls = read_callbase();
-  printw("\nReading %d lines from: %s\n\n", nrofcalls, basename(cbfilename));
+  load_countries();
+  pcmcache_init(cachemb << 20);
+  if ((metricsat[0] || metricsdump[0]) &&
+      metrics_start(metricsat, metricsdump, audio_metrics))
+    printw("  metrics: can't listen on %s\n", metricsat);
+  prof.config = get_ns();
+
+  // connect to the sound server, read the call database and the
+  // toplist at the same time
+  if (pthread_create(&audiothread, NULL, open_audio_thread, NULL) ||
+      pthread_create(&cbthread, NULL, callbase_thread, &ncalls) ||
+      pthread_create(&tlthread, NULL, toplist_thread, NULL)) {
+    endwin();
+    perror("Error: Unable to create startup threads");
+    exit(EXIT_FAILURE);
+  }
+  pthread_join(audiothread, NULL);
+  pthread_join(cbthread, NULL);
+  pthread_join(tlthread, NULL);
+  prof.parallel = get_ns();
+
+  // the sample rate is known now
+  if (audiostats.nativerate && (audiostats.nativerate != samplerate))
+    printw("\nThe sound card runs at %ld Hz, calls are rendered at %ld Hz\n"
+           "and resampled by the sound server (%s)\n", audiostats.nativerate,
+           samplerate, nativerate ? "rate not supported" : "nativerate=0");
+  if (rt_init())
+    printw("  real-time: could not lock %ld kB, raise RLIMIT_MEMLOCK\n",
+           rtstate.bytes >> 10);
+
+  if (ncalls <= 0) {
+    endwin();
+    fprintf(stderr, ncalls < 0 ? "Couldn't read call file %s\n" :
+            "\nError: %s is empty\n", cbfilename);
+    exit(EXIT_FAILURE);
+  }
+  nrofcalls = ncalls + 1;
+  if (alphabetauto)
+    alphabet = callbase_alphabet(nrofcalls);
+  printw("\nReading %d lines from: %s\n\n", nrofcalls, cbname());
   printw("Press any key to continue...");
 
   refresh();
+  prof.ready = get_ns();
   getch();
+  prof.keywait += get_ns() - prof.ready;
 
   erase();
   refresh();
@@ -226,19 +352,41 @@ int main(int argc, char *argv[]) {
   keypad(mid_w,  TRUE);
   keypad(conf_w, TRUE);
 
+  box(top_w, 0, 0);
+  box(conf_w, 0, 0);
+  box(mid_w, 0, 0);
+  box(bot_w, 0, 0);
+  box(inf_w, 0, 0);
+  box(right_w, 0, 0);
+  open_waterfall();
+
   // the first thread call
-  j = pthread_create(&cwthread, NULL, &morse, (void *)"");
-  check_thread(j);
+  send_text("");
+
+  if (textfile) {
+    text_attempt(textfile);
+    exit_program();
+  }
+  if (keyer) {
+    keyer_attempt();
+    exit_program();
+  }
+  if (replayfile) {
+    replay_attempt(replayfile);
+    exit_program();
+  }
+  if (contest) {
+    contest_attempt();
+    exit_program();
+  }
+  if (country) {
+    country_attempt();
+    exit_program();
+  }
 
   // run forever
   while (1) {
     while (status == 1) {
-      box(top_w, 0, 0);
-      box(conf_w, 0, 0);
-      box(mid_w, 0, 0);
-      box(bot_w, 0, 0);
-      box(inf_w, 0, 0);
-      box(right_w, 0, 0);
       wattron(top_w, A_BOLD);
       mvwprintw(top_w, 1, 1, "qrq v%s", VERSION);
       wattroff(top_w, A_BOLD);
@@ -254,26 +402,30 @@ int main(int argc, char *argv[]) {
       mvwaddstr(mid_w,  6, 2, "then points are credited.                          ");
       mvwaddstr(mid_w,  9, 2, "Press F7 to repeat the previous call               ");
       mvwaddstr(mid_w, 10, 2, "Press F6 or F1 to repeat the current call          ");
-      mvwaddstr(mid_w, 11, 2, "Press F5 to change settings                        ");
+      mvwaddstr(mid_w, 11, 2, "Press F5 to change settings, F8 to stop sending    ");
       mvwaddstr(mid_w, 12, 2, "Press F4 to quit                                   ");
+      mid_rows = 0x1e7a;                // rows 1, 3-6 and 9-12
 
       wattron(right_w, A_BOLD);
       mvwaddstr(right_w, 1, 6, "Toplist");
       wattroff(right_w, A_BOLD);
       display_toplist();
-      p = 0;                    // cursor to start position
+      editpos = 0;              // cursor to start position
       wattron(bot_w, A_BOLD);
       mvwaddstr(bot_w, 1, 1,  "Please enter your callsign                         ");
       wattroff(bot_w, A_BOLD);
-      wrefresh(top_w);
-      wrefresh(mid_w);
-      wrefresh(bot_w);
-      wrefresh(right_w);
+      wnoutrefresh(top_w);
+      wnoutrefresh(mid_w);
+      wnoutrefresh(bot_w);
+      wnoutrefresh(right_w);
       maxspeed = errornr = score = 0;
       speed = initialspeed;
 
       // prompt for own callsign
+      t = get_ns();
       i = readline(bot_w, 1, 30, mycall, 0);
+      if (!prof.firsttone)
+        prof.keywait += get_ns() - t;
 
       // F4 -> quit
       if (i == 4) {
@@ -286,9 +438,7 @@ int main(int argc, char *argv[]) {
       }
       // F6 -> play test CW
       else if (i == 6) {
-        pthread_join(cwthread, NULL);
-        j = pthread_create(&cwthread, NULL, &morse, (void *)"VVVTEST");
-        check_thread(j);
+        send_text("VVVTEST");
         break;
       } else if (i == 7) {
         statistics();
@@ -301,7 +451,7 @@ int main(int argc, char *argv[]) {
         mycall[7] = '\0';
 
       clear_display();
-      wrefresh(mid_w);
+      wnoutrefresh(mid_w);
 
       // update toplist
       display_toplist();
@@ -310,40 +460,29 @@ int main(int argc, char *argv[]) {
       wattron(top_w, A_BOLD);
       mvwprintw(top_w, 1, 1, "%s", mycall);
       wattroff(top_w, A_BOLD);
+      shown_score = -1;
       update_score();
-      wrefresh(top_w);
 
       // re-read the callbase
+      if (session_file(recfile) < 0) {
+        mvwprintw(mid_w, 14, 2, "Session path too long, not recording");
+        mid_rows |= 1 << 14;
+      } else if (rec_start(recfile, mycall, cbname()) < 0) {
+        mvwprintw(mid_w, 14, 2, "Can't record to %.50s", recfile);
+        mid_rows |= 1 << 14;
+      }
       nrofcalls = read_callbase();
 
       for (callnr = 1; callnr < nrofcalls; callnr++) {
-        // wait for the cwthread of the previous call
-        pthread_join(cwthread, NULL);
-        // select an unused call from the calls array
-        do i = rand() % (nrofcalls - 1);
-        while (calls[i][0] == '\0');
-
-        // only relevant for callbases with less than 50 calls
-        if (nrofcalls == callnr)        // Only one call left!"
-          callnr = 51;                  // Get out after next one
-
-        // select CW tone
-        if (fixedtone)
-          freq = ctonefreq;
-        else
-          freq = ctonelist[rand() % (NTONE)];
+        // select a call and start sending it
+        i = next_call();
 
         mvwprintw(bot_w, 1, 1, "                                      ");
         mvwprintw(bot_w, 1, 1, "%d/%d", callnr, nrofcalls-1);
-        wrefresh(bot_w);
+        show_audiostats();
+        wnoutrefresh(bot_w);
         tmp[0] = '\0';
 
-        // starting the morse output in a separate process to make
-        // keyboard input and echoing at the same time possible
-        sending_complete = 0;
-        j = pthread_create(&cwthread, NULL, morse, calls[i]);
-        check_thread(j);
-
         // check for function key press
         while ((j = readline(bot_w, 1, 10, input, scp)) > 1) {
           switch (j) {
@@ -352,58 +491,51 @@ int main(int argc, char *argv[]) {
             break;
           case 6:              // F6 -> repeat current call
             // wait for old cwthread to finish, then send call again
-            pthread_join(cwthread, NULL);
-            j = pthread_create(&cwthread, NULL, &morse, calls[i]);
-            check_thread(j);
+            send_text(calls[i]);
             break;
           case 7:              // F7 -> repeat previous call
-            if (callnr > 1) {
-              k = freq;
-              freq = previousfreq;
-              pthread_join(cwthread, NULL);
-              j = pthread_create(&cwthread, NULL, &morse, previouscall);
-              check_thread(j);
-              // wait for the CW thread before restore freq
-              // this blocks keyboard input
-              pthread_join(cwthread, NULL);
-              freq = k;
-            }
+            // this blocks keyboard input
+            if (callnr > 1)
+              repeat_previous();
             break;
           default:
             break;
           }
         }
         tmp[0] = '\0';
-        endtime = get_ms();
-        score += calc_score(calls[i], input, speed, tmp);
+        // the call was played, its first tone follows the leading silence
+        if (!prof.firsttone)
+          prof.firsttone = callstat.written + 250000000LL +
+                           prof.latency * 1000LL;
+        spd = speed;
+        t = score;
+        j = finish_call(i, input, tmp);
+        rec_score(previouscall, input, score - t, score);
+        log_answer(spd, input);
         update_score();
-        if (strcmp(tmp, "*"))           // made an error
-          show_error(calls[i], tmp);
+        if (j)                          // made an error
+          show_error(previouscall, tmp);
         input[0] = '\0';
-        strncpy(previouscall, calls[i], 80);
-        previousfreq = freq;
-        calls[i][0] = '\0';
       }
 
       // attempt is over
       callnr = 0;
       i = nrofcalls-1;
-      pthread_join(cwthread, NULL);   // wait for cwthread to finish
+      wait_sending();                 // wait for cwthread to finish
+      rec_stop();
       curs_set(0);
       wattron(bot_w, A_BOLD);
       mvwprintw(bot_w, 1, 1, "%d/%d completed.. Press any key to continue!", i,i);
       wattroff(bot_w, A_BOLD);
-      wrefresh(bot_w);
-      j = pthread_create(&cwthread, NULL, &morse, (void *)"EE");
-      check_thread(j);
-      pthread_join(cwthread, NULL);   // wait for cwthread to finish
+      wnoutrefresh(bot_w);
+      update_screen();
+      send_text("EE");
+      wait_sending();                 // wait for cwthread to finish
 
       j = (int)getch();
       // check for F7 (repeat last)
       while (j == KEY_F(7)) {
-        j = pthread_create(&cwthread, NULL, &morse, previouscall);
-        check_thread(j);
-        pthread_join(cwthread, NULL); // wait for CW thread to finish
+        repeat_previous();            // wait for CW thread to finish
         j = (int)getch();
       }
       mvwprintw(bot_w, 1, 1, "                                            ");
@@ -427,6 +559,7 @@ void parameter_dialog() {
 
   #define KEY_RETN 10
 
+  conf_clear = 1;
   update_parameter_dialog();
 
   while ((j = (int)getch()) != 0) {
@@ -481,9 +614,10 @@ void parameter_dialog() {
         callbase_dialog();
       break;
     case KEY_F(6):
-      pthread_join(cwthread, NULL);
-      j = pthread_create(&cwthread, NULL, &morse, (void *)"TESTING");
-      check_thread(j);
+      send_text("TESTING");
+      break;
+    default:                                // receiving conditions
+      fx_key(j);
       break;
     case KEY_RETN:   // ENTER KEY
     case KEY_F(1):
@@ -491,16 +625,16 @@ void parameter_dialog() {
     case KEY_F(3):
       curs_set(1);
       clear_parameter_display();
-      wrefresh(conf_w);
+      conf_clear = 1;
       // restore old windows
       touchwin(top_w);
       touchwin(mid_w);
       touchwin(bot_w);
       touchwin(right_w);
-      wrefresh(top_w);
-      wrefresh(mid_w);
-      wrefresh(bot_w);
-      wrefresh(right_w);
+      wnoutrefresh(top_w);
+      wnoutrefresh(mid_w);
+      wnoutrefresh(bot_w);
+      wnoutrefresh(right_w);
       return;
     }
     speed = initialspeed;
@@ -511,8 +645,11 @@ void parameter_dialog() {
 
 // update_parameter_dialog
 // repaints the whole config/parameter screen (F5)
+// all lines have a fixed width, so only clear when something else was shown
 void update_parameter_dialog() {
-  clear_parameter_display();
+  if (conf_clear)
+    clear_parameter_display();
+  conf_clear = 0;
   switch (waveform) {
   case SINE:
     strcpy(wavename, "Sine    ");
@@ -525,7 +662,8 @@ void update_parameter_dialog() {
     break;
   }
 
-  mvwaddstr(inf_w, 1, 1, "                                                         ");
+  mvwprintw(inf_w, 1, 1, "Terminal output: %8lu bytes, %6.1f per keystroke ",
+            termbytes, nrofkeys ? (double)keybytes / nrofkeys : 0.0);
   curs_set(0);
   wattron(conf_w, A_BOLD);
   mvwaddstr(conf_w, 1, 1, "Configuration:          Value                Change");
@@ -544,12 +682,21 @@ void update_parameter_dialog() {
             "                  f", (unlimitedrepeat ? "yes" : "no"));
   mvwprintw(conf_w, 8, 2, "Fixed CW speed:        %-3s"
             "                  s", (fixspeed ? "yes" : "no"));
-  mvwprintw(conf_w, 10, 2, "callbase:  %-15s"
-            "   d (%d)", basename(cbfilename), nrofcalls-1);
-
-  mvwprintw(conf_w, 14, 2, "Press Enter to continue");
-  wrefresh(conf_w);
-  wrefresh(inf_w);
+  mvwprintw(conf_w, 9, 2, "Noise/QSB/QRM (%%):     %3d/%3d/%3d"
+            "          n/N q/Q r/R", effects.noise, effects.qsb, effects.qrm);
+  mvwprintw(conf_w, 10, 2, "Filter (Hz, 0 = off):  %-4d"
+            "                 b/B", effects.filter);
+  mvwprintw(conf_w, 11, 2, "Chirp/drift (Hz):      %3d/%3d"
+            "              c/C t/T", chirp, drift);
+  mvwprintw(conf_w, 12, 2, "Key clicks (%%):        %-3d"
+            "                  x/X", clicks);
+  mvwprintw(conf_w, 13, 2, "callbase:  %-15.30s"
+            "   d (%d)", cbname(), nrofcalls-1);
+
+  mvwprintw(conf_w, 15, 2, "Press Enter to continue");
+  wnoutrefresh(conf_w);
+  wnoutrefresh(inf_w);
+  update_screen();
 }
 
 
@@ -559,187 +706,341 @@ void callbase_dialog() {
   mvwaddstr(conf_w, 1, 1, "Change Call Database");
   wattroff(conf_w, A_BOLD);
   select_callbase();
-  wrefresh(conf_w);
+  conf_clear = 1;
   return;
 }
 
 
 // read call data
+// waits for keys and for events from the cw thread in one place,
+// all keys typed ahead are answered with one terminal update
 static int readline(WINDOW *win, int y, int x, char *line, int scp) {
-  int c;
-  int i = 0;
+  struct pollfd fds[2];
+  unsigned long bytes, keys;
+  int c, e, ret = -1, wait = 0;
 
-  if (strlen(line) == 0) p = 0;   // cursor to start if no call in buffer
+  if (strlen(line) == 0) editpos = 0;   // cursor to start if no call in buffer
 
-  if (mode == 1)
+  if (editmode == 1)
     mvwaddstr(win, 1, 55, "INS");
   else
     mvwaddstr(win, 1, 55, "OVR");
 
   mvwaddstr(win, y, x, line);
-  wmove(win, y, x + p);
-  wrefresh(win);
+  wmove(win, y, x + utf8_columns(line, editpos));
+  wnoutrefresh(win);
   curs_set(TRUE);
+  update_screen();
+
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  fds[1].fd = event_fd();
+  fds[1].events = POLLIN;
+  nodelay(win, TRUE);
+
+  while (ret < 0) {
+    // the first round picks up keys ncurses has already buffered
+    if (poll(fds, 2, wait) < 0)          // EINTR, e.g. window resize
+      continue;
+    bytes = termbytes;
+    keys = 0;
+    while ((e = read_event()) != EV_NONE) {
+      rec_audio(e);
+      show_sending(win, e);
+    }
+    wait = sooner(show_timeline(), show_waterfall());
+    while ((ret < 0) && ((c = wgetch(win)) != ERR)) {
+      rec_key(c);
+      ret = readline_key(win, line, c, scp);
+      keys++;
+    }
+    if (ret > 0)                         // function key, caller takes over
+      break;
+    mvwaddstr(win, y, x, "                ");
+    mvwaddstr(win, y, x, line);
+    wmove(win, y, x + utf8_columns(line, editpos));
+    wnoutrefresh(win);
+    update_screen();
+    if (keys) {
+      keybytes += termbytes - bytes;
+      nrofkeys += keys;
+    }
+  }
+  nodelay(win, FALSE);
+  if (ret == 0)
+    curs_set(FALSE);
+  return ret;
+}
 
-  while (1) {
-    c = wgetch(win);
-    // exit loop if user hits the enter key
-    if ((c == '\n') && sending_complete) break;
-
-    if (((c >= 'a' && c <= 'z') ||
-         (c >= 'A' && c <= 'Z') ||
-         (c >= '0' && c <= '9') ||
-         (c == '/') || (c == '=') ||
-         (c == '.') || (c == ',') ||
-         (c == '#') || (c == '!') ||
-         (c == ';') || (c == '-') ||
-         (c == ' ') ||
-         (c == '+') || (c == '?')) && (strlen(line) < 14)) {
-
-      // for single character practice
-      if (scp) {
-        line[p] = toupper(c);
-        line[p + 1] = '\0';
+
+// handle one key for readline()
+// returns 0 when the line is complete, 4, 6 or 7 for function
+// keys the caller handles, or -1 to go on reading
+static int readline_key(WINDOW *win, char *line, int c, int scp) {
+  int e;
+
+  // exit loop if user hits the enter key
+  if ((c == '\n') && sending_complete) return 0;
+
+  e = edit_line(line, c, scp);
+  if (e == EDIT_DONE) {                      // single character practice
+    return 0;
+  } else if (e == EDIT_OK) {
+    if (c == KEY_IC)                         // INS/OVR
+      mvwaddstr(win, 1, 55, (editmode ? "INS" : "OVR"));
+  } else if (c == KEY_F(4)) {                // F4 -> quit
+    return 4;
+  } else if (c == KEY_F(5)) {                // F5 -> settings
+    parameter_dialog();
+  } else if (c == KEY_F(8)) {                // F8 -> stop sending
+    cancel_sending();
+  // alias multiple keys                     // F6 (repeat call)
+  } else if ((c == KEY_LEFT)  || (c == KEY_RIGHT) ||
+             (c == KEY_DOWN)  || (c == KEY_UP)    ||
+             (c == KEY_PPAGE) || (c == KEY_NPAGE) ||
+             (c == KEY_HOME)  || (c == KEY_END)   ||
+             (c == KEY_DC)    || (c == KEY_F(1))  ||
+             (c == KEY_F(2))  || (c == KEY_F(3))  ||
+             (c == KEY_F(6))) {
+    return 6;
+  } else if (c == KEY_F(7)) {
+    return 7;
+  }
+  return -1;
+}
+
+
+// show what the cw thread is doing next to INS/OVR
+static void show_sending(WINDOW *win, int ev) {
+  switch (ev) {
+  case EV_START:
+    mvwaddstr(win, 1, 50, "TX  ");
+    break;
+  case EV_END:
+    mvwaddstr(win, 1, 50, "    ");
+    break;
+  case EV_CANCEL:
+    mvwaddstr(win, 1, 50, "STOP");
+    tl_clear();
+    break;
+  case EV_ERROR:
+    mvwaddstr(win, 1, 50, "ERR ");
+    break;
+  }
+}
+
+
+// with showsending=1 the call appears in top_w as it is heard, the
+// character being sent in reverse and a block while the key is down.
+// Returns the ms until the next event, for poll()
+static int show_timeline() {
+  static char heard[60] = "";
+  static int n = 0, last = 0, key = 0, inchar = 0, done = 1;
+  struct tlevent ev;
+  long long now = get_ns();
+
+  if (!showsending) {
+    tl_clear();
+    return -1;
+  }
+  if (!tl_wait(now)) {
+    while (tl_next(&ev, now)) {
+      switch (ev.type) {
+      case QRQ_EV_CHAR:
+        if (done)
+          n = done = 0;
+        if (utf8_columns(heard, n) + utf8_width(ev.c) <= 14) {
+          last = n;
+          n += utf8_encode(ev.c, heard + n);
+        }
+        heard[n] = '\0';
+        inchar = 1;
+        break;
+      case QRQ_EV_CHAREND:
+        inchar = 0;
+        break;
+      case QRQ_EV_ELEMENT:
+        key = 1;
+        break;
+      case QRQ_EV_ELEMENTEND:
+        key = 0;
+        break;
+      case QRQ_EV_END:
+        done = 1;
+        key = inchar = 0;
         break;
       }
+    }
+    mvwaddstr(top_w, 1, 42, "              ");
+    mvwaddstr(top_w, 1, 42, heard);
+    if (inchar && n)
+      mvwchgat(top_w, 1, 42 + utf8_columns(heard, last),
+               utf8_columns(heard + last, n - last), A_REVERSE, 0, NULL);
+    mvwaddch(top_w, 1, 57, key ? ACS_BLOCK : ' ');
+    wnoutrefresh(top_w);
+  }
+  return tl_wait(get_ns());
+}
 
-      line[strlen(line) + 1] = '\0';
-      c = toupper(c);
-      if (mode == 1) {                       // insert
-        for (i = strlen(line); i > p; i--)   // move all chars by one
-          line[i] = line[i - 1];
-      }
-      line[p] = c;                           // insert into gap
-      p++;
-    } else if ((c == KEY_BACKSPACE || c == 127 || c == 9 || c == 8)
-               && p != 0) {                             // BACKSPACE
-      for (i = p - 1; i < strlen(line); i++)
-        line[i] = line[i + 1];
-      p--;
-    } else if (c == KEY_DC && strlen(line) != 0) {      // DELETE
-      p++;
-      for (i = p - 1; i < strlen(line); i++)
-        line[i] = line[i + 1];
-      p--;
-    } else if (c == KEY_LEFT && p != 0) {
-      p--;
-    } else if (c == KEY_RIGHT && p < strlen(line)) {
-      p++;
-    } else if (c == KEY_HOME) {
-      p = 0;
-    } else if (c == KEY_END) {
-      p = strlen(line);
-    } else if (c == KEY_IC) {                  // INS/OVR
-      if (mode == 1) {
-        mode = 0;
-        mvwaddstr(win, 1, 55, "OVR");
-      } else {
-        mode = 1;
-        mvwaddstr(win, 1, 55, "INS");
-      }
-    } else if (c == KEY_F(4)) {                // F4 -> quit
-      return 4;
-    } else if (c == KEY_F(5)) {                // F5 -> settings
-      parameter_dialog();
-    // alias multiple keys                     // F6 (repeat call)
-    } else if ((c == KEY_LEFT)  || (c == KEY_RIGHT) ||
-               (c == KEY_DOWN)  || (c == KEY_UP)    ||
-               (c == KEY_PPAGE) || (c == KEY_NPAGE) ||
-               (c == KEY_HOME)  || (c == KEY_END)   ||
-               (c == KEY_DC)    || (c == KEY_F(1))  ||
-               (c == KEY_F(2))  || (c == KEY_F(3))  ||
-               (c == KEY_F(6))) {
-      return 6;
-    } else if (c == KEY_F(7)) {
-      return 7;
+
+// the waterfall under the other windows on a terminal with more than
+// 24 lines, WF_LOW to WF_HIGH Hz from left to right and the newest row
+// on top. The terminal scrolls the old rows, so a row costs one line
+// of output
+static void open_waterfall() {
+  static const short color[WF_LEVELS] = {
+    COLOR_BLACK, COLOR_BLUE, COLOR_BLUE, COLOR_CYAN,
+    COLOR_GREEN, COLOR_YELLOW, COLOR_RED, COLOR_WHITE
+  };
+  int f, i, x, w = (COLS < 80) ? COLS : 80;
+  char label[8];
+
+  if ((waterfall == WF_OFF) || (LINES < 24 + 5))
+    return;
+  wf_w = newwin(LINES - 24, w, 24, 0);
+  box(wf_w, 0, 0);
+  for (f = WF_LOW; f <= WF_HIGH; f += 100) {
+    x = 1 + (f - WF_LOW) * (w - 3) / (WF_HIGH - WF_LOW);
+    i = snprintf(label, sizeof(label), "%d", f);
+    mvwaddstr(wf_w, 0, (x + i < w) ? x : w - 1 - i, label);
+  }
+  mvwaddstr(wf_w, LINES - 25, 2,
+            (waterfall == WF_CAPTURE) ? " capture " : " output ");
+  wfrows_w = derwin(wf_w, LINES - 26, w - 2, 1, 1);
+  scrollok(wfrows_w, TRUE);
+  idlok(wfrows_w, TRUE);
+  if (has_colors()) {
+    start_color();
+    for (i = 1; i < WF_LEVELS; i++)
+      init_pair(i, color[i], COLOR_BLACK);
+  }
+  wnoutrefresh(wf_w);
+  if (wf_start(waterfall, samplerate, w - 2)) {
+    delwin(wfrows_w);
+    delwin(wf_w);
+    wfrows_w = wf_w = NULL;
+  }
+}
+
+
+// the rows made since the last call, a shade and colour per level.
+// Returns the ms until the next row, for poll(), -1 without waterfall
+static int show_waterfall() {
+  static const char shade[] = " .:-=+*#";
+  unsigned char level[WF_MAXCOLS];
+  int i, rows = 0, cols;
+  chtype ch;
+
+  if (!wfrows_w)
+    return -1;
+  cols = getmaxx(wfrows_w);
+  while (wf_row(level)) {
+    wscrl(wfrows_w, -1);
+    for (i = 0; i < cols; i++) {
+      ch = shade[level[i]];
+      if (level[i] && has_colors())
+        ch |= COLOR_PAIR(level[i]);
+      if (level[i] >= WF_LEVELS - 2)
+        ch |= A_BOLD;
+      mvwaddch(wfrows_w, 0, i, ch);
     }
-    mvwaddstr(win, y, x, "                ");
-    mvwaddstr(win, y, x, line);
-    wmove(win, y, x + p);
-    wrefresh(win);
+    rows++;
   }
-  curs_set(FALSE);
-  return 0;
+  if (rows)
+    wnoutrefresh(wfrows_w);
+  return wf_wait(get_ns());
+}
+
+
+// the shorter of two poll() timeouts, -1 = none
+static int sooner(int a, int b) {
+  if ((a < 0) || ((b >= 0) && (b < a)))
+    return b;
+  return a;
 }
 
+
 // Read toplist and diplay first 10 entries
+// only when the file or the own call changed since the last time
 static int display_toplist() {
-  FILE *fh;
-  int i = 0;
-  char tmp[35] = "";
+  static char shown_call[CALLLEN] = "";
+  int i;
 
-  if ((fh = fopen(tlfilename, "a+")) == NULL) {
+  if (load_toplist() < 0) {
     endwin();
     fprintf(stderr, "Couldn't open list %s\n", tlfilename);
     exit(EXIT_FAILURE);
   }
+  if ((toplist_mtime == shown_toplist) && !strcmp(shown_call, mycall))
+    return 0;
+  shown_toplist = toplist_mtime;
+  strcpy(shown_call, mycall);
+  for (i = 0; i < ntoplines; i++) {
+    if (strstr(toplines[i], mycall))      // highlight own call
+      wattron(right_w, A_BOLD);
+    mvwaddstr(right_w, i + 3, 2, toplines[i]);
+    wattroff(right_w, A_BOLD);
+  }
+  wnoutrefresh(right_w);
+  return 0;
+}
+
+
+// read the toplist into toplines when it changed on disk
+// returns 0 or -1 if it can't be opened
+static int load_toplist() {
+  struct stat st;
+  FILE *fh;
+  int i = 0;
+  char tmp[35] = "";
+
+  if ((fh = fopen(tlfilename, "a+")) == NULL)
+    return -1;
+  if (!fstat(fileno(fh), &st) && (st.st_mtime == toplist_mtime)) {
+    fclose(fh);
+    return 0;
+  }
+  toplist_mtime = st.st_mtime;
   rewind(fh);                        // go to beginning of file
   (void)fgets(tmp, 34, fh);          // skip the first line
   while ((feof(fh) == 0) && i < 20) {
     i++;
     if (fgets(tmp, 34, fh) != NULL) {
       tmp[17] = '\0';
-      if (strstr(tmp, mycall))       // highlight own call
-        wattron(right_w, A_BOLD);
-      mvwaddstr(right_w, i + 2, 2, tmp);
-      wattroff(right_w, A_BOLD);
+      strcpy(toplines[i - 1], tmp);
+      ntoplines = i;
     }
   }
   fclose(fh);
-  wrefresh(right_w);
   return 0;
 }
 
-// calculate score depending on number of errors and speed
-// writes the correct call and entered call with highlighted errors
-// and returns the score for this call. There are no points
-// in training modes (unlimited attempts/repeats, or fixed speed)
-static int calc_score(char *realcall, char *input, int spd, char *output) {
-  int i, lngth, mistake = 0;
-
-  lngth = strlen(realcall);
-
-  if (strcmp(input, realcall) == 0) {       // exact match!
-    output[0] = '*';                        // * == OK, no mistake
-    output[1] = '\0';
-    if (speed > maxspeed) maxspeed = speed;
-    if (!fixspeed) speed += 10;
-    return (int)(2 * lngth * spd);          // score
-  } else {                                  // assemble error string
-    errornr += 1;
-    if (strlen(input) >= lngth) lngth = strlen(input);
-    for (i = 0; i < lngth; i++) {
-      if (realcall[i] != input[i]) {
-        mistake++;                          // mistake!
-        output[i] = tolower(input[i]);      // print as lower case
-      } else {
-        output[i] = input[i];
-      }
-    }
-    output[i] = '\0';
-    // slow down if not in fixed speed mode
-    if ((speed > 29) && !fixspeed) speed -= 10;
-    return 0; ;
-  }
-}
-
 // print score, current speed and max speed to window
 static int update_score() {
-  mvwaddstr(top_w, 1, 10, "Score:                                   ");
-  mvwprintw(top_w, 2, 10, "File:  %s", basename(cbfilename));
-  if (endtime > starttime) {
+  if (endtime > starttime)
     mstime = (int)(endtime - starttime);
+  else
+    mstime = 0;
+  if ((score == shown_score) && (mstime == shown_mstime))
+    return 0;
+  shown_score = score;
+  shown_mstime = mstime;
+
+  mvwaddstr(top_w, 1, 10, "Score:                        ");
+  mvwprintw(top_w, 2, 10, "File:  %-40.40s", cbname());
+  if (mstime) {
     mvwprintw(top_w, 1, 17, "%6d   %6d ms", score, mstime);
   } else {
     mvwprintw(top_w, 1, 17, "%6d", score);
   }
-  wrefresh(top_w);
+  wnoutrefresh(top_w);
   return 0;
 }
 
 // Display the correct call and what the user entered
 // with mistakes highlighted
 static int show_error(char *realcall, char *wrongcall) {
+  const struct dxcc *d;
   int x = 2;
   int y = errornr;
   int i;
@@ -756,18 +1057,32 @@ static int show_error(char *realcall, char *wrongcall) {
   if (errornr > 15) {
     x = 30; y = (errornr % 16) + 1;
   }
-  mvwprintw(mid_w, y, x, "%-13s %-13s", realcall, wrongcall);
-  wrefresh(mid_w);
+  // calls in other scripts are not as wide as they are long
+  mvwaddstr(mid_w, y, x, "                           ");
+  if ((d = dxcc_call(realcall)) && (strlen(realcall) < 9) &&
+      (strlen(wrongcall) < 9)) {
+    // a callsign with its country: prefix, CQ zone and continent
+    mvwaddstr(mid_w, y, x, realcall);
+    mvwaddstr(mid_w, y, x + 9, wrongcall);
+    mvwprintw(mid_w, y, x + 18, "%-3.3s %2d %s", d->prefix, d->cq, d->cont);
+  } else {
+    mvwaddstr(mid_w, y, x, realcall);
+    mvwaddstr(mid_w, y, x + 14, wrongcall);
+  }
+  mid_rows |= 1 << y;
+  wnoutrefresh(mid_w);
   return 0;
 }
 
 
-// clear error display
+// clear error display, only the rows that have text
 static int clear_display() {
   int i;
   for (i = 1; i < 16; i++)
-    mvwprintw(mid_w, i, 1, "                                 "
-              "                        ");
+    if (mid_rows & (1 << i))
+      mvwprintw(mid_w, i, 1, "                                 "
+                "                        ");
+  mid_rows = 0;
   return 0;
 }
 
@@ -788,6 +1103,7 @@ static int read_config() {
   FILE *fh;
   char tmp[80] = "";
   int i = 0;
+  int j = 0;
   int k = 0;
   int line = 0;
 
@@ -929,6 +1245,89 @@ static int read_config() {
       tmp[i] = '\0';
       samplerate = atoi(tmp);
       printw("  line  %2d: sample rate: %d\n", line, samplerate);
+    } else if (tmp == strstr(tmp, "metrics=")) {
+      sscanf(tmp + 8, "%4095s", metricsat);
+      printw("  line  %2d: metrics at: %s\n", line, metricsat);
+    } else if (tmp == strstr(tmp, "cty=")) {
+      ctyfile[0] = '\0';
+      sscanf(tmp + 4, "%4095s", ctyfile);
+      printw("  line  %2d: country file: %s\n", line,
+             ctyfile[0] ? ctyfile : "none");
+    } else if (tmp == strstr(tmp, "metricsdump=")) {
+      sscanf(tmp + 12, "%4095s", metricsdump);
+      printw("  line  %2d: metrics written to: %s\n", line, metricsdump);
+    } else if (tmp == strstr(tmp, "nativerate=")) {
+      nativerate = (tmp[11] == '1');
+      printw("  line  %2d: render at the rate of the sound card: %s\n", line,
+             nativerate ? "yes" : "no");
+    } else if (tmp == strstr(tmp, "pcmcache=")) {
+      while (isdigit(tmp[i] = tmp[9 + i]))
+        i++;
+      tmp[i] = '\0';
+      cachemb = atol(tmp);
+      printw("  line  %2d: call cache: %ld MB\n", line, cachemb);
+    } else if (tmp == strstr(tmp, "showsending=")) {
+      showsending = (tmp[12] == '1');
+      printw("  line  %2d: show the calls while they are sent: %s\n", line,
+             showsending ? "yes" : "no");
+    } else if (tmp == strstr(tmp, "alphabet=")) {
+      tmp[strcspn(tmp, " \t\r\n")] = '\0';
+      alphabetauto = !strcmp(tmp + 9, "auto");
+      if (!alphabetauto && (alphabet = qrq_alphabet_find(tmp + 9)) < 0) {
+        alphabet = 0;
+        printw("  line  %2d: unknown alphabet %s, using itu\n", line, tmp + 9);
+      } else {
+        printw("  line  %2d: alphabet: %s\n", line,
+               alphabetauto ? "auto" : qrq_alphabet_name(alphabet));
+      }
+    } else if (tmp == strstr(tmp, "waterfall=")) {
+      if ((tmp[10] >= '0') && (tmp[10] - '0' <= WF_CAPTURE))
+        waterfall = tmp[10] - '0';
+      printw("  line  %2d: waterfall: %s\n", line, (waterfall == WF_OFF) ?
+             "off" : (waterfall == WF_OUTPUT) ? "output" : "capture");
+    } else if (tmp == strstr(tmp, "contestgap=")) {
+      contestgap = atoi(tmp + 11);
+      if (contestgap < 0)
+        contestgap = 0;
+      printw("  line  %2d: contest gap: %d ms\n", line, contestgap);
+    } else if (tmp == strstr(tmp, "contestcalls=")) {
+      contestcalls = atoi(tmp + 13);
+      if (contestcalls < 1)
+        contestcalls = 1;
+      printw("  line  %2d: contest calls: %d\n", line, contestcalls);
+    } else if (tmp == strstr(tmp, "record=")) {
+      recording = (tmp[7] == '1');
+      printw("  line  %2d: record attempts: %s\n", line, recording ? "yes" : "no");
+    } else if (tmp == strstr(tmp, "realtime=")) {
+      realtime = (tmp[9] == '1');
+      printw("  line  %2d: real-time audio: %s\n", line, realtime ? "yes" : "no");
+    } else if (tmp == strstr(tmp, "scoremode=")) {
+      while (isdigit(tmp[i] = tmp[10 + i]))
+        i++;
+      tmp[i] = '\0';
+      scoremode = atoi(tmp);
+      if (scoremode > SCORE_ONEOFF)
+        scoremode = SCORE_EXACT;
+      printw("  line  %2d: score mode: %d\n", line, scoremode);
+    } else if ((k = fx_setting(tmp)) >= 0) {
+      j = strlen(fxsettings[k].key);
+      while (isdigit(tmp[i] = tmp[j + i]))
+        i++;
+      tmp[i] = '\0';
+      i = atoi(tmp);
+      *fxsettings[k].val = (i > fxsettings[k].max) ? fxsettings[k].max : i;
+      printw("  line  %2d: %s: %d\n", line, fxsettings[k].name,
+             *fxsettings[k].val);
+    } else if (tmp == strstr(tmp, "keyer=")) {
+      while (isgraph(tmp[i] = tmp[6 + i]))
+        i++;
+      tmp[i] = '\0';
+      strncpy(keyerdevice, tmp, sizeof(keyerdevice) - 1);
+      printw("  line  %2d: keyer device: %s\n", line, keyerdevice);
+    } else if (tmp == strstr(tmp, "keyermode=")) {
+      if (isdigit(tmp[10]) && (tmp[10] - '0' <= KEYER_IAMBIC_B))
+        keyermode = tmp[10] - '0';
+      printw("  line  %2d: keyer mode: %d\n", line, keyermode);
     }
     strcpy(cbfilename, cblist[cbptr]);
   }
@@ -942,152 +1341,39 @@ static int read_config() {
 }
 
 
-static void *morse(void *arg) {
-  char *text = arg;
-  int i, j;
-  int c, fulldotlen, dotlen, dashlen, charspeed, farnsworth, fwdotlen;
-  const char *code;
-
-  // opening the DSP device
-  dsp_fd = open_dsp(dspdevice);
-
-  // set bufpos to 0
-  full_bufpos = 0;
+// index of the receiving condition set in a qrqrc line, -1 if none
+static int fx_setting(const char *line) {
+  int k;
 
-  // some silence
-  tonegen(0, samplerate / 4, SILENCE);
-
-  // Farnsworth?
-  if (speed < mincharspeed) {
-    charspeed = mincharspeed;
-    farnsworth = 1;
-    fwdotlen = (int)(samplerate * 6 / speed);
-  } else {
-    charspeed = speed;
-    farnsworth = 0;
-  }
-
-  // speed is in LpM now, so we have to calculate the dot-length in
-  // milliseconds using the well-known formula  dotlength= 60/(wpm*50)
-  // and then to samples
-
-  dotlen = (int)(samplerate * 6 / charspeed);
-  fulldotlen = dotlen;
-  dashlen = 3 * dotlen;
-
-  // edge = length of rise/fall time in ms. ed = in samples
-
-  ed = (int)(samplerate * (edge / 1000.0));
-
-  // the signal needs "ed" samples to reach the full amplitude and
-  // at the end another "ed" samples to reach zero. The dots and
-  // dashes therefore are becoming longer by "ed" and the pauses
-  // after them are shortened accordingly by "ed" samples
-
-  for (i = 0; i < strlen(text); i++) {
-    c = text[i];
-    if (isalpha(c))
-      code = codetable[c - 65];
-    else if (isdigit(c))
-      code = codetable[c - 22];
-    else if (c == '/')
-      code = "-..-.";
-    else if (c == '=')
-      code = "-...-";
-    else if (c == '.')
-      code = ".-.-.-";
-    else if (c == '!')
-      code = "-.-.--";
-    else if (c == ',')
-      code = "--..--";
-    else if (c == ';')
-      code = "-.-.-.";
-    else if (c == '#')
-      code = "-.-.-";
-    else if (c == '+')
-      code = ".-.-.";
-    else if (c == '-')
-      code = "-....-";
-    else if (c == ' ')
-      code = " ";
-    else
-      code = "..--..";     // ?
-
-    // generate dots, dashes, and space
-    for (j = 0; j < strlen(code); j++) {
-      c = code[j];
-      if (c == '.') {
-        // dot
-        tonegen(freq, dotlen + ed, waveform);
-        tonegen(0, fulldotlen - ed, SILENCE);
-      } else if (c == '-') {
-        // dash
-        tonegen(freq, dashlen + ed, waveform);
-        tonegen(0, fulldotlen - ed, SILENCE);
-      } else {
-        // space
-        tonegen(0, 3*fulldotlen, SILENCE);
-      }
-    }
-    if (farnsworth)
-      tonegen(0, 3 * fwdotlen - fulldotlen, SILENCE);
-    else
-      tonegen(0, 2 * fulldotlen, SILENCE);
-  }
-
-  write_audio(dsp_fd, &full_buf[0], full_bufpos);
-  close_audio(dsp_fd);
-  sending_complete = 1;
-  starttime = get_ms();
-  return NULL;
+  for (k = 0; k < NFXSET; k++)
+    if (line == strstr(line, fxsettings[k].key))
+      return k;
+  return -1;
 }
 
-static int add_to_buf(void *data, int size) {
-  memcpy(&full_buf[full_bufpos / sizeof(int)], data, size);
-  full_bufpos += size;
-  return 0;
-}
-
-// generate a sine tone of frequency and length
-static int tonegen(int freq, int len, int waveform) {
-  int x = 0;
-  int out;
-  double val = 0;
 
-  for (x = 0; x < len - 1; x++) {
-    switch (waveform) {
-    case SINE:
-      val = sin(2 * PI * freq * x / samplerate);
-      break;
-    case SAWTOOTH:
-      val = ((1.0 * freq * x / samplerate) - floor(1.0 * freq * x / samplerate)) - 0.5;
-      break;
-    case SQUARE:
-      val = ceil(sin(2 * PI * freq * x / samplerate)) - 0.5;
-      break;
-    case SILENCE:
-      val = 0;
+// change a receiving condition with its key in the F5 dialog
+// returns 0 if c is no such key
+static int fx_key(int c) {
+  int k, *v;
+
+  for (k = 0; k < NFXSET; k++) {
+    v = fxsettings[k].val;
+    if (c == fxsettings[k].up) {
+      *v += fxsettings[k].step;
+      if (*v > fxsettings[k].max)
+        *v = fxsettings[k].max;
+      return 1;
+    } else if (c == fxsettings[k].down) {
+      *v -= fxsettings[k].step;
+      if (*v < 0)
+        *v = 0;
+      return 1;
     }
-
-    if (x < ed) val *= pow(sin(PI * x / (2.0 * ed)), 2);    // rising edge
-
-    if (x > (len - ed))                                     // falling edge
-      val *= pow(sin(2 * PI * (x - (len - ed) + ed) / (4 * ed)), 2);
-
-    out = (int)(val * 32500.0);
-    add_to_buf(&out, sizeof(out));
   }
   return 0;
 }
 
-// verify that thread was created OK
-static void check_thread(int j) {
-  if (j) {
-    endwin();
-    perror("Error: Unable to create cwthread!\n");
-    exit(EXIT_FAILURE);
-  }
-}
 
 // See where our files are. We need qrqrc and toplist
 // The can be:
@@ -1108,6 +1394,10 @@ static int find_files() {
     strcat(rcfilename, "/qrq/qrqrc");
     strcpy(tlfilename, homedir);
     strcat(tlfilename, "/qrq/toplist");
+    strcpy(hsfilename, homedir);
+    strcat(hsfilename, "/qrq/history");
+    strcpy(sessiondir, homedir);
+    strcat(sessiondir, "/qrq/sessions");
 
     // check if there is ~/qrq/qrqrc
     if (((fh = fopen(rcfilename, "r")) == NULL) ||
@@ -1123,6 +1413,8 @@ static int find_files() {
     printw(".. found files in current directory\n");
     strcpy(rcfilename, "qrqrc");
     strcpy(tlfilename, "toplist");
+    strcpy(hsfilename, "history");
+    strcpy(sessiondir, "sessions");
   }
   refresh();
   fclose(fh);
@@ -1130,6 +1422,63 @@ static int find_files() {
 }
 
 
+// underruns, late writes and the longest render next to the input line,
+// in real-time mode or once there was a problem
+static void show_audiostats() {
+  if (!realtime && !audiostats.underruns && !audiostats.late)
+    return;
+  mvwprintw(bot_w, 1, 27, "xrun %ld late %ld %.1fms   ",
+            (long)audiostats.underruns, (long)audiostats.late,
+            audiostats.maxrender / 1e6);
+}
+
+
+// the audio counters and the cache, for the metrics
+static void audio_metrics(FILE *f) {
+  struct pcmstats cs;
+
+  pcmcache_stats(&cs);
+  fprintf(f, "# TYPE qrq_underruns_total counter\nqrq_underruns_total %ld\n"
+          "# TYPE qrq_late_writes_total counter\nqrq_late_writes_total %ld\n"
+          "# TYPE qrq_cache_hits_total counter\nqrq_cache_hits_total %ld\n"
+          "# TYPE qrq_cache_misses_total counter\nqrq_cache_misses_total %ld\n"
+          "# TYPE qrq_cache_bytes gauge\nqrq_cache_bytes %ld\n",
+          (long)audiostats.underruns, (long)audiostats.late, cs.hits,
+          cs.misses, cs.bytes);
+}
+
+
+// name of the file for the next recorded attempt, the time it starts
+// in the sessions directory, which is created when needed; -1 if
+// the path doesn't fit, so no cut-off name is ever opened
+static int session_file(char *file) {
+  char stamp[32];
+  time_t now = time(NULL);
+
+  file[0] = '\0';
+  if (!recording)
+    return 0;
+  mkdir(sessiondir, 0755);
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+  if (snprintf(file, PATH_MAX, "%s/%s.qrs", sessiondir, stamp) >= PATH_MAX) {
+    file[0] = '\0';
+    return -1;
+  }
+  return 0;
+}
+
+
+// append the last answer to the history, qrqscore can score it again
+// time, own call, speed, call sent and answer, separated by tabs
+static void log_answer(int spd, char *input) {
+  if (!histfh && ((histfh = fopen(hsfilename, "a")) == NULL))
+    return;
+  fprintf(histfh, "%ld\t%s\t%d\t%s\t%s\n", (long)time(NULL), mycall,
+          spd, previouscall, input);
+  fflush(histfh);
+}
+
+
 static int statistics() {
   char line[80] = "";
   int time = 0;
@@ -1174,55 +1523,6 @@ static int statistics() {
 }
 
 
-int read_callbase() {
-  FILE *fh;
-  int c, i;
-  int maxlen = 0;
-  char tmp[80] = "";
-  int nr = 0;
-
-  if ((fh = fopen(cbfilename, "r")) == NULL) {
-    endwin();
-    fprintf(stderr, "Couldn't read call file %s\n", cbfilename);
-    exit(EXIT_FAILURE);
-  }
-  // count the lines/calls and lengths
-  i = 0;
-  while ((c = getc(fh)) != EOF) {
-    i++;
-    if (c == '\n') {
-      nr++;
-      maxlen = (i > maxlen) ? i : maxlen;
-      i = 0;
-    }
-  }
-  maxlen++;
-  // for single character practice
-  if (maxlen == 3) scp = 1;
-  else scp = 0;
-
-  if (!nr) {
-    endwin();
-    printf("\nError: %s is empty\n", cbfilename);
-    exit(EXIT_FAILURE);
-  }
-
-  rewind(fh);
-
-  nr = 0;
-  while (fgets(tmp, maxlen, fh) != NULL) {
-    for (i = 0; i < strlen(tmp); i++)
-      tmp[i] = toupper(tmp[i]);
-    tmp[i - 1] = '\0';              // remove newline
-    if (tmp[i - 2] == '\r')         // also for DOS files
-      tmp[i - 2] = '\0';
-    strcpy(calls[nr], tmp);
-    nr++;
-  }
-  fclose(fh);
-  return nr+1;
-}
-
 void select_callbase() {
   int cbidx = 0, key = 0;
 
@@ -1231,8 +1531,10 @@ void select_callbase() {
   // loop for key input
   while (1) {
     // clear file names from screen
-    for (cbidx = 4; cbidx < 16; cbidx++)
+    for (cbidx = 4; cbidx < 14; cbidx++)
       mvwprintw(conf_w, cbidx, 2, "                                              ");
+    mvwprintw(conf_w, 14, 2, "%-50s", "/  filter all callbases");
+    mvwprintw(conf_w, 15, 2, "%-50s", cbmsg);
 
     // then display 10 file names with cursor mark
     for (cbidx = page * 10; cbidx < (page + 1) * 10; cbidx++) {
@@ -1243,7 +1545,8 @@ void select_callbase() {
         mvwprintw(conf_w, 3 + (cbidx - (page * 10)), 2, ">");
     }
 
-    wrefresh(conf_w);
+    wnoutrefresh(conf_w);
+    update_screen();
     key = (int)getch();
 
     switch (key) {
@@ -1260,13 +1563,73 @@ void select_callbase() {
     case '\n':
       strcpy(cbfilename, cblist[crpos]);
       cbptr = crpos;                    // callbase pointer
+      cbquery[0] = '\0';
       nrofcalls = read_callbase();
       return;
       break;
+    case '/':
+      if (filter_callbase())
+        return;
+      break;
     }
+  }
+  curs_set(TRUE);
+}
+
+
+// make a virtual callbase of the entries of all files that match a query
+// the index is built the first time. returns 1 if a callbase was made
+static int filter_callbase() {
+  char query[CBQUERY] = "";
+  long long t;
+  int n, total, single;
+
+  if (!cbindex_size()) {
+    mvwprintw(conf_w, 15, 2, "indexing %d files ...", cbtot);
     wrefresh(conf_w);
+    if (cbindex_build(cblist, cbtot) < 0) {
+      strcpy(cbmsg, "Couldn't read the callbase files");
+      return 0;
+    }
   }
+
+  mvwprintw(conf_w, 14, 2, "%-50s", "filter:");
+  mvwprintw(conf_w, 15, 2, "%-50s", "e.g. len=5 has=QYZ  2=#  pre=DL  dxcc=JA  cq=14");
+  echo();
   curs_set(TRUE);
+  mvwgetnstr(conf_w, 14, 10, query, CBQUERY - 1);
+  noecho();
+  curs_set(FALSE);
+  if (!query[0]) {
+    cbmsg[0] = '\0';
+    return 0;
+  }
+
+  // check the query before the calls array is overwritten
+  t = get_ns();
+  n = cbindex_query(query, calls, 0, &single, &total);
+  if (n < 0 || !total) {
+    strcpy(cbmsg, n < 0 ? "invalid filter" : "nothing matches");
+    return 0;
+  }
+  strcpy(cbquery, query);
+  nrofcalls = read_callbase();
+  t = get_ns() - t;
+
+  snprintf(cbmsg, sizeof(cbmsg), "%d of %d entries, %.2f ms", total,
+           cbindex_size(), t / 1e6);
+  mvwprintw(conf_w, 15, 2, "%s - press a key", cbmsg);
+  wrefresh(conf_w);
+  getch();
+  return 1;
+}
+
+
+// name of the callbase for the display, the query of a virtual one
+static const char *cbname() {
+  if (corpus_size())
+    return corpus_name();
+  return cbquery[0] ? cbquery : basename(cbfilename);
 }
 
 
@@ -1277,24 +1640,64 @@ void check_tone() {
 
 
 void exit_program() {
+  struct pcmstats cs;
+
+  // wait for the cw thread, then send 73
+  rec_stop();
+  send_text("73");
   // wait for the cw thread
-  pthread_join(cwthread, NULL);
-  // send 73
-  j = pthread_create(&cwthread, NULL, &morse, (void *)"73");
-  check_thread(j);
-  // wait for the cw thread
-  pthread_join(cwthread, NULL);
+  wait_sending();
+  wf_stop();
   endwin();
+  if (profile)
+    startup_report();
+  printf("\nTerminal output: %lu bytes, %.1f bytes per keystroke\n",
+         termbytes, nrofkeys ? (double)keybytes / nrofkeys : 0.0);
+  pcmcache_stats(&cs);
+  printf("Call cache: %ld hits, %ld misses, %ld calls in %.1f MB\n",
+         cs.hits, cs.misses, cs.entries, cs.bytes / 1048576.0);
+  printf("Audio: %ld underruns, %ld late writes, longest render %.1f ms\n",
+         (long)audiostats.underruns, (long)audiostats.late,
+         audiostats.maxrender / 1e6);
+  if (audiostats.nativerate)
+    printf("Sound card: %ld Hz %s, rendered at %ld Hz%s\n",
+           audiostats.nativerate, audiostats.nativeformat, audiostats.rate,
+           (audiostats.nativerate != audiostats.rate) ? ", resampled" : "");
+  if (realtime)
+    printf("Real-time: %s, %.1f MB of buffers %s\n",
+           rtstate.fifo ? "SCHED_FIFO" :
+           (rtstate.denied ? "SCHED_FIFO not permitted" : "not used"),
+           rtstate.bytes / 1048576.0, rtstate.locked ? "locked" : "pre-faulted");
   printf("\nThank You for using qrq version %s !!\n\n", VERSION);
   exit(0);
 }
 
 
-long long get_ms() {
-  struct timeval te;
-  gettimeofday(&te, NULL);
-  long long ms = te.tv_sec*1000LL + te.tv_usec/1000;
-  return ms;
+// bytes written by this thread so far, from /proc/thread-self/io
+// (0 if that is not available)
+static unsigned long written_bytes() {
+  static int fd = -2;
+  char tmp[256];
+  char *w;
+  ssize_t n;
+
+  if (fd == -2)
+    fd = open("/proc/thread-self/io", O_RDONLY);
+  if ((fd < 0) || ((n = pread(fd, tmp, sizeof(tmp) - 1, 0)) <= 0))
+    return 0;
+  tmp[n] = '\0';
+  if ((w = strstr(tmp, "wchar:")) == NULL)
+    return 0;
+  return strtoul(w + 6, NULL, 10);
+}
+
+
+// send all pending window changes to the terminal in one go
+static void update_screen() {
+  unsigned long before = written_bytes();
+
+  doupdate();
+  termbytes += written_bytes() - before;
 }
 
 
@@ -1305,6 +1708,757 @@ void help() {
   printf("This is free software, and you are welcome to\n");
   printf("redistribute it under certain conditions (see COPYING)\n");
   printf("Start 'qrq' with no command line args for normal operation\n");
+  printf("or 'qrq --text FILE' to copy a text file of any length\n");
+  printf("or 'qrq --keyer' to practise sending with a live sidetone\n");
+  printf("or 'qrq --contest' to copy calls sent back to back, as in a pileup\n");
+  printf("or 'qrq --country' to name the country of every call\n");
+  printf("or 'qrq --corpus FILE.wav ...' to copy calls from recordings\n");
+  printf("or 'qrq --replay FILE.qrs' to step through a recorded attempt\n");
+  printf("or 'qrq --export FILE.qrs' to write it as FILE.csv and FILE.wav\n");
+  printf("--startup-profile prints the time of the startup phases at exit\n");
   exit(0);
 }
 
+
+
+// copied words of the text mode, the last rows of mid_w
+#define COPYROWS 5
+static char copyref[COPYROWS][59], copytyp[COPYROWS][59];
+static int copyrow = 0, copycol = 0;
+
+// text copy mode: send the file as one stream, the student copies it
+// word by word, a space or ENTER ends a word
+static void text_attempt(char *file) {
+  struct cwparams cp;
+  struct textresult r;
+  struct textstats ts;
+  struct pollfd fds[1];
+  char word[MAXWORD + 1] = "";
+  long shown[3] = { -1, -1, -1 };
+  int c, i, n = 0, res, running = 1, done = 0, wait;
+
+  if (text_open(file)) {
+    endwin();
+    fprintf(stderr, "Couldn't open text %s\n", file);
+    exit(EXIT_FAILURE);
+  }
+  wait_sending();
+  cw_params(&cp);
+  if (fixedtone)
+    cp.freq = ctonefreq;
+
+  clear_display();
+  memset(copyref, 0, sizeof(copyref));
+  memset(copytyp, 0, sizeof(copytyp));
+  wattron(top_w, A_BOLD);
+  mvwprintw(top_w, 1, 1, "Text: %-.50s", basename(file));
+  wattroff(top_w, A_BOLD);
+  mvwaddstr(right_w, 1, 2, "Copy the text,    ");
+  mvwaddstr(right_w, 2, 2, "SPACE/ENTER ends  ");
+  mvwaddstr(right_w, 3, 2, "a word. F8 stops, ");
+  mvwaddstr(right_w, 4, 2, "F4 quits.         ");
+  wnoutrefresh(right_w);
+  if (text_start(&cp)) {
+    endwin();
+    perror("Error: Unable to start sending the text");
+    exit(EXIT_FAILURE);
+  }
+
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  nodelay(bot_w, TRUE);
+  curs_set(TRUE);
+
+  while (!done) {
+    while ((c = wgetch(bot_w)) != ERR) {
+      if ((c == ' ') || (c == '\n')) {
+        if (n) {
+          res = text_score(word, &r);
+          text_copy(&r, word, res);
+          word[n = 0] = '\0';
+        } else if ((c == '\n') && text_done()) {
+          done = 1;
+          break;
+        }
+      } else if ((c == KEY_BACKSPACE) || (c == 127) || (c == 8)) {
+        if (n)
+          word[--n] = '\0';
+      } else if (c == KEY_F(8)) {
+        if (running)
+          text_stop();
+        running = 0;
+      } else if (c == KEY_F(4)) {
+        done = 1;
+        break;
+      } else if ((c < 128) && (isalnum(c) || strchr("/=.!,;+-?", c)) &&
+                 (n < MAXWORD)) {
+        word[n++] = toupper(c);
+        word[n] = '\0';
+      }
+    }
+
+    // score line, only when it changed
+    text_totals(&ts);
+    if ((ts.score != shown[0]) || (ts.sent != shown[1]) ||
+        (text_progress() != shown[2])) {
+      shown[0] = ts.score;
+      shown[1] = ts.sent;
+      shown[2] = text_progress();
+      mvwprintw(top_w, 2, 1, "Score %7ld  words %5ld/%-5ld  missed %4ld  %3ld%%  ",
+                ts.score, ts.correct, ts.sent, ts.missed, shown[2]);
+      wnoutrefresh(top_w);
+    }
+    mvwprintw(bot_w, 1, 1, "%-12s", text_done() ? "ENTER = end" : "");
+    mvwprintw(bot_w, 1, 14, "%-*s", MAXWORD + 1, word);
+    wmove(bot_w, 1, 14 + n);
+    wnoutrefresh(bot_w);
+    wait = show_waterfall();
+    update_screen();
+
+    if (!done && (poll(fds, 1, sooner(250, wait)) < 0) && (errno != EINTR))
+      break;
+  }
+  nodelay(bot_w, FALSE);
+
+  if (running)
+    text_stop();
+  text_finish();
+  text_close();
+
+  text_totals(&ts);
+  i = ts.correct + ts.wrong + ts.missed;
+  mvwprintw(bot_w, 1, 1, "%ld of %d words, %ld points. Press any key   ",
+            ts.correct, i, ts.score);
+  wnoutrefresh(bot_w);
+  update_screen();
+  getch();
+}
+
+
+// scored calls of the contest mode, the rows of mid_w
+#define CONTESTROWS 15
+static char contestrows[CONTESTROWS][59];
+static int ncontestrows = 0;
+
+// contest mode: the calls are sent back to back, contestgap ms apart,
+// and never wait for the answers. SPACE or ENTER sends an answer off
+// to be scored in the background
+static void contest_attempt() {
+  struct contestresult r;
+  struct conteststats cs;
+  struct pollfd fds[1];
+  char word[15] = "";
+  long shown[4] = { -1, -1, -1, -1 };
+  int c, n = 0, running = 1, done = 0, wait;
+
+  wait_sending();
+  speed = initialspeed;
+  if (fixedtone)
+    freq = ctonefreq;
+
+  clear_display();
+  memset(contestrows, 0, sizeof(contestrows));
+  ncontestrows = 0;
+  wattron(top_w, A_BOLD);
+  mvwprintw(top_w, 1, 1, "Contest: %d calls, %d ms apart", contestcalls,
+            contestgap);
+  wattroff(top_w, A_BOLD);
+  mvwaddstr(right_w, 1, 2, "Copy the calls,   ");
+  mvwaddstr(right_w, 2, 2, "SPACE/ENTER sends ");
+  mvwaddstr(right_w, 3, 2, "an answer. F8     ");
+  mvwaddstr(right_w, 4, 2, "stops, F4 quits.  ");
+  wnoutrefresh(right_w);
+  if (contest_start(contestcalls)) {
+    endwin();
+    perror("Error: Unable to start the contest");
+    exit(EXIT_FAILURE);
+  }
+
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  nodelay(bot_w, TRUE);
+  curs_set(TRUE);
+
+  while (!done) {
+    while ((c = wgetch(bot_w)) != ERR) {
+      if ((c == ' ') || (c == '\n')) {
+        if (n) {
+          contest_answer(word);
+          word[n = 0] = '\0';
+        } else if ((c == '\n') && contest_done()) {
+          done = 1;
+          break;
+        }
+      } else if ((c == KEY_BACKSPACE) || (c == 127) || (c == 8)) {
+        if (n)
+          word[--n] = '\0';
+      } else if (c == KEY_F(8)) {
+        if (running)
+          contest_stop();
+        running = 0;
+      } else if (c == KEY_F(4)) {
+        done = 1;
+        break;
+      } else if ((c < 128) && (isalnum(c) || (c == '/')) && (n < 14)) {
+        word[n++] = toupper(c);
+        word[n] = '\0';
+      }
+    }
+
+    while (contest_result(&r))
+      contest_row(&r);
+
+    // score line, only when it changed
+    contest_totals(&cs);
+    if ((cs.score != shown[0]) || (cs.sent != shown[1]) ||
+        (cs.correct != shown[2]) || (cs.speed != shown[3])) {
+      shown[0] = cs.score;
+      shown[1] = cs.sent;
+      shown[2] = cs.correct;
+      shown[3] = cs.speed;
+      mvwprintw(top_w, 2, 1, "Score %7d  %4d cpm  correct %4ld/%-4ld  missed %4ld ",
+                cs.score, cs.speed, cs.correct, cs.sent, cs.missed);
+      wnoutrefresh(top_w);
+    }
+    mvwprintw(bot_w, 1, 1, "%-12s", contest_done() ? "ENTER = end" : "");
+    mvwprintw(bot_w, 1, 14, "%-15s", word);
+    wmove(bot_w, 1, 14 + n);
+    wnoutrefresh(bot_w);
+    wait = show_waterfall();
+    update_screen();
+
+    if (!done && (poll(fds, 1, sooner(50, wait)) < 0) && (errno != EINTR))
+      break;
+  }
+  nodelay(bot_w, FALSE);
+
+  if (running)
+    contest_stop();
+  contest_finish();
+  while (contest_result(&r))
+    contest_row(&r);
+
+  contest_totals(&cs);
+  mvwprintw(bot_w, 1, 1, "%ld of %ld calls, %d points. Press any key    ",
+            cs.correct, cs.sent, cs.score);
+  wnoutrefresh(bot_w);
+  update_screen();
+  getch();
+}
+
+
+// show a scored call of the contest mode
+static void contest_row(struct contestresult *r) {
+  char row[80];
+
+  snprintf(row, sizeof(row), "%-9s %-14s %-22.22s %5d    ",
+           r->call, r->input[0] ? r->input : "___", r->output, r->points);
+  add_row(row);
+}
+
+
+// add a row to the list in mid_w, it scrolls up when it is full
+static void add_row(const char *row) {
+  int i;
+
+  if (ncontestrows == CONTESTROWS) {
+    memmove(contestrows, contestrows[1],
+            sizeof(contestrows[0]) * (CONTESTROWS - 1));
+    ncontestrows--;
+  }
+  snprintf(contestrows[ncontestrows++], 59, "%-57.57s", row);
+  for (i = 0; i < ncontestrows; i++)
+    mvwaddstr(mid_w, i + 1, 1, contestrows[i]);
+  mid_rows |= 0xfffe;
+  wnoutrefresh(mid_w);
+}
+
+
+// country mode: callsigns of the callbase are sent one by one and the
+// student names the country by a prefix of it. Any prefix of the same
+// entity counts, DA as well as DL, of up to COUNTRYPRE characters
+#define COUNTRYCALLS 50
+#define COUNTRYPRE   4
+
+static void country_attempt() {
+  static int drill[MAXCALLS];
+  const struct dxcc *d, *a;
+  char input[CALLLEN] = "", row[59];
+  int i, j, n = 0, ncalls, ok, correct = 0;
+
+  for (i = 0; i < nrofcalls - 1; i++)
+    if (dxcc_call(calls[i]))
+      drill[n++] = i;
+  if (!n) {
+    endwin();
+    fprintf(stderr, dxcc_entities() ? "No callsigns of a known country in %s\n" :
+            "No country file, see cty= in qrqrc\n", cbname());
+    exit(EXIT_FAILURE);
+  }
+  ncalls = (n < COUNTRYCALLS) ? n : COUNTRYCALLS;
+
+  wait_sending();
+  speed = initialspeed;
+  if (fixedtone)
+    freq = ctonefreq;
+
+  clear_display();
+  memset(contestrows, 0, sizeof(contestrows));
+  ncontestrows = 0;
+  wattron(top_w, A_BOLD);
+  mvwprintw(top_w, 1, 1, "Country: %d calls of %-.30s", ncalls, cbname());
+  wattroff(top_w, A_BOLD);
+  mvwaddstr(right_w, 1, 2, "Type the prefix   ");
+  mvwaddstr(right_w, 2, 2, "of the country of ");
+  mvwaddstr(right_w, 3, 2, "the call, e.g. DL.");
+  mvwaddstr(right_w, 4, 2, "F6 repeats, F4    ");
+  mvwaddstr(right_w, 5, 2, "quits.            ");
+  wnoutrefresh(right_w);
+
+  for (callnr = 1; callnr <= ncalls; callnr++) {
+    i = drill[rand() % n];
+    send_text(calls[i]);
+    mvwprintw(top_w, 2, 1, "Countries %4d/%-4d  %3d%%  ", correct, callnr - 1,
+              (callnr > 1) ? 100 * correct / (callnr - 1) : 0);
+    wnoutrefresh(top_w);
+    mvwprintw(bot_w, 1, 1, "                                      ");
+    mvwprintw(bot_w, 1, 1, "%d/%d", callnr, ncalls);
+    wnoutrefresh(bot_w);
+    input[0] = '\0';
+
+    while ((j = readline(bot_w, 1, 10, input, 0)) > 1) {
+      if (j == 4)                       // F4 -> quit
+        return;
+      if (j == 6)                       // F6 -> repeat the call
+        send_text(calls[i]);
+    }
+
+    // the country is the one of the call, the answer only has to be in it
+    d = dxcc_call(calls[i]);
+    a = (strlen(input) <= COUNTRYPRE) ? dxcc_find(input) : NULL;
+    ok = a && (a->name == d->name);
+    correct += ok;
+    snprintf(row, sizeof(row), "%-10.10s %-5.5s %-24.24s %2d %s %s",
+             calls[i], input[0] ? input : "___", d->name, d->cq, d->cont,
+             ok ? "ok" : d->prefix);
+    add_row(row);
+  }
+
+  wait_sending();
+  mvwprintw(top_w, 2, 1, "Countries %4d/%-4d  %3d%%  ", correct, ncalls,
+            100 * correct / ncalls);
+  wnoutrefresh(top_w);
+  mvwprintw(bot_w, 1, 1, "%d of %d countries. Press any key          ",
+            correct, ncalls);
+  wnoutrefresh(bot_w);
+  update_screen();
+  getch();
+}
+
+
+// compile the country file, a path or a file in CALLDIR
+static void load_countries() {
+  char file[PATH_MAX];
+  long long t = get_ns();
+  int n;
+
+  if (!ctyfile[0])
+    return;
+  if (ctyfile[0] == '/')
+    n = snprintf(file, sizeof(file), "%s", ctyfile);
+  else
+    n = snprintf(file, sizeof(file), "%s%s%s", homedir, CALLDIR, ctyfile);
+  if (n >= (int)sizeof(file)) {           // don't load a cut-off path
+    printw("  country file path too long\n");
+    return;
+  }
+  if ((n = dxcc_load(file)) < 0)
+    printw("  Couldn't read the country file %s\n", file);
+  else
+    printw("  %d countries from %s, %.2f ms\n", n, ctyfile,
+           (get_ns() - t) / 1e6);
+}
+
+
+// keyer mode: the keyboard is a paddle or straight key, the sidetone
+// is generated live. Shows what was sent and the time from a key
+// press to its tone.
+static void keyer_attempt() {
+  static const char *modename[] = { "straight", "iambic A", "iambic B" };
+  struct cwparams cp;
+  struct keyerstats ks;
+  struct pollfd fds[1];
+  char sent[MAXKEYTEXT];
+  int c, i, done = 0, row = 1, col = 1, wait;
+  int m = keyermode, spd = initialspeed;
+  long long t;
+
+  wait_sending();
+  cw_params(&cp);
+  cp.freq = ctonefreq;
+  cp.speed = spd;
+  if (keyer_start(&cp)) {
+    endwin();
+    fprintf(stderr, "Couldn't open the audio stream for the keyer\n");
+    exit(EXIT_FAILURE);
+  }
+
+  clear_display();
+  mvwaddstr(right_w, 1, 2, "z . dit paddle    ");
+  mvwaddstr(right_w, 2, 2, "x / dah paddle    ");
+  mvwaddstr(right_w, 3, 2, keyerdevice[0] ? "or left/right Ctrl" :
+                                            "(every key is one ");
+  mvwaddstr(right_w, 4, 2, keyerdevice[0] ? "                  " :
+                                            " element)         ");
+  mvwaddstr(right_w, 6, 2, "F2 keyer mode     ");
+  mvwaddstr(right_w, 7, 2, "up/down speed     ");
+  mvwaddstr(right_w, 8, 2, "F4 quits          ");
+  wnoutrefresh(right_w);
+
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  nodelay(bot_w, TRUE);
+  curs_set(FALSE);
+
+  while (!done) {
+    t = get_ns();
+    while ((c = wgetch(bot_w)) != ERR) {
+      switch (c) {
+      case 'z':
+      case '.':
+        keyer_tap(PADDLE_DIT, t);
+        break;
+      case 'x':
+      case '/':
+        keyer_tap(PADDLE_DAH, t);
+        break;
+      case KEY_F(2):
+        m = (m + 1) % 3;
+        break;
+      case KEY_UP:
+        spd += 10;
+        break;
+      case KEY_DOWN:
+        if (spd > 20)
+          spd -= 10;
+        break;
+      case KEY_F(4):
+        done = 1;
+        break;
+      }
+      keyer_set(m, spd);
+    }
+
+    // what was sent, row by row
+    for (i = 0; i < keyer_text(sent, sizeof(sent)); i++) {
+      if (col > 58) {
+        col = 1;
+        row = (row % 15) + 1;
+        mvwprintw(mid_w, row, 1, "%58s", "");
+      }
+      mvwaddch(mid_w, row, col++, sent[i]);
+      mid_rows |= 1 << row;
+    }
+    wnoutrefresh(mid_w);
+
+    keyer_stats(&ks);
+    wattron(top_w, A_BOLD);
+    mvwprintw(top_w, 1, 1, "Keyer: %-8s  %4d CpM  %4d Hz          ",
+              modename[m], spd, cp.freq);
+    wattroff(top_w, A_BOLD);
+    mvwprintw(top_w, 2, 1, "%-40s", keyerdevice[0] ? keyerdevice :
+              "keys from the terminal");
+    wnoutrefresh(top_w);
+    mvwprintw(bot_w, 1, 1, "Key to tone: mean %5.1f  p95 %5.1f  max %5.1f ms  ",
+              ks.mean / 1000.0, ks.p95 / 1000.0, ks.max / 1000.0);
+    wnoutrefresh(bot_w);
+    wait = show_waterfall();
+    update_screen();
+
+    if (!done && (poll(fds, 1, sooner(50, wait)) < 0) && (errno != EINTR))
+      break;
+  }
+  nodelay(bot_w, FALSE);
+  keyer_stop();
+  keyermode = m;
+}
+
+
+// step through a recorded attempt: every call with its speed, tone,
+// answer and points, the keys of the selected one with their times
+// after the end of the call. ENTER sends it again as it was recorded
+static void replay_attempt(char *file) {
+  struct rechead h;
+  struct recevent *ev;
+  int item[MAXCALLS], nitems = 0, top = 0, sel = 0, done = 0;
+  int n, i, k, c, row, col, end;
+  long long t0, tend;
+  char key[16], when[32];
+  time_t start;
+
+  if ((n = rec_load(file, &h, &ev)) < 0) {
+    endwin();
+    fprintf(stderr, "Couldn't read the recorded attempt %s\n", file);
+    exit(EXIT_FAILURE);
+  }
+  // a call and its repeats are one item
+  for (i = 0; (i < n) && (nitems < MAXCALLS); i++)
+    if ((ev[i].type == REC_CALL) && ev[i].u.call.text[0] &&
+        (!nitems || strcmp(ev[item[nitems - 1]].u.call.text,
+                           ev[i].u.call.text)))
+      item[nitems++] = i;
+  wait_sending();
+
+  clear_display();
+  start = h.start;
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&start));
+  wattron(top_w, A_BOLD);
+  mvwprintw(top_w, 1, 1, "Replay: %-10s %-.30s", h.mycall, h.callbase);
+  wattroff(top_w, A_BOLD);
+  mvwprintw(top_w, 2, 1, "%s, %d calls", when, nitems);
+  wnoutrefresh(top_w);
+  mvwaddstr(right_w, 1, 2, "UP/DOWN selects a ");
+  mvwaddstr(right_w, 2, 2, "call, ENTER sends ");
+  mvwaddstr(right_w, 3, 2, "it again, F4      ");
+  mvwaddstr(right_w, 4, 2, "quits.            ");
+  wnoutrefresh(right_w);
+  curs_set(FALSE);
+
+  while (!done) {
+    if (sel < top)
+      top = sel;
+    if (sel >= top + 10)
+      top = sel - 9;
+
+    // the list
+    for (row = 0; row < 10; row++) {
+      if (top + row >= nitems) {
+        mvwprintw(mid_w, row + 1, 1, "%58s", "");
+        continue;
+      }
+      i = item[top + row];
+      end = (top + row + 1 < nitems) ? item[top + row + 1] : n;
+      for (k = i; (k < end) && (ev[k].type != REC_SCORE); k++)
+        ;
+      if (k < end)
+        sprintf(key, "%5d", ev[k].u.score.points);
+      else
+        strcpy(key, "    -");
+      if (top + row == sel)
+        wattron(mid_w, A_REVERSE);
+      mvwprintw(mid_w, row + 1, 1, "%6.1f %-15s %4dcpm %4dHz %-14s %s",
+                ev[i].t / 1e6, ev[i].u.call.text, ev[i].u.call.speed,
+                ev[i].u.call.freq, (k < end) ? ev[k].u.score.input : "", key);
+      wattroff(mid_w, A_REVERSE);
+    }
+
+    // the keys of the selected call, from the end of its last play
+    for (row = 12; row < 16; row++)
+      mvwprintw(mid_w, row, 1, "%58s", "");
+    if (nitems) {
+      i = item[sel];
+      end = (sel + 1 < nitems) ? item[sel + 1] : n;
+      t0 = ev[i].t;
+      for (k = i; k < end; k++) {
+        if ((ev[k].type == REC_CALL) && (ev[k].u.call.text[0]))
+          t0 = ev[k].t;
+        else if ((ev[k].type == REC_AUDIO) && (ev[k].u.audio != EV_START))
+          t0 = ev[k].t;
+        if (ev[k].type == REC_SCORE)
+          break;
+      }
+      tend = t0;
+      row = 12;
+      col = 1;
+      for (k = i; (k < end) && (row < 15); k++) {
+        if (ev[k].type != REC_KEY)
+          continue;
+        rec_keyname(ev[k].u.key, key);
+        if (col + strlen(key) + 8 > 58) {
+          row++;
+          col = 1;
+          if (row == 15)
+            break;
+        }
+        mvwprintw(mid_w, row, col, "%s %+.2f", key, (ev[k].t - t0) / 1e6);
+        col += strlen(key) + 8;
+        tend = ev[k].t;
+      }
+      mvwprintw(mid_w, 15, 1, "Last key %.2f s after the end of the call",
+                (tend - t0) / 1e6);
+    }
+    mid_rows = 0xffff;
+    wnoutrefresh(mid_w);
+    mvwprintw(bot_w, 1, 1, "%-40s", nitems ? "" : "No calls recorded");
+    wnoutrefresh(bot_w);
+    update_screen();
+
+    switch (c = getch()) {
+    case KEY_UP:
+      if (sel > 0)
+        sel--;
+      break;
+    case KEY_DOWN:
+      if (sel + 1 < nitems)
+        sel++;
+      break;
+    case '\n':
+      if (nitems) {
+        rec_params(&ev[item[sel]].u.call);
+        send_text(ev[item[sel]].u.call.text);
+      }
+      break;
+    case KEY_F(4):
+      done = 1;
+      break;
+    }
+  }
+  wait_sending();
+  free(ev);
+}
+
+
+// show a copied word under the word that was sent, mistakes in lower
+// case. Missed words get a row of underscores.
+static void text_copy(struct textresult *r, char *typed, int res) {
+  char ref[MAXWORD + 1], typ[MAXWORD + 1];
+  int i, k, w, redraw = 0;
+
+  for (k = 0; k <= r->nskipped; k++) {
+    if (k < r->nskipped) {
+      strcpy(ref, r->skipped[k]);
+      memset(typ, '_', strlen(ref));
+      typ[strlen(ref)] = '\0';
+    } else {
+      strcpy(ref, (res == TEXT_EXTRA) ? "" : r->ref);
+      for (i = 0; typed[i]; i++)
+        typ[i] = (typed[i] == ref[i]) ? typed[i] : tolower(typed[i]);
+      typ[i] = '\0';
+    }
+    w = (strlen(ref) > strlen(typ) ? strlen(ref) : strlen(typ)) + 1;
+    if (copycol + w > 57) {             // next row, scroll when full
+      copycol = 0;
+      if (++copyrow == COPYROWS) {
+        memmove(copyref, copyref[1], sizeof(copyref[0]) * (COPYROWS - 1));
+        memmove(copytyp, copytyp[1], sizeof(copytyp[0]) * (COPYROWS - 1));
+        copyrow = COPYROWS - 1;
+        redraw = 1;
+      }
+      memset(copyref[copyrow], ' ', 58);
+      memset(copytyp[copyrow], ' ', 58);
+      copyref[copyrow][58] = copytyp[copyrow][58] = '\0';
+    }
+    if (!copycol && !copyref[copyrow][0]) {
+      memset(copyref[copyrow], ' ', 58);
+      memset(copytyp[copyrow], ' ', 58);
+    }
+    memcpy(copyref[copyrow] + copycol, ref, strlen(ref));
+    memcpy(copytyp[copyrow] + copycol, typ, strlen(typ));
+    copycol += w;
+    if (!redraw) {
+      mvwaddstr(mid_w, 3 * copyrow + 1, 1, copyref[copyrow]);
+      mvwaddstr(mid_w, 3 * copyrow + 2, 1, copytyp[copyrow]);
+    }
+  }
+  if (redraw)
+    for (i = 0; i < COPYROWS; i++) {
+      mvwaddstr(mid_w, 3 * i + 1, 1, copyref[i]);
+      mvwaddstr(mid_w, 3 * i + 2, 1, copytyp[i]);
+    }
+  mid_rows |= 0x7fff;
+  wnoutrefresh(mid_w);
+}
+
+
+// startup threads: connect to the sound server and fill its buffer
+// with some silence, so the first call starts without the handshake
+static void *open_audio_thread(void *arg) {
+  static short silence[MAXRATE / 20];
+  long long t = get_ns();
+  void *dsp = open_dsp();
+
+  prof.audio = get_ns() - t;
+  t = get_ns();
+  if (dsp) {
+    stream_audio(dsp, silence, samplerate / 20);       // 50 ms
+    prof.latency = audio_latency(dsp);
+  }
+  prof.prewarm = get_ns() - t;
+  return NULL;
+}
+
+
+// the number of calls goes to *arg, -1 if the file can't be read; it
+// is checked by main, calling endwin here would race
+static void *callbase_thread(void *arg) {
+  long long t = get_ns();
+  int *n = arg;
+
+  if (corpus_size())
+    *n = corpus_calls(calls, MAXCALLS, &scp);
+  else
+    *n = load_callbase(cbfilename, calls, MAXCALLS, &scp);
+  prof.callbase = get_ns() - t;
+  return NULL;
+}
+
+
+static void *toplist_thread(void *arg) {
+  long long t = get_ns();
+
+  load_toplist();
+  prof.toplist = get_ns() - t;
+  return NULL;
+}
+
+
+// process start on the get_ns() clock, from /proc/self/stat
+// (the start of main if that is not available)
+static long long process_start() {
+  struct timespec boot;
+  unsigned long long ticks;
+  long long now = get_ns(), age;
+  char tmp[1024], *p;
+  FILE *fh;
+  int i;
+
+  if ((fh = fopen("/proc/self/stat", "r")) == NULL)
+    return now;
+  p = fgets(tmp, sizeof(tmp), fh);
+  fclose(fh);
+  if (!p || !(p = strrchr(tmp, ')')))
+    return now;
+  for (i = 0; p && (i < 20); i++)       // starttime is field 22
+    p = strchr(p + 1, ' ');
+  if (!p || (sscanf(p, "%llu", &ticks) != 1))
+    return now;
+  clock_gettime(CLOCK_BOOTTIME, &boot);
+  age = boot.tv_sec * 1000000000LL + boot.tv_nsec -
+        ticks * (1000000000LL / sysconf(_SC_CLK_TCK));
+  return (age > 0) ? now - age : now;
+}
+
+
+static void startup_report() {
+  printf("\nStartup profile (ms)\n");
+  printf("  exec to main         %8.1f\n", (prof.main - prof.start) / 1e6);
+  printf("  find files           %8.1f\n", (prof.files - prof.main) / 1e6);
+  printf("  read config          %8.1f\n", (prof.config - prof.files) / 1e6);
+  printf("  in parallel:\n");
+  printf("    audio connect      %8.1f\n", prof.audio / 1e6);
+  printf("    sink pre-warm      %8.1f\n", prof.prewarm / 1e6);
+  printf("    callbase load      %8.1f\n", prof.callbase / 1e6);
+  printf("    toplist index      %8.1f\n", prof.toplist / 1e6);
+  printf("  parallel phase       %8.1f\n", (prof.parallel - prof.config) / 1e6);
+  printf("  ready for input      %8.1f after process start\n",
+         (prof.ready - prof.start) / 1e6);
+  if (prof.firsttone)
+    printf("  first tone audible   %8.1f after process start, %.1f without "
+           "%.1f waiting for keys\n         (%.1f leading silence, %.1f "
+           "sound server latency)\n",
+           (prof.firsttone - prof.start) / 1e6,
+           (prof.firsttone - prof.start - prof.keywait) / 1e6,
+           prof.keywait / 1e6, 250.0, prof.latency / 1e3);
+  else
+    printf("  first tone audible   (no call was sent)\n");
+}
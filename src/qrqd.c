@@ -0,0 +1,791 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqd - training server for many students at once
+//
+// Every callbase in the callsign directory is loaded once and shared by
+// all sessions. Each connection is a session with its own settings,
+// score and call sequence. Calls are rendered by a pool of worker
+// threads and sent to the client as 16 bit mono PCM. Rendered calls
+// are kept in the PCM cache, a call another session has heard with the
+// same settings is sent at once.
+//
+// The protocol is line based, every command gets one answer:
+//   HELLO                 OK qrqd <protocol> <samplerate>
+//   LIST                  CB <nr> <name> <calls> for every callbase, then OK
+//   SET <key> <value>     OK or ERR <reason>, keys are callbase (nr or
+//                         name), speed, mincharspeed, freq, waveform,
+//                         edge, fixspeed and scoremode (0 exact,
+//                         1 partial, 2 one-off)
+//   START                 OK, new attempt: score 0, all calls unused
+//   NEXT                  PCM <callnr> <bytes>, followed by the audio,
+//                         or END <score> when all calls were sent
+//   REPEAT                PCM of the current call again
+//   ANSWER <text>         SCORE <ok> <points> <score> <speed> "<call>" "<errors>"
+//   STATS                 OK <sessions> <renders> <queued> <cache hits>
+//                         <cache misses> <cached calls>
+//   QUIT                  BYE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "morse.h"
+#include "callbase.h"
+#include "score.h"
+#include "pcmcache.h"
+#include "metrics.h"
+
+#define PROTOCOL  1
+#define MAXCB     100              // callbases
+#define MAXLINE   256              // command line length
+#define MAXWORKER 64
+#define OUTCAP    (4 << 20)        // unsent bytes that stop reading commands
+#define OUTMAX    (64 << 20)       // unsent bytes that close the session
+
+// a shared, read-only callbase
+struct cbase {
+  char name[64];
+  int n;                           // number of calls
+  int scp;                         // single character practice
+  char (*calls)[CALLLEN];
+};
+
+// one connection
+struct session {
+  int fd;                          // -1 = free slot
+  unsigned int gen;                // incremented when the slot is reused
+  char in[MAXLINE];                // partial command line
+  int inlen;
+  char *out;                       // answers not yet sent
+  size_t outlen, outpos, outsize;
+  struct cwparams cp;              // own settings
+  struct scorestate st;
+  int cb;                          // callbase
+  unsigned char *used;             // calls sent in this attempt
+  int left;                        // calls left in this attempt
+  int callnr;
+  int cur;                         // current call, -1 = none
+  int busy;                        // render job outstanding
+  const short *pcm;                // current call, rendered
+  int pcmlen;                      // samples
+  void *ref;                       // pcm is in the cache
+};
+
+// a call to be rendered by the worker pool
+struct job {
+  int slot;
+  unsigned int gen;
+  struct cwparams cp;
+  char text[16];
+  const short *pcm;
+  int len;
+  void *ref;
+  struct job *next;
+};
+
+static struct cbase cbases[MAXCB];
+static int ncb = 0;
+static struct session *sessions;
+static int maxsessions = 256;
+static atomic_int nsessions = 0;
+
+static struct job *todo = NULL, *todotail = NULL;  // oldest first
+static struct job *done = NULL;
+static pthread_mutex_t jobmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobcond = PTHREAD_COND_INITIALIZER;
+static int wake[2];                // workers -> main loop
+static atomic_long renders = 0;
+static atomic_int queued = 0;
+
+static char *sockpath = NULL;
+static volatile sig_atomic_t quit = 0;
+
+static void usage();
+static void load_callbases(char *dir);
+static int  open_listener(char *path, int port);
+static void *worker(void *arg);
+static void new_session(int lfd);
+static void close_session(int slot);
+static void read_session(int slot);
+static void write_session(int slot);
+static void command(int slot, char *line);
+static void reply(struct session *s, const char *fmt, ...);
+static void put(struct session *s, const void *data, size_t len);
+static void send_pcm(struct session *s);
+static void set_pcm(struct session *s, const short *pcm, int len, void *ref);
+static void free_pcm(const short *pcm, void *ref);
+static void start_attempt(struct session *s);
+static void next(int slot);
+static void answer(struct session *s, char *text);
+static int  set(struct session *s, char *key, char *value);
+static void finish_jobs();
+static void on_signal(int sig);
+static void server_metrics(FILE *f);
+static long long now_ns();
+
+
+int main(int argc, char *argv[]) {
+  char dir[PATH_MAX] = "";
+  char *metricsat = NULL, *metricsdump = NULL;
+  int c, i, n, lfd, port = 0, nworker = 0;
+  long cachemb = 64;
+  struct pollfd *fds;
+  int *slot;
+  pthread_t tid;
+
+  if (getenv("HOME"))
+    snprintf(dir, sizeof(dir), "%s/qrq/callsigns", getenv("HOME"));
+
+  while ((c = getopt(argc, argv, "d:u:p:w:m:r:c:M:D:h")) != -1) {
+    switch (c) {
+    case 'd': strncpy(dir, optarg, PATH_MAX - 1); break;
+    case 'u': sockpath = optarg; break;
+    case 'p': port = atoi(optarg); break;
+    case 'w': nworker = atoi(optarg); break;
+    case 'm': maxsessions = atoi(optarg); break;
+    case 'r': samplerate = atol(optarg); break;
+    case 'c': cachemb = atol(optarg); break;
+    case 'M': metricsat = optarg; break;
+    case 'D': metricsdump = optarg; break;
+    default: usage();
+    }
+  }
+  if ((samplerate < 8000) || (samplerate > MAXRATE) || (maxsessions < 1) ||
+      (nworker < 0) || (nworker > MAXWORKER) || (cachemb < 0))
+    usage();
+  if (!sockpath && !port)
+    sockpath = "/tmp/qrqd.sock";
+  if (!nworker)
+    nworker = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nworker < 1)
+    nworker = 1;
+
+  load_callbases(dir);
+  pcmcache_init(cachemb << 20);
+  lfd = open_listener(sockpath, port);
+  if ((metricsat || metricsdump) &&
+      metrics_start(metricsat, metricsdump, server_metrics)) {
+    perror("Error: Unable to serve the metrics");
+    exit(EXIT_FAILURE);
+  }
+
+  sessions = calloc(maxsessions, sizeof(struct session));
+  fds = calloc(maxsessions + 2, sizeof(struct pollfd));
+  slot = calloc(maxsessions + 2, sizeof(int));
+  if (!sessions || !fds || !slot || pipe(wake)) {
+    perror("qrqd");
+    exit(EXIT_FAILURE);
+  }
+  fcntl(wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake[1], F_SETFL, O_NONBLOCK);
+  for (i = 0; i < maxsessions; i++)
+    sessions[i].fd = -1;
+
+  for (i = 0; i < nworker; i++) {
+    if (pthread_create(&tid, NULL, worker, NULL)) {
+      perror("Error: Unable to create worker");
+      exit(EXIT_FAILURE);
+    }
+    pthread_detach(tid);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  if (sockpath)
+    fprintf(stderr, "qrqd: %d callbases, %d workers, listening on %s\n",
+            ncb, nworker, sockpath);
+  else
+    fprintf(stderr, "qrqd: %d callbases, %d workers, listening on "
+            "127.0.0.1:%d\n", ncb, nworker, port);
+
+  while (!quit) {
+    fds[0].fd = lfd;
+    fds[0].events = (nsessions < maxsessions) ? POLLIN : 0;
+    fds[1].fd = wake[0];
+    fds[1].events = POLLIN;
+    for (n = 2, i = 0; i < maxsessions; i++) {
+      if (sessions[i].fd < 0)
+        continue;
+      fds[n].fd = sessions[i].fd;
+      // a client that does not read its answers is not served more
+      fds[n].events = (sessions[i].outlen - sessions[i].outpos < OUTCAP) ?
+                      POLLIN : 0;
+      if (sessions[i].outpos < sessions[i].outlen)
+        fds[n].events |= POLLOUT;
+      slot[n++] = i;
+    }
+
+    if (poll(fds, n, -1) < 0)
+      continue;                     // EINTR
+
+    if (fds[1].revents & POLLIN)
+      finish_jobs();
+    for (i = 2; i < n; i++) {
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+        read_session(slot[i]);
+      if ((sessions[slot[i]].fd >= 0) && (fds[i].revents & POLLOUT))
+        write_session(slot[i]);
+    }
+    if (fds[0].revents & POLLIN)
+      new_session(lfd);
+  }
+
+  if (sockpath)
+    unlink(sockpath);
+  return 0;
+}
+
+
+static void usage() {
+  fprintf(stderr,
+          "usage: qrqd [-d callsign dir] [-u socket | -p port] [-w workers]\n"
+          "            [-m max sessions] [-r samplerate] [-c cache MB]\n"
+          "            [-M metrics socket | port] [-D metrics file]\n"
+          "  default socket is /tmp/qrqd.sock, TCP only listens on 127.0.0.1\n");
+  exit(EXIT_FAILURE);
+}
+
+
+static void on_signal(int sig) {
+  quit = 1;
+}
+
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+// the state of the server, for the metrics
+static void server_metrics(FILE *f) {
+  struct pcmstats cs;
+
+  pcmcache_stats(&cs);
+  fprintf(f, "# TYPE qrqd_sessions gauge\nqrqd_sessions %d\n"
+          "# TYPE qrqd_renders_queued gauge\nqrqd_renders_queued %d\n"
+          "# TYPE qrq_cache_hits_total counter\nqrq_cache_hits_total %ld\n"
+          "# TYPE qrq_cache_misses_total counter\nqrq_cache_misses_total %ld\n"
+          "# TYPE qrq_cache_bytes gauge\nqrq_cache_bytes %ld\n",
+          (int)nsessions, (int)queued, cs.hits, cs.misses, cs.bytes);
+}
+
+
+static int cmp_name(const struct dirent **a, const struct dirent **b) {
+  return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+// load every .txt file in dir once, in name order
+static void load_callbases(char *dir) {
+  static char tmp[MAXCALLS][CALLLEN];
+  struct dirent **de;
+  char path[PATH_MAX];
+  struct cbase *cb;
+  int i, n, nr;
+
+  if ((n = scandir(dir, &de, NULL, cmp_name)) < 0) {
+    fprintf(stderr, "Couldn't open callsign directory %s\n", dir);
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < n; i++) {
+    if ((ncb < MAXCB) && strstr(de[i]->d_name, ".txt")) {
+      snprintf(path, sizeof(path), "%s/%s", dir, de[i]->d_name);
+      cb = &cbases[ncb];
+      if ((nr = load_callbase(path, tmp, MAXCALLS, &cb->scp)) > 0) {
+        strncpy(cb->name, de[i]->d_name, sizeof(cb->name) - 1);
+        cb->calls = malloc(nr * sizeof(tmp[0]));
+        if (!cb->calls) {
+          perror("qrqd");
+          exit(EXIT_FAILURE);
+        }
+        memcpy(cb->calls, tmp, nr * sizeof(tmp[0]));
+        cb->n = nr;
+        ncb++;
+      }
+    }
+    free(de[i]);
+  }
+  free(de);
+  if (!ncb) {
+    fprintf(stderr, "No callbase files found in %s\n", dir);
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+static int open_listener(char *path, int port) {
+  struct sockaddr_un un;
+  struct sockaddr_in in;
+  int fd, on = 1;
+
+  if (path) {
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, path, sizeof(un.sun_path) - 1);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || bind(fd, (struct sockaddr *)&un, sizeof(un)))
+      fd = -1;
+  } else {
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons(port);
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if ((fd < 0) || bind(fd, (struct sockaddr *)&in, sizeof(in)))
+      fd = -1;
+  }
+  if ((fd < 0) || listen(fd, 128)) {
+    perror("Error: Unable to listen");
+    exit(EXIT_FAILURE);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+
+// render thread, one buffer of 20 seconds per thread
+static void *worker(void *arg) {
+  struct cwbuf out;
+  struct job *j;
+  short *pcm;
+  long long t;
+  int i;
+
+  out.size = FULLBUF;
+  if ((out.buf = malloc(FULLBUF * sizeof(int))) == NULL) {
+    perror("qrqd");
+    exit(EXIT_FAILURE);
+  }
+
+  while (1) {
+    pthread_mutex_lock(&jobmutex);
+    while (!todo)
+      pthread_cond_wait(&jobcond, &jobmutex);
+    j = todo;
+    if ((todo = j->next) == NULL)
+      todotail = NULL;
+    pthread_mutex_unlock(&jobmutex);
+
+    out.len = 0;
+    t = now_ns();
+    render_text(&j->cp, j->text, &out);
+    metric_time(MH_RENDER, now_ns() - t);
+    j->len = out.len;
+    j->pcm = pcmcache_put(&j->cp, j->text, out.buf, out.len, &j->ref);
+    if (!j->pcm && (pcm = malloc(out.len * sizeof(short))) != NULL) {
+      for (i = 0; i < out.len; i++)
+        pcm[i] = (short)out.buf[i];
+      j->pcm = pcm;
+    }
+    renders++;
+
+    pthread_mutex_lock(&jobmutex);
+    j->next = done;
+    done = j;
+    pthread_mutex_unlock(&jobmutex);
+    if (write(wake[1], "", 1) < 0 && errno != EAGAIN)
+      perror("qrqd");
+  }
+  return NULL;
+}
+
+
+// hand finished renders to their sessions
+static void finish_jobs() {
+  struct session *s;
+  struct job *j, *list;
+  char tmp[64];
+
+  while (read(wake[0], tmp, sizeof(tmp)) > 0)
+    ;
+  pthread_mutex_lock(&jobmutex);
+  list = done;
+  done = NULL;
+  pthread_mutex_unlock(&jobmutex);
+
+  while ((j = list) != NULL) {
+    list = j->next;
+    queued--;
+    s = &sessions[j->slot];
+    if ((s->fd >= 0) && (s->gen == j->gen)) {
+      set_pcm(s, j->pcm, j->len, j->ref);
+      s->busy = 0;
+      send_pcm(s);
+    } else {
+      free_pcm(j->pcm, j->ref);     // session is gone or restarted
+    }
+    free(j);
+  }
+}
+
+
+static void new_session(int lfd) {
+  struct session *s;
+  int fd, i;
+
+  if ((fd = accept(lfd, NULL, NULL)) < 0)
+    return;
+  for (i = 0; i < maxsessions && sessions[i].fd >= 0; i++)
+    ;
+  if ((i == maxsessions) ||
+      ((sessions[i].used == NULL) &&
+       ((sessions[i].used = malloc(MAXCALLS)) == NULL))) {
+    if (write(fd, "ERR full\n", 9) < 0)
+      ;
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  s = &sessions[i];
+  s->fd = fd;
+  s->inlen = 0;
+  s->outlen = s->outpos = 0;
+  s->cp.samplerate = samplerate;
+  s->cp.speed = 200;
+  s->cp.mincharspeed = 0;
+  s->cp.freq = MYFREQ;
+  s->cp.waveform = SINE;
+  s->cp.edge = 2.0;
+  s->cp.chirp = s->cp.drift = s->cp.clicks = 0;
+  s->st.fixspeed = 0;
+  s->st.mode = SCORE_EXACT;
+  s->cb = 0;
+  start_attempt(s);                 // new generation, nothing rendered
+  nsessions++;
+}
+
+
+static void close_session(int slot) {
+  struct session *s = &sessions[slot];
+
+  close(s->fd);
+  s->fd = -1;
+  s->gen++;                         // drops renders still in the pool
+  set_pcm(s, NULL, 0, NULL);
+  free(s->out);
+  s->out = NULL;
+  s->outsize = 0;
+  nsessions--;
+}
+
+
+static void read_session(int slot) {
+  struct session *s = &sessions[slot];
+  char buf[1024];
+  int n, i;
+
+  if ((n = read(s->fd, buf, sizeof(buf))) <= 0) {
+    if ((n == 0) || (errno != EAGAIN && errno != EINTR))
+      close_session(slot);
+    return;
+  }
+  for (i = 0; i < n && s->fd >= 0; i++) {
+    if (buf[i] == '\n') {
+      s->in[s->inlen] = '\0';
+      if (s->inlen && s->in[s->inlen - 1] == '\r')
+        s->in[s->inlen - 1] = '\0';
+      s->inlen = 0;
+      command(slot, s->in);
+    } else if (s->inlen < MAXLINE - 1) {
+      s->in[s->inlen++] = buf[i];
+    }
+  }
+  if (s->fd >= 0 && s->outpos < s->outlen)
+    write_session(slot);
+}
+
+
+static void write_session(int slot) {
+  struct session *s = &sessions[slot];
+  ssize_t n;
+
+  n = write(s->fd, s->out + s->outpos, s->outlen - s->outpos);
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EINTR)
+      close_session(slot);
+    return;
+  }
+  s->outpos += n;
+  if (s->outpos == s->outlen)
+    s->outpos = s->outlen = 0;
+}
+
+
+// queue data for the client. A session that has more than OUTMAX
+// bytes waiting, or no memory for them, is closed
+static void put(struct session *s, const void *data, size_t len) {
+  char *p;
+
+  if (s->fd < 0)
+    return;
+  if (s->outlen + len > s->outsize) {
+    if ((s->outlen + len > OUTMAX) ||
+        ((p = realloc(s->out, s->outlen + len + 4096)) == NULL)) {
+      fprintf(stderr, "qrqd: closing a session with %zu bytes not read\n",
+              s->outlen - s->outpos);
+      close_session(s - sessions);
+      return;
+    }
+    s->out = p;
+    s->outsize = s->outlen + len + 4096;
+  }
+  memcpy(s->out + s->outlen, data, len);
+  s->outlen += len;
+}
+
+
+static void reply(struct session *s, const char *fmt, ...) {
+  char tmp[MAXLINE];
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(tmp, sizeof(tmp) - 1, fmt, ap);
+  va_end(ap);
+  if (n > sizeof(tmp) - 2)
+    n = sizeof(tmp) - 2;
+  tmp[n++] = '\n';
+  put(s, tmp, n);
+}
+
+
+// replace the rendered call of a session
+static void set_pcm(struct session *s, const short *pcm, int len, void *ref) {
+  free_pcm(s->pcm, s->ref);
+  s->pcm = pcm;
+  s->pcmlen = pcm ? len : 0;
+  s->ref = ref;
+}
+
+
+static void free_pcm(const short *pcm, void *ref) {
+  if (ref)
+    pcmcache_release(ref);
+  else
+    free((void *)pcm);
+}
+
+
+static void send_pcm(struct session *s) {
+  metric_count(MC_CALLS, 1);
+  reply(s, "PCM %d %d", s->callnr, s->pcmlen * (int)sizeof(short));
+  put(s, s->pcm, s->pcmlen * sizeof(short));
+}
+
+
+static void command(int slot, char *line) {
+  struct session *s = &sessions[slot];
+  struct pcmstats cs;
+  char *cmd, *arg, *save;
+  int i;
+
+  if ((cmd = strtok_r(line, " ", &save)) == NULL)
+    return;
+  arg = strtok_r(NULL, "", &save);
+
+  if (!strcmp(cmd, "HELLO")) {
+    reply(s, "OK qrqd %d %ld", PROTOCOL, samplerate);
+  } else if (!strcmp(cmd, "LIST")) {
+    for (i = 0; i < ncb; i++)
+      reply(s, "CB %d %s %d", i, cbases[i].name, cbases[i].n);
+    reply(s, "OK");
+  } else if (!strcmp(cmd, "SET")) {
+    if (arg && (cmd = strtok_r(arg, " ", &save)) &&
+        (arg = strtok_r(NULL, " ", &save)) && !set(s, cmd, arg))
+      reply(s, "OK");
+    else
+      reply(s, "ERR invalid setting");
+  } else if (!strcmp(cmd, "START")) {
+    start_attempt(s);
+    reply(s, "OK");
+  } else if (!strcmp(cmd, "NEXT")) {
+    next(slot);
+  } else if (!strcmp(cmd, "REPEAT")) {
+    if (s->busy)
+      reply(s, "ERR busy");
+    else if (s->cur < 0 || !s->pcm)
+      reply(s, "ERR no call");
+    else
+      send_pcm(s);
+  } else if (!strcmp(cmd, "ANSWER")) {
+    answer(s, arg ? arg : "");
+  } else if (!strcmp(cmd, "STATS")) {
+    pcmcache_stats(&cs);
+    reply(s, "OK %d %ld %d %ld %ld %ld", (int)nsessions, (long)renders,
+          (int)queued, cs.hits, cs.misses, cs.entries);
+  } else if (!strcmp(cmd, "QUIT")) {
+    reply(s, "BYE");
+    write_session(slot);
+    if (s->fd >= 0)                 // not closed by a failed write
+      close_session(slot);
+  } else {
+    reply(s, "ERR unknown command");
+  }
+}
+
+
+// a render still in the pool is dropped, its call was never sent
+static void start_attempt(struct session *s) {
+  s->gen++;
+  s->busy = 0;
+  set_pcm(s, NULL, 0, NULL);
+  memset(s->used, 0, MAXCALLS);
+  s->left = cbases[s->cb].n;
+  s->callnr = 0;
+  s->cur = -1;
+  s->st.score = s->st.maxspeed = s->st.errornr = 0;
+  s->st.speed = s->cp.speed;
+}
+
+
+// select an unused call of the session and queue it for rendering
+static void next(int slot) {
+  struct session *s = &sessions[slot];
+  struct cbase *cb = &cbases[s->cb];
+  struct cwparams cp;
+  const short *pcm;
+  struct job *j;
+  void *ref;
+  int i, len;
+
+  if (s->busy) {
+    reply(s, "ERR busy");
+    return;
+  }
+  if (!s->left) {
+    reply(s, "END %d", s->st.score);
+    return;
+  }
+  do i = rand() % cb->n;
+  while (s->used[i]);
+  s->used[i] = 1;
+  s->left--;
+  s->cur = i;
+  s->callnr++;
+
+  // rendered for this or another session before
+  cp = s->cp;
+  cp.speed = s->st.speed;
+  if ((pcm = pcmcache_get(&cp, cb->calls[i], &len, &ref)) != NULL) {
+    set_pcm(s, pcm, len, ref);
+    send_pcm(s);
+    return;
+  }
+
+  if ((j = malloc(sizeof(struct job))) == NULL) {
+    perror("qrqd");
+    exit(EXIT_FAILURE);
+  }
+  j->slot = slot;
+  j->gen = s->gen;
+  j->cp = cp;
+  strcpy(j->text, cb->calls[i]);
+  s->busy = 1;
+  queued++;
+
+  pthread_mutex_lock(&jobmutex);
+  j->next = NULL;
+  if (todotail)
+    todotail->next = j;
+  else
+    todo = j;
+  todotail = j;
+  pthread_cond_signal(&jobcond);
+  pthread_mutex_unlock(&jobmutex);
+}
+
+
+static void answer(struct session *s, char *text) {
+  char *call, output[80] = "", input[16] = "";
+  int points, i;
+
+  if (s->cur < 0) {
+    reply(s, "ERR no call");
+    return;
+  }
+  for (i = 0; text[i] && i < sizeof(input) - 1; i++)
+    input[i] = toupper(text[i]);
+  call = cbases[s->cb].calls[s->cur];
+  points = score_call(&s->st, call, input, s->st.speed, output);
+  s->st.score += points;
+  s->cur = -1;
+  metric_count(MC_ANSWERS, 1);
+  if (!strcmp(output, "*"))
+    metric_count(MC_CORRECT, 1);
+  reply(s, "SCORE %d %d %d %d \"%s\" \"%s\"", !strcmp(output, "*"),
+        points, s->st.score, s->st.speed, call, output);
+}
+
+
+static int set(struct session *s, char *key, char *value) {
+  int i = atoi(value);
+  double d = atof(value);
+
+  if (!strcmp(key, "callbase")) {
+    for (i = 0; i < ncb; i++)
+      if (!strcmp(cbases[i].name, value))
+        break;
+    if ((i == ncb) && isdigit(value[0]))
+      i = atoi(value);
+    if ((i < 0) || (i >= ncb))
+      return -1;
+    s->cb = i;
+    start_attempt(s);
+  } else if (!strcmp(key, "speed") && (i >= 10)) {
+    s->cp.speed = s->st.speed = i;
+  } else if (!strcmp(key, "mincharspeed") && (i >= 0)) {
+    s->cp.mincharspeed = i;
+  } else if (!strcmp(key, "freq") && (i >= MINFREQ) && (i <= MAXFREQ)) {
+    s->cp.freq = i;
+  } else if (!strcmp(key, "waveform") && (i >= SINE) && (i <= SQUARE)) {
+    s->cp.waveform = i;
+  } else if (!strcmp(key, "edge") && (d >= 0.0) && (d <= 10.0)) {
+    s->cp.edge = d;
+  } else if (!strcmp(key, "fixspeed")) {
+    s->st.fixspeed = (i != 0);
+  } else if (!strcmp(key, "scoremode") && (i >= SCORE_EXACT) &&
+             (i <= SCORE_ONEOFF)) {
+    s->st.mode = i;
+  } else {
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,245 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqdecode - decode CW from a WAV file or a live capture
+//
+//   qrqdecode file.wav      decode a 16 bit PCM WAV file
+//   qrqdecode -c            decode from the PulseAudio capture stream
+//   qrqdecode -t            self check: decode qrq's own rendering at
+//                           every speed and waveform
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "morse.h"
+#include "decoder.h"
+#include "pulseaudio.h"
+
+#define CHUNK 4096
+
+static const char *checktext[] = {
+  "ABCDEFGHI", "JKLMNOPQR", "STUVWXYZ", "0123456789", "/=.!,;#+-?",
+  "CQ DE DJ1YFK"
+};
+
+static int verbose = 0;
+
+static double get_sec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void usage() {
+  fprintf(stderr, "usage: qrqdecode [-v] file.wav\n"
+                  "       qrqdecode [-v] -c [-r samplerate]\n"
+                  "       qrqdecode [-v] -t [-r samplerate]\n");
+  exit(EXIT_FAILURE);
+}
+
+
+static unsigned int le16(const unsigned char *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static unsigned long le32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+
+// decode a WAV file, only 16 bit PCM, the channels are mixed
+static int decode_wav(char *file) {
+  struct decoder d;
+  unsigned char hdr[16];
+  short in[CHUNK], pcm[CHUNK];
+  char text[CHUNK];
+  unsigned long len, total = 0;
+  int i, j, n, channels = 0, bits = 0;
+  long rate = 0;
+  double t;
+  FILE *fh;
+
+  if ((fh = fopen(file, "rb")) == NULL) {
+    perror(file);
+    return -1;
+  }
+  if ((fread(hdr, 1, 12, fh) != 12) || memcmp(hdr, "RIFF", 4) ||
+      memcmp(hdr + 8, "WAVE", 4))
+    goto bad;
+
+  // walk the chunks up to "data"
+  while (1) {
+    if (fread(hdr, 1, 8, fh) != 8)
+      goto bad;
+    len = le32(hdr + 4);
+    if (!memcmp(hdr, "fmt ", 4)) {
+      if ((len < 16) || (fread(hdr, 1, 16, fh) != 16))
+        goto bad;
+      if (le16(hdr) != 1)
+        goto bad;                       // not PCM
+      channels = le16(hdr + 2);
+      rate = le32(hdr + 4);
+      bits = le16(hdr + 14);
+      len -= 16;
+    } else if (!memcmp(hdr, "data", 4)) {
+      break;
+    }
+    if (fseek(fh, len + (len & 1), SEEK_CUR))
+      goto bad;
+  }
+  if ((bits != 16) || (channels < 1) || (channels > 8) ||
+      (rate < 8000) || (rate > MAXRATE))
+    goto bad;
+
+  decoder_init(&d, rate);
+  t = get_sec();
+  while ((n = fread(in, 2 * channels, CHUNK / channels, fh)) > 0) {
+    for (i = 0; i < n; i++) {
+      long sum = 0;
+      for (j = 0; j < channels; j++)
+        sum += in[i * channels + j];
+      pcm[i] = sum / channels;
+    }
+    total += n;
+    if (decoder_feed(&d, pcm, n, text, sizeof(text)))
+      fputs(text, stdout);
+  }
+  if (decoder_flush(&d, text, sizeof(text)))
+    fputs(text, stdout);
+  putchar('\n');
+  t = get_sec() - t;
+  fclose(fh);
+
+  if (verbose)
+    fprintf(stderr, "%.2f s of audio at %ld Hz in %.3f s (%.0fx real time), "
+            "%d cpm, %d Hz\n", (double)total / rate, rate, t,
+            total / (rate * (t > 0 ? t : 1e-9)), decoder_speed(&d),
+            decoder_freq(&d));
+  return 0;
+
+bad:
+  fprintf(stderr, "%s: not a 16 bit PCM WAV file\n", file);
+  fclose(fh);
+  return -1;
+}
+
+
+// decode the capture stream until interrupted
+static int decode_capture(long rate) {
+  struct decoder d;
+  short pcm[CHUNK];
+  char text[CHUNK];
+  int n = rate / 50;                    // 20 ms
+  void *s;
+
+  if ((s = open_capture(rate)) == NULL)
+    return -1;
+  decoder_init(&d, rate);
+  while (read_capture(s, pcm, n) == 0) {
+    if (decoder_feed(&d, pcm, n, text, sizeof(text))) {
+      fputs(text, stdout);
+      fflush(stdout);
+    }
+    if (verbose && (d.hops % (rate / d.hop) < n / d.hop))
+      fprintf(stderr, "[%d cpm %d Hz]\n", decoder_speed(&d), decoder_freq(&d));
+  }
+  fprintf(stderr, "Error: reading the capture stream failed\n");
+  return -1;
+}
+
+
+// render every check text at every speed and waveform and decode it
+static int selfcheck(long rate) {
+  static int ibuf[FULLBUF];
+  static short pcm[FULLBUF];
+  struct cwparams cp = { rate, 0, 0, MYFREQ, SINE, 2.0 };
+  struct cwbuf out = { ibuf, 0, FULLBUF };
+  struct decoder d;
+  char text[256], *p;
+  int i, n, wf, spd, runs = 0, fails = 0;
+  double t, audio = 0, busy = 0;
+
+  for (wf = SINE; wf <= SQUARE; wf++) {
+    for (spd = 50; spd <= 1000; spd += 10) {
+      for (i = 0; i < sizeof(checktext) / sizeof(checktext[0]); i++) {
+        cp.waveform = wf;
+        cp.speed = spd;
+        cp.freq = MINFREQ + (spd * 7) % (MAXFREQ - MINFREQ + 1);
+        out.len = 0;
+        render_text(&cp, checktext[i], &out);
+        if (out.len >= out.size)
+          continue;                     // longer than 20 s, cut off
+        for (n = 0; n < out.len; n++)
+          pcm[n] = (short)ibuf[n];
+
+        t = get_sec();
+        decoder_init(&d, rate);
+        n = decoder_feed(&d, pcm, out.len, text, sizeof(text));
+        decoder_flush(&d, text + n, sizeof(text) - n);
+        busy += get_sec() - t;
+        audio += (double)out.len / rate;
+
+        for (p = text + strlen(text); (p > text) && (p[-1] <= ' '); )
+          *--p = '\0';
+        runs++;
+        if (strcmp(text, checktext[i])) {
+          fails++;
+          printf("FAIL waveform %d, %d cpm, %d Hz: \"%s\" -> \"%s\"\n",
+                 wf, spd, cp.freq, checktext[i], text);
+        } else if (verbose) {
+          printf("ok   waveform %d, %d cpm, %d Hz: \"%s\", estimated "
+                 "%d cpm\n", wf, spd, cp.freq, text, decoder_speed(&d));
+        }
+      }
+    }
+  }
+  printf("%d of %d decoded correctly, %.1f s of audio at %ld Hz "
+         "in %.3f s (%.0fx real time)\n", runs - fails, runs, audio, rate,
+         busy, audio / busy);
+  return fails ? -1 : 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  int c, capture = 0, check = 0;
+  long rate = 48000;
+
+  while ((c = getopt(argc, argv, "ctr:vh")) != -1) {
+    switch (c) {
+    case 'c': capture = 1; break;
+    case 't': check = 1; break;
+    case 'r': rate = atol(optarg); break;
+    case 'v': verbose = 1; break;
+    default: usage();
+    }
+  }
+  if ((rate < 8000) || (rate > MAXRATE))
+    usage();
+
+  if (check)
+    return selfcheck(rate) ? EXIT_FAILURE : 0;
+  if (capture)
+    return decode_capture(rate) ? EXIT_FAILURE : 0;
+  if (optind != argc - 1)
+    usage();
+  return decode_wav(argv[optind]) ? EXIT_FAILURE : 0;
+}
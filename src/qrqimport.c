@@ -0,0 +1,411 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqimport - make a callbase from a large callsign list, e.g. the CSV
+// export of a national licence database
+//
+// The files are read line by line, so their size doesn't matter. In
+// every row the callsign column is found (-c, or the column most of the
+// first rows have a callsign in), the callsign is upper cased and
+// checked: 3 to 9 letters, digits and /, with a letter and a digit.
+//
+// Every distinct callsign is packed into 64 bits, base 38, so equal
+// calls are equal numbers. The whole list (-n 0) is deduplicated with
+// an open addressing set of these, 16 bytes per call at most. A sample
+// (-n N, the default is a full callbase of MAXCALLS) keeps the N calls
+// with the smallest hash of all distinct calls: a uniform sample that
+// needs memory for 2 N calls only, whatever the size of the input, and
+// duplicates are never drawn twice. -s picks another sample.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "callbase.h"
+
+#define MAXCOL    64             // columns of a row that are looked at
+#define PROBE     64             // rows to find the callsign column in
+#define MAXPRE    64             // prefixes of -p
+#define CALLMAX   9              // longest call of a callbase
+
+struct set {
+  uint64_t *key;                 // 0 = empty
+  size_t size, n;                // size is a power of 2
+};
+
+struct cand {
+  uint64_t hash, key;
+};
+
+struct sample {
+  struct cand *c;                // candidates, 2 * max
+  size_t n, max;
+  uint64_t limit;                // only hashes below are candidates
+};
+
+static int column = 0;           // 1.., 0 = find it
+static char *prefix[MAXPRE];
+static int nprefix = 0;
+static uint64_t seed = 0;
+static long rows = 0, valid = 0;
+
+static const char *usage =
+  "usage: qrqimport [-c column] [-p prefix,...] [-n calls] [-s seed]\n"
+  "                 [-o callbase] file.csv ...\n";
+
+
+static double get_sec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// splitmix64, a bijection: distinct calls have distinct hashes
+static uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+
+// a normalised call as a number, 0 if it isn't a call
+static uint64_t pack(const char *call) {
+  uint64_t k = 0;
+  int i, digit = 0, letter = 0, c;
+
+  for (i = 0; call[i]; i++) {
+    c = call[i];
+    if (isdigit(c)) {
+      k = k * 38 + 1 + (c - '0');
+      digit = 1;
+    } else if (isupper(c)) {
+      k = k * 38 + 11 + (c - 'A');
+      letter = 1;
+    } else {
+      k = k * 38 + 37;                    // '/'
+    }
+  }
+  return (i >= 3) && digit && letter ? k : 0;
+}
+
+
+static void unpack(uint64_t k, char *call) {
+  static const char sym[] = "?0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ/";
+  char tmp[CALLMAX + 1];
+  int n = 0;
+
+  while (k) {
+    tmp[n++] = sym[k % 38];
+    k /= 38;
+  }
+  while (n)
+    *call++ = tmp[--n];
+  *call = '\0';
+}
+
+
+// upper case the field in place, without quotes and blanks around it.
+// returns it, or NULL if it isn't a callsign
+static char *normalise(char *f) {
+  char *e;
+
+  while (isspace((unsigned char)*f) || (*f == '"'))
+    f++;
+  for (e = f; *e; e++)
+    *e = toupper((unsigned char)*e);
+  while ((e > f) && (isspace((unsigned char)e[-1]) || (e[-1] == '"')))
+    *--e = '\0';
+  if ((e - f < 3) || (e - f > CALLMAX) || (*f == '/') || (e[-1] == '/'))
+    return NULL;
+  for (e = f; *e; e++)
+    if (!isdigit((unsigned char)*e) && !isupper((unsigned char)*e) && (*e != '/'))
+      return NULL;
+  return pack(f) ? f : NULL;
+}
+
+
+// split a row at commas, semicolons or tabs outside of quotes, in
+// place. returns the number of fields
+static int split(char *line, char **field) {
+  int n = 0, quoted = 0;
+  char *p;
+
+  field[n++] = line;
+  for (p = line; *p && (*p != '\n') && (*p != '\r'); p++) {
+    if (*p == '"')
+      quoted = !quoted;
+    else if (!quoted && ((*p == ',') || (*p == ';') || (*p == '\t'))) {
+      *p = '\0';
+      if (n == MAXCOL)
+        return n;
+      field[n++] = p + 1;
+    }
+  }
+  *p = '\0';
+  return n;
+}
+
+
+// the callsign of a row, NULL if it has none or doesn't match -p
+static char *row_call(char *line) {
+  char *field[MAXCOL], *call;
+  int n, i;
+
+  rows++;
+  n = split(line, field);
+  if ((column > n) || !(call = normalise(field[column - 1])))
+    return NULL;
+  if (nprefix) {
+    for (i = 0; i < nprefix; i++)
+      if (!strncmp(call, prefix[i], strlen(prefix[i])))
+        break;
+    if (i == nprefix)
+      return NULL;
+  }
+  valid++;
+  return call;
+}
+
+
+// the column most of the first rows have a callsign in
+static int find_column(char **line, int n) {
+  char *field[MAXCOL], tmp[4096];
+  int count[MAXCOL] = { 0 };
+  int i, k, m, best = 0;
+
+  for (i = 0; i < n; i++) {
+    strncpy(tmp, line[i], sizeof(tmp) - 1);
+    tmp[sizeof(tmp) - 1] = '\0';
+    m = split(tmp, field);
+    for (k = 0; k < m; k++)
+      count[k] += (normalise(field[k]) != NULL);
+  }
+  for (k = 1; k < MAXCOL; k++)
+    if (count[k] > count[best])
+      best = k;
+  return count[best] ? best + 1 : 0;
+}
+
+
+// add k, returns 1 if it is new
+static int set_add(struct set *s, uint64_t k) {
+  uint64_t *old = s->key;
+  size_t i, size = s->size;
+
+  if (2 * (s->n + 1) > s->size) {
+    s->size = size ? 2 * size : 1 << 16;
+    if ((s->key = calloc(s->size, sizeof(uint64_t))) == NULL) {
+      perror("qrqimport");
+      exit(EXIT_FAILURE);
+    }
+    s->n = 0;
+    for (i = 0; i < size; i++)
+      if (old[i])
+        set_add(s, old[i]);
+    free(old);
+  }
+  for (i = mix(k) & (s->size - 1); s->key[i]; i = (i + 1) & (s->size - 1))
+    if (s->key[i] == k)
+      return 0;
+  s->key[i] = k;
+  s->n++;
+  return 1;
+}
+
+
+static int cmp_cand(const void *a, const void *b) {
+  uint64_t x = ((const struct cand *)a)->hash, y = ((const struct cand *)b)->hash;
+  return (x > y) - (x < y);
+}
+
+
+// keep the max smallest distinct candidates, the rest is dropped
+static void sample_trim(struct sample *s) {
+  size_t i, n = 0;
+
+  qsort(s->c, s->n, sizeof(struct cand), cmp_cand);
+  for (i = 0; i < s->n; i++)
+    if (!n || (s->c[i].hash != s->c[n - 1].hash))
+      s->c[n++] = s->c[i];
+  if (n >= s->max) {
+    n = s->max;
+    s->limit = s->c[n - 1].hash;
+  }
+  s->n = n;
+}
+
+
+static void sample_add(struct sample *s, uint64_t k) {
+  uint64_t h = mix(k ^ seed);
+
+  if (h >= s->limit)
+    return;
+  s->c[s->n].hash = h;
+  s->c[s->n++].key = k;
+  if (s->n == 2 * s->max)
+    sample_trim(s);
+}
+
+
+static int cmp_call(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+
+// one row: the whole list is written as it comes, a sample at the end
+static void add_row(char *line, struct set *all, struct sample *smp, FILE *out) {
+  char *call;
+  uint64_t k;
+
+  if ((call = row_call(line)) == NULL)
+    return;
+  k = pack(call);
+  if (smp->max)
+    sample_add(smp, k);
+  else if (set_add(all, k))
+    fprintf(out, "%s\n", call);
+}
+
+
+// stream one file, "-" is stdin. returns 0 or -1
+static int import(const char *file, struct set *all, struct sample *smp,
+                  FILE *out) {
+  char *probe[PROBE], *line = NULL;
+  size_t size = 0;
+  int n = 0, i, auto_column = !column;
+  FILE *fh;
+
+  if (!strcmp(file, "-"))
+    fh = stdin;
+  else if ((fh = fopen(file, "r")) == NULL)
+    return -1;
+  setvbuf(fh, NULL, _IOFBF, 1 << 20);
+
+  // the first rows tell which column has the callsigns
+  if (auto_column) {
+    while ((n < PROBE) && (getline(&line, &size, fh) > 0))
+      probe[n++] = strdup(line);
+    if (!(column = find_column(probe, n))) {
+      fprintf(stderr, "%s: no callsign column, try -c\n", file);
+      column = 1;
+    }
+    for (i = 0; i < n; i++) {
+      add_row(probe[i], all, smp, out);
+      free(probe[i]);
+    }
+  }
+  while (getline(&line, &size, fh) > 0)
+    add_row(line, all, smp, out);
+  free(line);
+  if (auto_column)
+    column = 0;
+  if (fh != stdin)
+    fclose(fh);
+  return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  struct set all = { NULL, 0, 0 };
+  struct sample smp = { NULL, 0, MAXCALLS, UINT64_MAX };
+  char *outfile = NULL, *p, (*calls)[CALLMAX + 1];
+  FILE *out = stdout;
+  long written, distinct;
+  double t0 = get_sec();
+  size_t i;
+  int c;
+
+  while ((c = getopt(argc, argv, "c:p:n:s:o:h")) != -1) {
+    switch (c) {
+    case 'c': column = atoi(optarg); break;
+    case 'n': smp.max = atol(optarg); break;
+    case 's': seed = mix(strtoull(optarg, NULL, 0)); break;
+    case 'o': outfile = optarg; break;
+    case 'p':
+      for (p = strtok(optarg, ","); p && (nprefix < MAXPRE); p = strtok(NULL, ","))
+        for (prefix[nprefix++] = p; *p; p++)
+          *p = toupper((unsigned char)*p);
+      break;
+    default:
+      fprintf(stderr, "%s", usage);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if ((optind == argc) || (column < 0)) {
+    fprintf(stderr, "%s", usage);
+    exit(EXIT_FAILURE);
+  }
+  if (outfile && ((out = fopen(outfile, "w")) == NULL)) {
+    perror(outfile);
+    exit(EXIT_FAILURE);
+  }
+  if (smp.max && ((smp.c = malloc(2 * smp.max * sizeof(struct cand))) == NULL)) {
+    perror("qrqimport");
+    exit(EXIT_FAILURE);
+  }
+
+  for (; optind < argc; optind++)
+    if (import(argv[optind], &all, &smp, out)) {
+      perror(argv[optind]);
+      exit(EXIT_FAILURE);
+    }
+
+  // the sample in alphabetical order
+  if (smp.max) {
+    sample_trim(&smp);
+    if ((calls = malloc(smp.n * sizeof(*calls) + 1)) == NULL) {
+      perror("qrqimport");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < smp.n; i++)
+      unpack(smp.c[i].key, calls[i]);
+    qsort(calls, smp.n, sizeof(*calls), cmp_call);
+    for (i = 0; i < smp.n; i++)
+      fprintf(out, "%s\n", calls[i]);
+    free(calls);
+  }
+  if (fflush(out) || ((out != stdout) && fclose(out))) {
+    perror(outfile ? outfile : "stdout");
+    exit(EXIT_FAILURE);
+  }
+
+  // with a full sample the number of distinct calls is estimated
+  // from the hash of its last call
+  written = smp.max ? smp.n : all.n;
+  if (smp.max && (smp.n == smp.max) && (smp.limit < UINT64_MAX))
+    distinct = (smp.max - 1) / (smp.limit / 18446744073709551616.0);
+  else
+    distinct = written;
+  t0 = get_sec() - t0;
+  fprintf(stderr, "%ld rows, %ld callsigns, %s%ld distinct, %ld written "
+          "in %.2f s (%.1f M rows/s)\n", rows, valid,
+          (distinct != written) ? "about " : "", distinct, written, t0,
+          rows / (t0 > 0 ? t0 : 1e-9) / 1e6);
+  if (written > MAXCALLS)
+    fprintf(stderr, "qrq reads the first %d calls of a callbase, "
+            "-n %d draws a sample\n", MAXCALLS, MAXCALLS);
+  if (outfile)
+    fprintf(stderr, "use it with callbase=%s in qrqrc\n", outfile);
+  return 0;
+}
@@ -0,0 +1,226 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqload - load generator for qrqd
+//
+// Opens many sessions at once, each asks for calls and answers them
+// wrongly, so the speed stays put. Reports throughput and the latency
+// from NEXT to the end of the received audio.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static char *sockpath = "/tmp/qrqd.sock";
+static int port = 0;
+static int ncalls = 20;
+static int speed = 200;
+static long *lat;                  // per call latency in us
+static int nlat = 0;
+static long pcmbytes = 0;
+static int failed = 0;
+static pthread_mutex_t statmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long get_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+
+static int connect_qrqd() {
+  struct sockaddr_un un;
+  struct sockaddr_in in;
+  int fd;
+
+  if (port) {
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons(port);
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if ((fd >= 0) && connect(fd, (struct sockaddr *)&in, sizeof(in)))
+      fd = -1;
+  } else {
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, sockpath, sizeof(un.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd >= 0) && connect(fd, (struct sockaddr *)&un, sizeof(un)))
+      fd = -1;
+  }
+  return fd;
+}
+
+
+// read one answer line, returns its length or -1
+static int getline_fd(int fd, char *line, int size) {
+  int n = 0;
+  char c;
+
+  while (read(fd, &c, 1) == 1) {
+    if (c == '\n') {
+      line[n] = '\0';
+      return n;
+    }
+    if (n < size - 1)
+      line[n++] = c;
+  }
+  return -1;
+}
+
+
+static int command(int fd, const char *cmd, char *line, int size) {
+  if (write(fd, cmd, strlen(cmd)) != strlen(cmd))
+    return -1;
+  return getline_fd(fd, line, size);
+}
+
+
+// skip n bytes of audio
+static int drain(int fd, long n) {
+  char buf[65536];
+  ssize_t r;
+
+  while (n > 0) {
+    r = read(fd, buf, n < sizeof(buf) ? n : sizeof(buf));
+    if (r <= 0)
+      return -1;
+    n -= r;
+  }
+  return 0;
+}
+
+
+static void *session(void *arg) {
+  char line[256];
+  long t, bytes = 0;
+  int fd, i, nr, len, n = 0;
+  long mylat[ncalls];
+
+  if ((fd = connect_qrqd()) < 0)
+    goto fail;
+  snprintf(line, sizeof(line), "SET speed %d\n", speed);
+  if ((command(fd, line, line, sizeof(line)) < 0) || strcmp(line, "OK"))
+    goto fail;
+  if ((command(fd, "START\n", line, sizeof(line)) < 0) || strcmp(line, "OK"))
+    goto fail;
+
+  for (i = 0; i < ncalls; i++) {
+    t = get_us();
+    if (command(fd, "NEXT\n", line, sizeof(line)) < 0)
+      goto fail;
+    if (!strncmp(line, "END", 3))
+      break;
+    if ((sscanf(line, "PCM %d %d", &nr, &len) != 2) || drain(fd, len))
+      goto fail;
+    mylat[n++] = get_us() - t;
+    bytes += len;
+    if ((command(fd, "ANSWER X\n", line, sizeof(line)) < 0) ||
+        strncmp(line, "SCORE", 5))
+      goto fail;
+  }
+  command(fd, "QUIT\n", line, sizeof(line));
+  close(fd);
+
+  pthread_mutex_lock(&statmutex);
+  memcpy(lat + nlat, mylat, n * sizeof(long));
+  nlat += n;
+  pcmbytes += bytes;
+  pthread_mutex_unlock(&statmutex);
+  return NULL;
+
+fail:
+  if (fd >= 0)
+    close(fd);
+  pthread_mutex_lock(&statmutex);
+  failed++;
+  pthread_mutex_unlock(&statmutex);
+  return NULL;
+}
+
+
+static int cmp_long(const void *a, const void *b) {
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+
+int main(int argc, char *argv[]) {
+  pthread_t *tid;
+  int c, i, nsessions = 100;
+  long t;
+  double sum = 0;
+
+  while ((c = getopt(argc, argv, "u:p:n:c:s:h")) != -1) {
+    switch (c) {
+    case 'u': sockpath = optarg; break;
+    case 'p': port = atoi(optarg); break;
+    case 'n': nsessions = atoi(optarg); break;
+    case 'c': ncalls = atoi(optarg); break;
+    case 's': speed = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: qrqload [-u socket | -p port] [-n sessions] "
+              "[-c calls] [-s speed]\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if ((nsessions < 1) || (ncalls < 1)) {
+    fprintf(stderr, "qrqload: need at least one session and call\n");
+    exit(EXIT_FAILURE);
+  }
+
+  tid = malloc(nsessions * sizeof(pthread_t));
+  lat = malloc((long)nsessions * ncalls * sizeof(long));
+  if (!tid || !lat) {
+    perror("qrqload");
+    exit(EXIT_FAILURE);
+  }
+
+  t = get_us();
+  for (i = 0; i < nsessions; i++)
+    if (pthread_create(&tid[i], NULL, session, NULL)) {
+      perror("Error: Unable to create session thread");
+      exit(EXIT_FAILURE);
+    }
+  for (i = 0; i < nsessions; i++)
+    pthread_join(tid[i], NULL);
+  t = get_us() - t;
+
+  qsort(lat, nlat, sizeof(long), cmp_long);
+  for (i = 0; i < nlat; i++)
+    sum += lat[i];
+
+  printf("{\"sessions\": %d, \"failed\": %d, \"calls\": %d, "
+         "\"seconds\": %.3f, \"calls_per_s\": %.1f, \"pcm_mb\": %.1f",
+         nsessions, failed, nlat, t / 1e6, nlat / (t / 1e6),
+         pcmbytes / 1e6);
+  if (nlat)
+    printf(", \"latency_us\": {\"mean\": %.0f, \"p50\": %ld, \"p95\": %ld, "
+           "\"max\": %ld}", sum / nlat, lat[nlat / 2],
+           lat[(nlat * 95) / 100], lat[nlat - 1]);
+  printf("}\n");
+  return failed ? EXIT_FAILURE : 0;
+}
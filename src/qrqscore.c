@@ -0,0 +1,245 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqscore - score a history log again, e.g. after the rules changed
+//
+// Every line of the log is one answer:
+//   time <TAB> own call <TAB> speed <TAB> call sent <TAB> answer
+// The log is memory mapped and split between threads at line ends.
+// Each answer is scored with all scoring modes at once, the totals are
+// printed per own call.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "score.h"
+#include "utf8.h"
+
+#define NMODE   3
+#define NCALL   1024             // own calls per log, more go to "(other)"
+#define MAXTHR  256
+
+struct total {
+  char call[16];
+  long answers, correct;
+  long long points[NMODE];
+};
+
+struct part {
+  const char *start, *end;
+  struct total calls[NCALL];
+  long answers, bad;
+  pthread_t tid;
+};
+
+static const char *modename[NMODE] = { "exact", "partial", "oneoff" };
+
+static int cmp_total(const void *a, const void *b) {
+  const struct total *x = a, *y = b;
+  if (x->points[0] != y->points[0])
+    return (x->points[0] < y->points[0]) ? 1 : -1;
+  return strcmp(x->call, y->call);
+}
+
+
+// totals of call in tab, linear probing, the last slot is "(other)"
+static struct total *lookup(struct total *tab, const char *call, int len) {
+  unsigned int h = 2166136261u;
+  int i, k;
+
+  if (len > 15)
+    len = 15;
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char)call[i]) * 16777619u;
+  for (k = 0; k < NCALL - 1; k++) {
+    i = (h + k) % (NCALL - 1);
+    if (!tab[i].call[0]) {
+      memcpy(tab[i].call, call, len);
+      tab[i].call[len] = '\0';
+      return &tab[i];
+    }
+    if (!strncmp(tab[i].call, call, len) && !tab[i].call[len])
+      return &tab[i];
+  }
+  strcpy(tab[NCALL - 1].call, "(other)");
+  return &tab[NCALL - 1];
+}
+
+
+// copy a field up to the next tab or line end, returns the next field
+static const char *field(const char *p, const char *end, char *out, int size) {
+  int n = 0;
+
+  while ((p < end) && (*p != '\t') && (*p != '\n')) {
+    if (n < size - 1)
+      out[n++] = *p;
+    p++;
+  }
+  out[n] = '\0';
+  return (p < end && *p == '\t') ? p + 1 : p;
+}
+
+
+static void *rescore(void *arg) {
+  struct part *pt = arg;
+  const char *p = pt->start, *line, *call;
+  char tmp[16], realcall[MAXALIGN + 1], input[MAXALIGN + 1];
+  struct total *t;
+  int k, spd, len, dist, calllen;
+
+  while (p < pt->end) {
+    line = p;
+    p = field(p, pt->end, tmp, sizeof(tmp));          // time
+    call = p;
+    p = field(p, pt->end, tmp, sizeof(tmp));          // own call
+    calllen = strlen(tmp);
+    p = field(p, pt->end, tmp, sizeof(tmp));
+    spd = atoi(tmp);
+    p = field(p, pt->end, realcall, sizeof(realcall));
+    p = field(p, pt->end, input, sizeof(input));
+    while ((p < pt->end) && (*p++ != '\n'))
+      ;
+    if (!realcall[0] || (spd <= 0) || (p - line < 8)) {
+      pt->bad++;
+      continue;
+    }
+
+    t = lookup(pt->calls, call, calllen);
+    len = utf8_len(realcall);
+    dist = strcmp(realcall, input) ? edit_distance(realcall, input) : 0;
+    t->answers++;
+    t->correct += !dist;
+    for (k = 0; k < NMODE; k++)
+      t->points[k] += partial_points(k, len, dist, spd);
+    pt->answers++;
+  }
+  return NULL;
+}
+
+
+static double get_sec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char *argv[]) {
+  static struct part parts[MAXTHR];
+  struct total *sum, *t;
+  struct stat st;
+  const char *map, *p;
+  long answers = 0, bad = 0;
+  int c, i, k, n, fd, nthr = 0;
+  double t0;
+
+  while ((c = getopt(argc, argv, "j:h")) != -1) {
+    switch (c) {
+    case 'j': nthr = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: qrqscore [-j threads] history\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: qrqscore [-j threads] history\n");
+    exit(EXIT_FAILURE);
+  }
+  if (nthr < 1)
+    nthr = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthr < 1)
+    nthr = 1;
+  if (nthr > MAXTHR)
+    nthr = MAXTHR;
+
+  if (((fd = open(argv[optind], O_RDONLY)) < 0) || fstat(fd, &st)) {
+    perror(argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+  if (!st.st_size) {
+    printf("no answers\n");
+    return 0;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror(argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+  t0 = get_sec();
+  // split at line ends
+  for (p = map, i = 0; i < nthr; i++) {
+    parts[i].start = p;
+    p = map + (long)st.st_size * (i + 1) / nthr;
+    while ((p < map + st.st_size) && (p > map) && (p[-1] != '\n'))
+      p++;
+    if (p < parts[i].start)
+      p = parts[i].start;
+    parts[i].end = p;
+    if (pthread_create(&parts[i].tid, NULL, rescore, &parts[i])) {
+      perror("Error: Unable to create thread");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // merge the totals of all threads
+  sum = calloc(NCALL, sizeof(struct total));
+  for (i = 0; i < nthr; i++) {
+    pthread_join(parts[i].tid, NULL);
+    answers += parts[i].answers;
+    bad += parts[i].bad;
+    for (n = 0; n < NCALL; n++) {
+      if (!parts[i].calls[n].call[0])
+        continue;
+      t = (n == NCALL - 1) ? &sum[NCALL - 1] :
+          lookup(sum, parts[i].calls[n].call, strlen(parts[i].calls[n].call));
+      strcpy(t->call, parts[i].calls[n].call);
+      t->answers += parts[i].calls[n].answers;
+      t->correct += parts[i].calls[n].correct;
+      for (k = 0; k < NMODE; k++)
+        t->points[k] += parts[i].calls[n].points[k];
+    }
+  }
+  t0 = get_sec() - t0;
+
+  qsort(sum, NCALL, sizeof(struct total), cmp_total);
+  printf("%-15s %10s %10s", "call", "answers", "correct");
+  for (k = 0; k < NMODE; k++)
+    printf(" %14s", modename[k]);
+  printf("\n");
+  for (n = 0; n < NCALL; n++) {
+    if (!sum[n].call[0])
+      continue;
+    printf("%-15s %10ld %10ld", sum[n].call, sum[n].answers, sum[n].correct);
+    for (k = 0; k < NMODE; k++)
+      printf(" %14lld", sum[n].points[k]);
+    printf("\n");
+  }
+  fprintf(stderr, "%ld answers (%ld bad lines) in %.3f s on %d threads, "
+          "%.1f M answers/s\n", answers, bad, t0, nthr,
+          answers / (t0 > 0 ? t0 : 1e-9) / 1e6);
+  return 0;
+}
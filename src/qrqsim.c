@@ -0,0 +1,390 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// qrqsim - headless driver for the attempt logic. Replays a scripted
+// keystroke timeline against a null or WAV file audio sink and reports
+// the latency between the stages of every call and the wall time of
+// every attempt.
+//
+// The script has one line per call, the lines are used in turn and
+// repeated. Tokens are separated by blanks:
+//   <number>   wait for that many ms
+//   {CALL}     type the call that is being sent
+//   {TYPO}     type the call with one wrong character
+//   {DROP}     type the call without its first character
+//   {F6}       repeat the current call
+//   {F7}       repeat the previous call
+//   {ENTER}    enter the answer, waits until the call is sent
+//   anything else is typed as it is
+// Every line ends with an implicit {ENTER}, '#' starts a comment.
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include <poll.h>
+
+#include "morse.h"
+#include "callbase.h"
+#include "score.h"
+#include "attempt.h"
+#include "pcmcache.h"
+#include "effects.h"
+#include "fileaudio.h"
+
+#define MAXLINES 100
+#define NSTAGE   6
+
+static char script[MAXLINES][256] = { "{CALL}" };
+static int nlines = 1;
+static int keyms = 0;                   // ms between two keys
+static int json = 0;
+
+static const char *stagename[NSTAGE] = {
+  "start", "render", "play", "react", "score", "total"
+};
+static long long *stages[NSTAGE];       // us, all calls of all attempts
+static long nstage = 0, maxstage = 0;
+
+static void usage();
+static void read_script(char *file);
+static void wait_ms(int ms);
+static void type_text(char *line, char *text, int scp);
+static void enter_answer();
+static void run_call(int i, char *line, int scpmode);
+static void report_call(int a, char *input, char *output);
+static void summary(long long *attempts, int *scores, int n);
+static void json_string(const char *s);
+
+
+int main(int argc, char *argv[]) {
+  int c, a, i, nattempt = 1, maxcalls = 0;
+  unsigned int seed = 1;
+  long long *attempts, t;
+  int *scores;
+  char input[80], output[80];
+  int initialspeed;
+
+  strcpy(cbfilename, "../callsigns/all_callsigns_4995.txt");
+  speed = 200;
+
+  while ((c = getopt(argc, argv, "c:n:m:s:xr:f:k:o:pjS:C:E:h")) != -1) {
+    switch (c) {
+    case 'c': strncpy(cbfilename, optarg, PATH_MAX - 1); break;
+    case 'n': nattempt = atoi(optarg); break;
+    case 'm': maxcalls = atoi(optarg); break;
+    case 's': speed = atoi(optarg); break;
+    case 'x': fixspeed = 1; break;
+    case 'r': samplerate = atol(optarg); break;
+    case 'f': read_script(optarg); break;
+    case 'k': keyms = atoi(optarg); break;
+    case 'o': sinkfile = optarg; break;
+    case 'p': sinkpace = 1; break;
+    case 'j': json = 1; break;
+    case 'S': seed = atoi(optarg); break;
+    case 'C': pcmcache_init(atol(optarg) << 20); break;
+    case 'E':
+      if (sscanf(optarg, "%d,%d,%d,%d", &effects.noise, &effects.qsb,
+                 &effects.qrm, &effects.filter) != 4)
+        usage();
+      break;
+    default: usage();
+    }
+  }
+  if ((nattempt < 1) || (speed < 10) || (samplerate < 8000) ||
+      (samplerate > MAXRATE))
+    usage();
+
+  srand(seed);
+  initialspeed = speed;
+  attempts = calloc(nattempt, sizeof(long long));
+  scores = calloc(nattempt, sizeof(int));
+  for (i = 0; i < NSTAGE; i++)
+    stages[i] = NULL;
+
+  if (json)
+    printf("{\n  \"calls\": [");
+
+  // the first thread call
+  send_text("");
+
+  for (a = 0; a < nattempt; a++) {
+    t = get_ns();
+    maxspeed = errornr = score = 0;
+    speed = initialspeed;
+    nrofcalls = read_callbase();
+
+    for (callnr = 1; callnr < nrofcalls; callnr++) {
+      if (maxcalls && (callnr > maxcalls))
+        break;
+      i = next_call();
+      input[0] = '\0';
+      run_call(i, input, scp);
+      output[0] = '\0';
+      finish_call(i, input, output);
+      report_call(a, input, output);
+    }
+
+    // attempt is over
+    callnr = 0;
+    send_text("EE");
+    wait_sending();
+    attempts[a] = get_ns() - t;
+    scores[a] = score;
+  }
+
+  summary(attempts, scores, nattempt);
+  return 0;
+}
+
+
+static void usage() {
+  fprintf(stderr,
+          "usage: qrqsim [-c callbase] [-n attempts] [-m calls per attempt]\n"
+          "              [-s speed] [-x] [-r samplerate] [-f script]\n"
+          "              [-k key ms] [-o file.wav] [-p] [-j] [-S seed]\n"
+          "              [-C cache MB] [-E noise,qsb,qrm,filter]\n"
+          "  -x  keep the speed fixed\n"
+          "  -p  play the audio in real time instead of discarding it at once\n"
+          "  -j  JSON output\n"
+          "  -C  cache rendered calls (default: off)\n"
+          "  -E  receiving conditions, see qrqrc (default: 0,0,0,0)\n");
+  exit(EXIT_FAILURE);
+}
+
+
+static void read_script(char *file) {
+  FILE *fh;
+  char tmp[256];
+  char *s;
+
+  if ((fh = fopen(file, "r")) == NULL) {
+    fprintf(stderr, "Couldn't read script %s\n", file);
+    exit(EXIT_FAILURE);
+  }
+  nlines = 0;
+  while ((nlines < MAXLINES) && (fgets(tmp, sizeof(tmp), fh) != NULL)) {
+    if ((s = strchr(tmp, '#')))
+      *s = '\0';
+    tmp[strcspn(tmp, "\r\n")] = '\0';
+    if (strspn(tmp, " \t") == strlen(tmp))  // blank line
+      continue;
+    strcpy(script[nlines++], tmp);
+  }
+  fclose(fh);
+  if (!nlines) {
+    fprintf(stderr, "Error: %s is empty\n", file);
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+static void wait_ms(int ms) {
+  struct timespec ts;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+
+// feed text to the line editor, one key at a time
+static void type_text(char *line, char *text, int scpmode) {
+  for (; *text; text++) {
+    if (keyms)
+      wait_ms(keyms);
+    if (edit_line(line, (unsigned char)*text, scpmode) == EDIT_DONE)
+      break;
+  }
+}
+
+
+// like readline(), enter is only accepted once the call is sent
+static void enter_answer() {
+  struct pollfd pfd = { event_fd(), POLLIN, 0 };
+
+  while (!sending_complete) {
+    poll(&pfd, 1, -1);
+    while (read_event() != EV_NONE)
+      ;
+  }
+}
+
+
+// replay the script line for call i
+static void run_call(int i, char *line, int scpmode) {
+  char tokens[256], text[16];
+  char *tok, *save;
+
+  editpos = 0;
+  strcpy(tokens, script[(callnr - 1) % nlines]);
+  for (tok = strtok_r(tokens, " \t", &save); tok;
+       tok = strtok_r(NULL, " \t", &save)) {
+    if (isdigit(tok[0])) {
+      wait_ms(atoi(tok));
+    } else if (!strcmp(tok, "{CALL}")) {
+      type_text(line, calls[i], scpmode);
+    } else if (!strcmp(tok, "{TYPO}")) {
+      strcpy(text, calls[i]);
+      text[strlen(text) / 2] = (text[strlen(text) / 2] == 'X') ? 'Y' : 'X';
+      type_text(line, text, scpmode);
+    } else if (!strcmp(tok, "{DROP}")) {
+      type_text(line, calls[i] + 1, scpmode);
+    } else if (!strcmp(tok, "{F6}")) {
+      send_text(calls[i]);
+    } else if (!strcmp(tok, "{F7}")) {
+      if (callnr > 1)
+        repeat_previous();
+    } else if (!strcmp(tok, "{ENTER}")) {
+      break;
+    } else {
+      type_text(line, tok, scpmode);
+    }
+  }
+  enter_answer();
+}
+
+
+// record and print the stage latencies of the last scored call
+static void report_call(int a, char *input, char *output) {
+  struct callstat *cs = &callstat;
+  long long us[NSTAGE];
+  int k;
+
+  us[0] = (cs->render - cs->select) / 1000;
+  us[1] = (cs->written - cs->render) / 1000;
+  us[2] = (cs->complete - cs->written) / 1000;
+  us[3] = (cs->answered - cs->complete) / 1000;
+  us[4] = (cs->scored - cs->answered) / 1000;
+  us[5] = (cs->scored - cs->select) / 1000;
+
+  if (nstage == maxstage) {
+    maxstage = maxstage ? 2 * maxstage : 1024;
+    for (k = 0; k < NSTAGE; k++) {
+      if ((stages[k] = realloc(stages[k], maxstage * sizeof(long long))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  for (k = 0; k < NSTAGE; k++)
+    stages[k][nstage] = us[k];
+
+  if (json) {
+    printf("%s\n    {\"attempt\": %d, \"call\": %d, \"sent\": ",
+           nstage ? "," : "", a + 1, callnr);
+    json_string(previouscall);
+    printf(", \"input\": ");
+    json_string(input);
+    printf(", \"ok\": %s", strcmp(output, "*") ? "false" : "true");
+    for (k = 0; k < NSTAGE; k++)
+      printf(", \"%s_us\": %lld", stagename[k], us[k]);
+    printf("}");
+  } else {
+    printf("%4d %4d %-10s %-10s %-3s", a + 1, callnr, previouscall, input,
+           strcmp(output, "*") ? "err" : "ok");
+    for (k = 0; k < NSTAGE; k++)
+      printf(" %s %lld", stagename[k], us[k]);
+    printf("\n");
+  }
+  nstage++;
+}
+
+
+static int cmp_ll(const void *a, const void *b) {
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+
+// a JSON string, with the characters that need it escaped
+static void json_string(const char *s) {
+  putchar('"');
+  for (; *s; s++) {
+    if ((*s == '"') || (*s == '\\'))
+      printf("\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      printf("\\u%04x", *s);
+    else
+      putchar(*s);
+  }
+  putchar('"');
+}
+
+
+// mean, median, 95th percentile and maximum of every stage
+static void summary(long long *attempts, int *scores, int n) {
+  struct pcmstats cs;
+  long long sum, total = 0;
+  long long *v;
+  long points = 0;
+  int k;
+  long i;
+
+  for (i = 0; i < n; i++) {
+    total += attempts[i];
+    points += scores[i];
+  }
+
+  if (json)
+    printf("\n  ],\n  \"attempts\": %d, \"ncalls\": %ld, \"score\": %ld, "
+           "\"wall_us\": %lld, \"attempt_us\": [", n, nstage, points,
+           total / 1000);
+  else
+    printf("\n%d attempts, %ld calls, score %ld, %lld us\n", n, nstage,
+           points, total / 1000);
+
+  for (i = 0; i < n; i++) {
+    if (json)
+      printf("%s%lld", i ? ", " : "", attempts[i] / 1000);
+    else
+      printf("attempt %ld: %lld us, score %d\n", i + 1, attempts[i] / 1000,
+             scores[i]);
+  }
+  if (json) {
+    printf("],\n  \"attempt_score\": [");
+    for (i = 0; i < n; i++)
+      printf("%s%d", i ? ", " : "", scores[i]);
+    printf("],\n  \"stages\": {");
+  }
+
+  for (k = 0; k < NSTAGE && nstage; k++) {
+    v = stages[k];
+    qsort(v, nstage, sizeof(long long), cmp_ll);
+    for (sum = 0, i = 0; i < nstage; i++)
+      sum += v[i];
+    if (json)
+      printf("%s\n    \"%s\": {\"mean_us\": %lld, \"p50_us\": %lld, "
+             "\"p95_us\": %lld, \"max_us\": %lld}", k ? "," : "",
+             stagename[k], sum / nstage, v[nstage / 2],
+             v[nstage * 95 / 100], v[nstage - 1]);
+    else
+      printf("%-7s mean %8lld  p50 %8lld  p95 %8lld  max %8lld us\n",
+             stagename[k], sum / nstage, v[nstage / 2],
+             v[nstage * 95 / 100], v[nstage - 1]);
+  }
+  pcmcache_stats(&cs);
+  if (json)
+    printf("\n  },\n  \"cache\": {\"hits\": %ld, \"misses\": %ld}\n}\n",
+           cs.hits, cs.misses);
+  else
+    printf("cache   %ld hits, %ld misses\n", cs.hits, cs.misses);
+}
@@ -0,0 +1,415 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// libqrqsynth: morse code to samples, tone by tone. See qrqsynth.h.
+// Tones and pauses are timed to a fraction of a sample, so the samples
+// are the same as qrq has always rendered them only where a dot is a
+// whole number of samples; at other rates and speeds they differ.
+
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "qrqsynth.h"
+#include "codetab.h"
+#include "utf8.h"
+
+#define PI       M_PI
+
+enum { OUT_SHORT, OUT_INT, OUT_FLOAT, OUT_NONE };
+
+static const struct qrq_codeent *code_entry(int c);
+static int next_segment(struct qrq_synth *s);
+static int next_char(struct qrq_synth *s, unsigned int t, int *c);
+static void segment(struct qrq_synth *s, int freq, long len, int waveform);
+static void timed(struct qrq_synth *s, int freq, double len, int waveform);
+static double sample(struct qrq_synth *s);
+static void event(struct qrq_synth *s, int type, int c);
+static int pull(struct qrq_synth *s, void *out, int n, int type);
+
+
+// map a character of any alphabet to its dots and dashes, "?" if
+// none has it
+const char *qrq_morse_code(int c) {
+  const struct qrq_codeent *e = code_entry(c);
+
+  return e ? e->code : "..--..";
+}
+
+
+// the alphabet a character is from, -1 if it has no code
+int qrq_char_alphabet(int c) {
+  const struct qrq_codeent *e = code_entry(c);
+
+  return e ? e->alphabet : -1;
+}
+
+
+// number of an alphabet by its name, -1 if there is none
+int qrq_alphabet_find(const char *name) {
+  int i;
+
+  for (i = 0; i < qrq_nalphabets; i++)
+    if (!strcmp(qrq_alphabets[i].name, name))
+      return i;
+  return -1;
+}
+
+
+const char *qrq_alphabet_name(int alphabet) {
+  return ((alphabet >= 0) && (alphabet < qrq_nalphabets)) ?
+         qrq_alphabets[alphabet].name : NULL;
+}
+
+
+// the character typed with a key on a Latin keyboard: the letter of the
+// alphabet with the same code, other keys as they are
+int qrq_alphabet_key(int alphabet, int key) {
+  if ((alphabet < 0) || (alphabet >= qrq_nalphabets) || (key >= 0x80) ||
+      !isalpha(key))
+    return key;
+  return qrq_alphabets[alphabet].keys[toupper(key) - 'A'];
+}
+
+
+// one lookup in the perfect hash of codetab.c
+static const struct qrq_codeent *code_entry(int c) {
+  const struct qrq_codeent *e;
+  unsigned int b;
+
+  if (c < 0)
+    return NULL;
+  b = qrq_codehash(c, 0) % qrq_nbuckets;
+  e = &qrq_codes[qrq_codehash(c, qrq_codedisp[b]) % qrq_ncodes];
+  return (e->c == c) ? e : NULL;
+}
+
+
+// an idle synthesizer with the settings in cp
+void qrq_synth_init(struct qrq_synth *s, const struct cwparams *cp) {
+  memset(s, 0, sizeof(*s));
+  atomic_init(&s->head, 0);
+  atomic_init(&s->tail, 0);
+  atomic_init(&s->flush, 0);
+  atomic_init(&s->evhead, 0);
+  atomic_init(&s->evtail, 0);
+  qrq_synth_params(s, cp);
+}
+
+
+// new settings, from the rendering thread or while nothing is rendered.
+// The tone being sent keeps its own.
+void qrq_synth_params(struct qrq_synth *s, const struct cwparams *cp) {
+  s->cp = *cp;
+
+  // the signal needs "ed" samples to reach the full amplitude and
+  // at the end another "ed" samples to reach zero. The dots and
+  // dashes therefore are becoming longer by "ed" and the pauses
+  // after them are shortened accordingly by "ed" samples
+  s->ed = (int)(cp->samplerate * (cp->edge / 1000.0));
+}
+
+
+// queue UTF-8 text to be sent, from one thread at a time. Only whole
+// characters are queued, returns the number of bytes that fit
+int qrq_synth_queue(struct qrq_synth *s, const char *text) {
+  unsigned int h = atomic_load_explicit(&s->head, memory_order_relaxed);
+  unsigned int t = atomic_load_explicit(&s->tail, memory_order_acquire);
+  int n = 0, k;
+
+  while (text[n]) {
+    k = utf8_size(text[n]) ? utf8_size(text[n]) : 1;
+    if (h - t + k > QRQ_SYNTH_QUEUE)
+      break;
+    while (k-- && text[n])
+      s->queue[h++ % QRQ_SYNTH_QUEUE] = text[n++];
+  }
+  atomic_store_explicit(&s->head, h, memory_order_release);
+  return n;
+}
+
+
+// send a plain tone of len samples next, when nothing else is sent
+void qrq_synth_tone(struct qrq_synth *s, int freq, long len, int waveform) {
+  segment(s, freq, len, waveform);
+}
+
+
+// fill out with nframes samples, silence once everything is sent
+// returns the number of samples that were sent before that.
+// Never allocates, locks or blocks.
+int qrq_synth_render(struct qrq_synth *s, short *out, int nframes) {
+  return pull(s, out, nframes, OUT_SHORT);
+}
+
+int qrq_synth_render_int(struct qrq_synth *s, int *out, int nframes) {
+  return pull(s, out, nframes, OUT_INT);
+}
+
+// -1.0 .. 1.0
+int qrq_synth_render_float(struct qrq_synth *s, float *out, int nframes) {
+  return pull(s, out, nframes, OUT_FLOAT);
+}
+
+
+// advance by nframes samples like the render functions, without
+// computing them: the events of a text without rendering it
+int qrq_synth_skip(struct qrq_synth *s, int nframes) {
+  return pull(s, NULL, nframes, OUT_NONE);
+}
+
+
+// the oldest event not read yet, returns 0 if there is none
+int qrq_synth_event(struct qrq_synth *s, struct qrq_event *ev) {
+  unsigned int t = atomic_load_explicit(&s->evtail, memory_order_relaxed);
+
+  if (t == atomic_load_explicit(&s->evhead, memory_order_acquire))
+    return 0;
+  *ev = s->events[t % QRQ_SYNTH_EVENTS];
+  atomic_store_explicit(&s->evtail, t + 1, memory_order_release);
+  return 1;
+}
+
+
+// 1 while there is something to send
+int qrq_synth_busy(struct qrq_synth *s) {
+  return (s->seg.x < s->seg.len - 1) || s->code ||
+         (atomic_load(&s->head) != atomic_load(&s->tail));
+}
+
+
+// drop everything queued, may be called from any thread. The renderer
+// stops at its next call.
+void qrq_synth_flush(struct qrq_synth *s) {
+  atomic_store(&s->flush, 1);
+}
+
+
+static int pull(struct qrq_synth *s, void *out, int n, int type) {
+  int i = 0, k;
+  double val;
+
+  if (atomic_exchange(&s->flush, 0)) {
+    atomic_store(&s->tail, atomic_load(&s->head));
+    s->code = NULL;
+    s->seg.len = s->seg.x = 0;
+    s->frac = 0.0;
+    s->sending = 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    // a tone of len samples has len - 1 of them, as always
+    while (s->seg.x >= s->seg.len - 1)
+      if (!next_segment(s))
+        goto done;
+    if (type == OUT_NONE) {
+      s->seg.x++;
+      s->pos++;
+      continue;
+    }
+    val = sample(s);
+    switch (type) {
+    case OUT_SHORT:
+      ((short *)out)[i] = (short)(int)(val * 32500.0);
+      break;
+    case OUT_INT:
+      ((int *)out)[i] = (int)(val * 32500.0);
+      break;
+    default:
+      ((float *)out)[i] = (float)(val * (32500.0 / 32768.0));
+    }
+  }
+done:
+  for (k = i; (type != OUT_NONE) && (k < n); k++) {
+    switch (type) {
+    case OUT_SHORT:
+      ((short *)out)[k] = 0;
+      break;
+    case OUT_INT:
+      ((int *)out)[k] = 0;
+      break;
+    default:
+      ((float *)out)[k] = 0.0f;
+    }
+  }
+  return i;
+}
+
+
+static void segment(struct qrq_synth *s, int freq, long len, int waveform) {
+  s->seg.freq = freq;
+  s->seg.waveform = waveform;
+  s->seg.len = len;
+  s->seg.x = 0;
+  s->seg.cyc = 0;
+}
+
+
+// a tone or pause of len samples, which need not be a whole number:
+// the fraction is carried over, so at any sample rate and speed the
+// elements are never more than half a sample off
+static void timed(struct qrq_synth *s, int freq, double len, int waveform) {
+  long n = (long)(len + s->frac + 0.5);
+
+  s->frac += len - n;
+  segment(s, freq, n, waveform);
+}
+
+
+// the next tone or pause of the text, 0 if nothing is queued
+static int next_segment(struct qrq_synth *s) {
+  const struct cwparams *cp = &s->cp;
+  double fulldotlen, dotlen, fwdotlen = 0;
+  int charspeed;
+  unsigned int t;
+  int c;
+
+  // Farnsworth?
+  if (cp->speed < cp->mincharspeed) {
+    charspeed = cp->mincharspeed;
+    fwdotlen = cp->samplerate * 6.0 / cp->speed;
+  } else {
+    charspeed = cp->speed;
+  }
+
+  // speed is in LpM now, so we have to calculate the dot-length in
+  // milliseconds using the well-known formula  dotlength= 60/(wpm*50)
+  // and then to samples
+  dotlen = cp->samplerate * 6.0 / charspeed;
+  fulldotlen = dotlen;
+
+  while (1) {
+    if (s->code) {
+      // a dot or dash and the pause after it, or a word space
+      c = s->code[s->codepos / 2];
+      if (c == '.' || c == '-') {
+        if (s->codepos % 2 == 0) {
+          event(s, QRQ_EV_ELEMENT, c);
+          timed(s, cp->freq, (c == '.' ? dotlen : 3 * dotlen) + s->ed,
+                cp->waveform);
+        } else {
+          event(s, QRQ_EV_ELEMENTEND, c);
+          timed(s, 0, fulldotlen - s->ed, SILENCE);
+        }
+        s->codepos++;
+      } else if (c) {
+        timed(s, 0, 3 * fulldotlen, SILENCE);
+        s->codepos += 2;
+      } else {
+        // end of the character
+        s->code = NULL;
+        event(s, QRQ_EV_CHAREND, 0);
+        if (fwdotlen)
+          timed(s, 0, 3 * fwdotlen - fulldotlen, SILENCE);
+        else
+          timed(s, 0, 2 * fulldotlen, SILENCE);
+      }
+      return 1;
+    }
+
+    t = atomic_load_explicit(&s->tail, memory_order_relaxed);
+    if (t == atomic_load_explicit(&s->head, memory_order_acquire)) {
+      if (s->sending)
+        event(s, QRQ_EV_END, 0);
+      s->sending = 0;
+      return 0;
+    }
+    t += next_char(s, t, &c);
+    s->code = qrq_morse_code(c);
+    s->codepos = 0;
+    s->sending = 1;
+    event(s, QRQ_EV_CHAR, utf8_upper(c));
+    atomic_store_explicit(&s->tail, t, memory_order_release);
+  }
+}
+
+
+// the character at the tail of the queue into *c, returns its bytes.
+// qrq_synth_queue() only queues whole characters
+static int next_char(struct qrq_synth *s, unsigned int t, int *c) {
+  char tmp[5] = "";
+  int i, n = utf8_size(s->queue[t % QRQ_SYNTH_QUEUE]);
+
+  for (i = 0; i < n; i++)
+    tmp[i] = s->queue[(t + i) % QRQ_SYNTH_QUEUE];
+  return n ? utf8_decode(tmp, c) : (*c = UTF8_BAD, 1);
+}
+
+
+// an event at the next sample, dropped when the queue is full
+static void event(struct qrq_synth *s, int type, int c) {
+  unsigned int h = atomic_load_explicit(&s->evhead, memory_order_relaxed);
+  struct qrq_event *ev = &s->events[h % QRQ_SYNTH_EVENTS];
+
+  if (h - atomic_load_explicit(&s->evtail, memory_order_acquire) >=
+      QRQ_SYNTH_EVENTS)
+    return;
+  ev->pos = s->pos;
+  ev->type = type;
+  ev->c = c;
+  atomic_store_explicit(&s->evhead, h + 1, memory_order_release);
+}
+
+
+// the next sample of the segment, -1.0 .. 1.0
+// with chirp or drift the frequency changes while the tone is sent,
+// the phase is then accumulated sample by sample
+static double sample(struct qrq_synth *s) {
+  struct qrq_segment *g = &s->seg;
+  const struct cwparams *cp = &s->cp;
+  long sr = cp->samplerate;
+  long x = g->x, len = g->len;
+  int ed = s->ed;
+  double val = 0, f, hard;
+
+  g->x++;
+  s->pos++;
+  if (g->waveform == SILENCE)
+    return 0;
+
+  if (cp->chirp || cp->drift) {
+    f = g->freq + cp->chirp * exp(-x / (sr * CHIRPMS / 1000.0)) +
+        cp->drift * sin(2 * PI * (s->pos - 1) / (DRIFTSEC * sr));
+    g->cyc += f / sr;
+  } else {
+    g->cyc = 1.0 * g->freq * x / sr;
+  }
+
+  switch (g->waveform) {
+  case SINE:
+    val = sin(2 * PI * g->cyc);
+    break;
+  case SAWTOOTH:
+    val = (g->cyc - floor(g->cyc)) - 0.5;
+    break;
+  case SQUARE:
+    val = ceil(sin(2 * PI * g->cyc)) - 0.5;
+    break;
+  }
+
+  // key clicks: only part of the edge is shaped
+  hard = cp->clicks / 100.0;
+  if (x < ed)                                               // rising edge
+    val *= hard + (1 - hard) * pow(sin(PI * x / (2.0 * ed)), 2);
+
+  if (x > (len - ed))                                       // falling edge
+    val *= hard + (1 - hard) *
+           pow(sin(2 * PI * (x - (len - ed) + ed) / (4 * ed)), 2);
+
+  return val;
+}
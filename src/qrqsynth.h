@@ -0,0 +1,133 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// libqrqsynth - the morse synthesis of qrq as a library
+//
+// All state is in a struct qrq_synth that the caller provides, the
+// library never allocates, locks or touches globals. Text is queued
+// with qrq_synth_queue() from any one thread and pulled as samples with
+// qrq_synth_render() from any other one, e.g. a real-time audio
+// callback. The queue between the two is lock free.
+//
+//   struct qrq_synth s;
+//   struct cwparams cp = { 48000, 200, 0, 600, SINE, 2.0 };
+//
+//   qrq_synth_init(&s, &cp);
+//   qrq_synth_queue(&s, "CQ DE DJ1YFK");
+//   while (qrq_synth_busy(&s))
+//     qrq_synth_render(&s, pcm, 256);      // short pcm[256]
+//
+// While it renders, the synthesizer records when every character and
+// element starts and ends, as sample positions. qrq_synth_event() reads
+// them back, from the rendering thread or one other thread.
+//
+// Text is UTF-8, the characters of all alphabets in alphabets.txt are
+// sent with their codes. qrq_alphabet_key() maps the Latin letters to
+// an alphabet, for typing it on any keyboard.
+
+#ifndef QRQ_SYNTH
+#define QRQ_SYNTH
+
+#include <stdatomic.h>
+
+#define SILENCE  0       // for the tone generator
+#define SINE     1
+#define SAWTOOTH 2
+#define SQUARE   3
+
+#define CHIRPMS  8.0             // decay of the chirp after key down
+#define DRIFTSEC 4.0             // period of the frequency drift
+
+#define QRQ_SYNTH_QUEUE 256      // characters queued, a power of 2
+#define QRQ_SYNTH_EVENTS 256     // events not read yet, a power of 2
+
+#define QRQ_EV_CHAR       1      // a character starts, c is the character
+#define QRQ_EV_CHAREND    2      // the space after it starts
+#define QRQ_EV_ELEMENT    3      // key down, c is '.' or '-'
+#define QRQ_EV_ELEMENTEND 4      // key up
+#define QRQ_EV_END        5      // everything queued is sent
+
+// settings of one rendering
+struct cwparams {
+  long samplerate;
+  int speed;                     // in cpm
+  int mincharspeed;              // below: farnsworth
+  int freq;
+  int waveform;
+  double edge;                   // rise/fall time in milliseconds
+  int chirp;                     // Hz off frequency at key down
+  int drift;                     // Hz of slow frequency wander
+  int clicks;                    // 0 = shaped edges .. 100 = hard keying
+};
+
+// something that happens at a sample of the rendering
+struct qrq_event {
+  long pos;                      // sample, counted from 0 like pos below
+  int type;                      // QRQ_EV_*
+  int c;                         // code point
+};
+
+// a tone or a pause being rendered
+struct qrq_segment {
+  int freq, waveform;
+  long len;                      // samples + 1, as tone() always had
+  long x;                        // next sample
+  double cyc;                    // phase in cycles, with chirp and drift
+};
+
+struct qrq_synth {
+  struct cwparams cp;
+  int ed;                        // rise/fall time in samples
+  double frac;                   // of a sample, carried to the next segment
+  long pos;                      // samples rendered, for the drift
+  struct qrq_segment seg;
+
+  // the character being sent
+  const char *code;
+  int codepos, charend;
+
+  // queued text, written by one thread and read by the renderer
+  char queue[QRQ_SYNTH_QUEUE];
+  atomic_uint head, tail;
+  atomic_int flush;
+
+  // events, written by the renderer and read by one thread.
+  // When nobody reads them the newest ones are dropped
+  struct qrq_event events[QRQ_SYNTH_EVENTS];
+  atomic_uint evhead, evtail;
+  int sending;                   // a character was taken from the queue
+};
+
+void qrq_synth_init(struct qrq_synth *s, const struct cwparams *cp);
+void qrq_synth_params(struct qrq_synth *s, const struct cwparams *cp);
+int  qrq_synth_queue(struct qrq_synth *s, const char *text);
+void qrq_synth_tone(struct qrq_synth *s, int freq, long len, int waveform);
+int  qrq_synth_render(struct qrq_synth *s, short *out, int nframes);
+int  qrq_synth_render_int(struct qrq_synth *s, int *out, int nframes);
+int  qrq_synth_render_float(struct qrq_synth *s, float *out, int nframes);
+int  qrq_synth_skip(struct qrq_synth *s, int nframes);
+int  qrq_synth_event(struct qrq_synth *s, struct qrq_event *ev);
+int  qrq_synth_busy(struct qrq_synth *s);
+void qrq_synth_flush(struct qrq_synth *s);
+const char *qrq_morse_code(int c);
+int  qrq_char_alphabet(int c);
+int  qrq_alphabet_find(const char *name);
+const char *qrq_alphabet_name(int alphabet);
+int  qrq_alphabet_key(int alphabet, int key);
+
+#endif
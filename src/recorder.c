@@ -0,0 +1,428 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// The session recorder, see recorder.h. Records are put into the ring by
+// the UI thread only, the writer thread empties it every 100 ms.
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "morse.h"
+#include "effects.h"
+#include "score.h"
+#include "attempt.h"
+#include "recorder.h"
+
+int recording = 0;
+long recdropped = 0;
+
+static FILE *fh = NULL;
+static pthread_t writer;
+static atomic_int stopping;
+static unsigned char ring[RECRING];
+static atomic_uint head, tail;          // bytes put in, bytes written
+static long long last;                  // ns, time of the last record
+
+static void put(int type, const void *data, int len);
+static void *write_records(void *arg);
+static void put32(unsigned char *p, unsigned long v);
+static void write_header(FILE *f, long rate, unsigned long datalen);
+static void csv_text(FILE *f, const char *s);
+
+
+// start recording an attempt to file, if recording is on
+// returns 0 or -1 if the file can't be written
+int rec_start(const char *file, const char *mycall, const char *callbase) {
+  struct rechead h;
+
+  if (!recording || fh)
+    return 0;
+  if ((fh = fopen(file, "wb")) == NULL)
+    return -1;
+  memset(&h, 0, sizeof(h));
+  strcpy(h.magic, RECMAGIC);
+  h.start = time(NULL);
+  strncpy(h.mycall, mycall, sizeof(h.mycall) - 1);
+  strncpy(h.callbase, callbase, sizeof(h.callbase) - 1);
+  fwrite(&h, sizeof(h), 1, fh);
+
+  head = tail = 0;
+  stopping = 0;
+  last = get_ns();
+  if (pthread_create(&writer, NULL, write_records, NULL)) {
+    fclose(fh);
+    fh = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+
+// the call that is sent now, with all that is needed to render it again
+void rec_call(const char *text) {
+  struct cwparams cp;
+  struct reccall c;
+
+  if (!fh)
+    return;
+  cw_params(&cp);
+  memset(&c, 0, sizeof(c));
+  c.samplerate = cp.samplerate;
+  c.speed = cp.speed;
+  c.mincharspeed = cp.mincharspeed;
+  c.freq = cp.freq;
+  c.edge = cp.edge;
+  c.waveform = cp.waveform;
+  c.chirp = cp.chirp;
+  c.drift = cp.drift;
+  c.clicks = cp.clicks;
+  c.noise = effects.noise;
+  c.qsb = effects.qsb;
+  c.qrm = effects.qrm;
+  c.filter = effects.filter;
+  c.seed = fx_seed();
+  strncpy(c.text, text, sizeof(c.text) - 1);
+  put(REC_CALL, &c, sizeof(c));
+}
+
+
+void rec_key(int c) {
+  int32_t k = c;
+
+  if (fh)
+    put(REC_KEY, &k, sizeof(k));
+}
+
+
+void rec_audio(int ev) {
+  int32_t e = ev;
+
+  if (fh)
+    put(REC_AUDIO, &e, sizeof(e));
+}
+
+
+void rec_score(const char *call, const char *input, int points, int score) {
+  struct recscore s;
+
+  if (!fh)
+    return;
+  memset(&s, 0, sizeof(s));
+  s.points = points;
+  s.score = score;
+  s.mode = scoremode;
+  strncpy(s.call, call, sizeof(s.call) - 1);
+  strncpy(s.input, input, sizeof(s.input) - 1);
+  put(REC_SCORE, &s, sizeof(s));
+}
+
+
+// end the attempt, waits until all records are written
+void rec_stop() {
+  if (!fh)
+    return;
+  put(REC_END, NULL, 0);
+  stopping = 1;
+  pthread_join(writer, NULL);
+  fclose(fh);
+  fh = NULL;
+}
+
+
+// append a record to the ring, it is dropped if the ring is full
+static void put(int type, const void *data, int len) {
+  struct rechdr h;
+  const unsigned char *p[2] = { (const unsigned char *)&h, data };
+  int n[2] = { sizeof(h), len };
+  unsigned int pos = head;
+  long long now = get_ns();
+  int k, i;
+
+  if (RECRING - (pos - atomic_load_explicit(&tail, memory_order_acquire))
+      < sizeof(h) + len) {
+    recdropped++;
+    return;
+  }
+  h.dt = ((now - last) / 1000 > UINT32_MAX) ? UINT32_MAX : (now - last) / 1000;
+  h.type = type;
+  h.len = len;
+  last = now;
+  for (k = 0; k < 2; k++)
+    for (i = 0; i < n[k]; i++)
+      ring[pos++ % RECRING] = p[k][i];
+  atomic_store_explicit(&head, pos, memory_order_release);
+}
+
+
+// writer thread: every 100 ms, all that is in the ring goes to the file
+static void *write_records(void *arg) {
+  struct timespec ts = { 0, 100000000L };
+  unsigned int h, t, n;
+  int done;
+
+  do {
+    done = stopping;
+    h = atomic_load_explicit(&head, memory_order_acquire);
+    for (t = tail; t != h; t += n) {
+      n = RECRING - t % RECRING;
+      if (n > h - t)
+        n = h - t;
+      fwrite(ring + t % RECRING, 1, n, fh);
+    }
+    atomic_store_explicit(&tail, t, memory_order_release);
+    fflush(fh);
+    if (!done)
+      nanosleep(&ts, NULL);
+  } while (!done);
+  return NULL;
+}
+
+
+// read a recorded attempt, *ev is allocated
+// returns the number of records or -1
+int rec_load(const char *file, struct rechead *h, struct recevent **ev) {
+  struct rechdr rh;
+  struct recevent *e = NULL;
+  long long t = 0;
+  int n = 0, size = 0;
+  FILE *f;
+  void *p;
+
+  if ((f = fopen(file, "rb")) == NULL)
+    return -1;
+  if ((fread(h, sizeof(*h), 1, f) != 1) || strcmp(h->magic, RECMAGIC)) {
+    fclose(f);
+    return -1;
+  }
+  while (fread(&rh, sizeof(rh), 1, f) == 1) {
+    if (n == size) {
+      size = 2 * size + 256;
+      if ((p = realloc(e, size * sizeof(*e))) == NULL)
+        break;
+      e = p;
+    }
+    t += rh.dt;
+    memset(&e[n], 0, sizeof(*e));
+    e[n].t = t;
+    e[n].type = rh.type;
+    if ((rh.len > sizeof(e[n].u)) || (fread(&e[n].u, 1, rh.len, f) != rh.len))
+      break;
+    n++;
+  }
+  fclose(f);
+  *ev = e;
+  return n;
+}
+
+
+// set the parameters of a recorded call, the next send_text() of its
+// text sounds the same. Only the sample rate stays as it is
+void rec_params(const struct reccall *c) {
+  speed = c->speed;
+  mincharspeed = c->mincharspeed;
+  freq = c->freq;
+  edge = c->edge;
+  waveform = c->waveform;
+  chirp = c->chirp;
+  drift = c->drift;
+  clicks = c->clicks;
+  effects.noise = c->noise;
+  effects.qsb = c->qsb;
+  effects.qrm = c->qrm;
+  effects.filter = c->filter;
+  fx_reseed(c->seed);
+}
+
+
+// render a recorded call as the cw thread did, at its sample rate
+// returns the number of samples
+int rec_render(const struct reccall *c, struct cwbuf *out) {
+  struct cwparams cp = { c->samplerate, c->speed, c->mincharspeed, c->freq,
+                         c->waveform, c->edge, c->chirp, c->drift, c->clicks };
+  struct effects fx = { c->noise, c->qsb, c->qrm, c->filter };
+  struct fxstate st = { .qrm = NULL };
+
+  out->len = 0;
+  render_text(&cp, c->text, out);
+  if (fx_active(&fx)) {
+    fx_reseed(c->seed);
+    fx_init(&st, &fx, cp.samplerate, cp.freq, cp.speed);
+    fx_process(&st, out->buf, out->len);
+    fx_free(&st);
+  }
+  return out->len;
+}
+
+
+// write a recorded attempt as file.csv, every record, and file.wav, the
+// calls rendered again at the time they were sent. A call stopped with
+// F8 ends where it was stopped. returns 0 or -1
+int rec_export(const char *file) {
+  static const char *types[] = { "", "call", "key", "audio", "score", "end" };
+  static const char *events[] = { "", "start", "end", "cancel", "error" };
+  char base[PATH_MAX], name[PATH_MAX + 4], key[16], pair[2 * CALLLEN];
+  struct rechead h;
+  struct recevent *ev, *e;
+  struct cwbuf out = { NULL, 0, 0 };
+  FILE *csv, *wav;
+  long rate = 0, pos = 0, start, len, k;
+  short int s;
+  int n, i, j;
+
+  if ((n = rec_load(file, &h, &ev)) < 0)
+    return -1;
+  strncpy(base, file, sizeof(base) - 1);
+  base[sizeof(base) - 1] = '\0';
+  if (strrchr(base, '.') && !strchr(strrchr(base, '.'), '/'))
+    *strrchr(base, '.') = '\0';
+
+  sprintf(name, "%s.csv", base);
+  if ((csv = fopen(name, "w")) == NULL) {
+    free(ev);
+    return -1;
+  }
+  fprintf(csv, "time,event,text,speed,freq,points,score\n");
+  for (i = 0; i < n; i++) {
+    e = &ev[i];
+    fprintf(csv, "%.6f,%s,", e->t / 1e6, types[e->type < 6 ? e->type : 0]);
+    switch (e->type) {
+    case REC_CALL:
+      csv_text(csv, e->u.call.text);
+      fprintf(csv, ",%d,%d,,\n", e->u.call.speed, e->u.call.freq);
+      break;
+    case REC_KEY:
+      rec_keyname(e->u.key, key);
+      csv_text(csv, key);
+      fprintf(csv, ",,,,\n");
+      break;
+    case REC_AUDIO:
+      csv_text(csv, events[e->u.audio < 5 ? e->u.audio : 0]);
+      fprintf(csv, ",,,,\n");
+      break;
+    case REC_SCORE:
+      snprintf(pair, sizeof(pair), "%s/%s", e->u.score.call,
+               e->u.score.input);
+      csv_text(csv, pair);
+      fprintf(csv, ",,,%d,%d\n", e->u.score.points, e->u.score.score);
+      break;
+    default:
+      fprintf(csv, ",,,,\n");
+    }
+  }
+  fclose(csv);
+
+  sprintf(name, "%s.wav", base);
+  if ((wav = fopen(name, "wb")) == NULL) {
+    free(ev);
+    return -1;
+  }
+  write_header(wav, 0, 0);
+  for (i = 0; i < n; i++) {
+    if ((ev[i].type != REC_CALL) || !ev[i].u.call.text[0])
+      continue;
+    if (!rate) {
+      rate = ev[i].u.call.samplerate;
+      out.size = 20 * rate;
+      if ((out.buf = malloc(out.size * sizeof(int))) == NULL)
+        break;
+    }
+    if (ev[i].u.call.samplerate != rate)
+      continue;
+    len = rec_render(&ev[i].u.call, &out);
+    for (j = i + 1; (j < n) && (ev[j].type != REC_CALL); j++)
+      if ((ev[j].type == REC_AUDIO) && (ev[j].u.audio == EV_CANCEL) &&
+          ((ev[j].t - ev[i].t) * rate / 1000000 < len))
+        len = (ev[j].t - ev[i].t) * rate / 1000000;
+    start = ev[i].t * rate / 1000000;
+    for (s = 0; pos < start; pos++)
+      fwrite(&s, sizeof(s), 1, wav);
+    for (k = 0; k < len; k++, pos++) {
+      s = out.buf[k];
+      fwrite(&s, sizeof(s), 1, wav);
+    }
+  }
+  write_header(wav, rate, pos * 2);
+  fclose(wav);
+  free(out.buf);
+  free(ev);
+  return 0;
+}
+
+
+// name of a key, for the CSV file and the replay
+void rec_keyname(int c, char *name) {
+  if (c == '\n')
+    strcpy(name, "ENTER");
+  else if (c == ' ')
+    strcpy(name, "SPACE");
+  else if (c == ',')
+    strcpy(name, "COMMA");
+  else if ((c == KEY_BACKSPACE) || (c == 127) || (c == 8))
+    strcpy(name, "BACKSPACE");
+  else if ((c >= KEY_F(1)) && (c <= KEY_F(12)))
+    sprintf(name, "F%d", c - KEY_F0);
+  else if ((c > ' ') && (c < 127))
+    sprintf(name, "%c", c);
+  else
+    sprintf(name, "0x%x", c);
+}
+
+
+static void put32(unsigned char *p, unsigned long v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+
+// a text field of the CSV file, quoted: calls may contain a comma
+static void csv_text(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"')
+      fputc('"', f);
+    fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+
+// (re)write the header of a mono 16 bit WAV file
+static void write_header(FILE *f, long rate, unsigned long datalen) {
+  unsigned char h[44];
+
+  memcpy(h, "RIFF", 4);
+  put32(h + 4, 36 + datalen);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put32(h + 16, 16);                  // fmt chunk size
+  h[20] = 1; h[21] = 0;               // PCM
+  h[22] = 1; h[23] = 0;               // mono
+  put32(h + 24, rate);
+  put32(h + 28, rate * 2);            // bytes per second
+  h[32] = 2; h[33] = 0;               // bytes per frame
+  h[34] = 16; h[35] = 0;              // bits per sample
+  memcpy(h + 36, "data", 4);
+  put32(h + 40, datalen);
+
+  fseek(f, 0, SEEK_SET);
+  fwrite(h, 1, sizeof(h), f);
+}
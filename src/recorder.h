@@ -0,0 +1,102 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_RECORDER
+#define QRQ_RECORDER
+
+// The session recorder writes a timeline of an attempt to a file: the
+// parameters of every call sent (the audio can be rendered again from
+// them), every key, the audio events and the scores. The records go
+// into a ring buffer and a thread writes them out, the input path makes
+// no system calls for it.
+
+#include <stdint.h>
+
+#include "morse.h"
+#include "callbase.h"            // CALLLEN
+
+#define RECMAGIC  "QRQREC2"
+#define RECRING   65536          // bytes of records not written yet
+
+#define REC_CALL   1             // a call is sent
+#define REC_KEY    2             // a key was read
+#define REC_AUDIO  3             // event of the cw thread, EV_*
+#define REC_SCORE  4             // an answer was scored
+#define REC_END    5             // end of the attempt
+
+// the file starts with
+struct rechead {
+  char magic[8];
+  int64_t start;                 // wall clock, s
+  char mycall[16];
+  char callbase[48];
+} __attribute__((packed));
+
+// then records, each one a header and type dependent data
+struct rechdr {
+  uint32_t dt;                   // us since the record before
+  uint8_t type;
+  uint8_t len;                   // bytes of data
+} __attribute__((packed));
+
+struct reccall {
+  uint32_t samplerate;
+  uint16_t speed, mincharspeed, freq, filter;
+  double edge;
+  uint8_t waveform, chirp, drift, clicks;
+  uint8_t noise, qsb, qrm, pad;
+  uint32_t seed;                 // of the receiving conditions
+  char text[CALLLEN];
+} __attribute__((packed));
+
+struct recscore {
+  int32_t points, score;
+  uint8_t mode;                  // scoremode
+  char call[CALLLEN];
+  char input[CALLLEN];
+} __attribute__((packed));
+
+// one record as read back
+struct recevent {
+  long long t;                   // us since the start
+  int type;
+  union {
+    struct reccall call;
+    int32_t key;
+    int32_t audio;
+    struct recscore score;
+  } u;
+};
+
+extern int recording;            // 1 = record every attempt, from qrqrc
+extern long recdropped;          // records lost to a full ring
+
+int  rec_start(const char *file, const char *mycall, const char *callbase);
+void rec_call(const char *text);
+void rec_key(int c);
+void rec_audio(int ev);
+void rec_score(const char *call, const char *input, int points, int score);
+void rec_stop();
+
+int  rec_load(const char *file, struct rechead *h, struct recevent **ev);
+void rec_params(const struct reccall *c);
+int  rec_render(const struct reccall *c, struct cwbuf *out);
+int  rec_export(const char *file);
+void rec_keyname(int c, char *name);
+
+#endif
@@ -0,0 +1,98 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Real-time mode for the audio threads: they run with SCHED_FIFO and
+// the render buffers are locked in memory and pre-faulted, so that other
+// work on the machine does not delay the audio.
+
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "pulseaudio.h"
+#include "morse.h"
+#include "rt.h"
+
+int realtime = 0;
+struct rtstate rtstate;
+
+static int lock_buffer(void *p, size_t bytes);
+
+
+// lock and pre-fault the part of the render buffers that is used at
+// the sample rate. returns 0 or -1 if not all could be locked
+int rt_init() {
+  size_t used = 20 * (size_t)samplerate;   // FULLBUF is 20 s at MAXRATE
+  short int *pcm;
+  long n;
+  int ret;
+
+  if (!realtime)
+    return 0;
+  if (used > FULLBUF)
+    used = FULLBUF;
+  pcm = audio_buffer(&n);
+  if (n > used)
+    n = used;
+  ret = lock_buffer(full_buf, used * sizeof(int));
+  ret |= lock_buffer(pcm, n * sizeof(short int));
+  rtstate.locked = !ret;
+  rtstate.bytes = used * sizeof(int) + n * sizeof(short int);
+  return ret;
+}
+
+
+// lock a buffer and write every page of it, so the audio threads never
+// wait for a page fault. Without enough RLIMIT_MEMLOCK the pages are at
+// least present. returns 0 or -1 if the buffer could not be locked
+static int lock_buffer(void *p, size_t bytes) {
+  volatile char *c = p;
+  long page = sysconf(_SC_PAGESIZE);
+  size_t i;
+  int ret = mlock(p, bytes);
+
+  for (i = 0; i < bytes; i += page)
+    c[i] = c[i];
+  return ret;
+}
+
+
+// start an audio thread, with SCHED_FIFO in real-time mode. Without
+// permission (RLIMIT_RTPRIO or CAP_SYS_NICE) it runs as a normal thread
+// returns 0 or the error of pthread_create
+int rt_thread(pthread_t *t, void *(*fn)(void *), void *arg) {
+  struct sched_param sp = { .sched_priority = RTPRIO };
+  pthread_attr_t attr;
+  int ret;
+
+  if (realtime && !rtstate.denied) {
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &sp);
+    ret = pthread_create(t, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    if (ret != EPERM) {
+      rtstate.fifo |= !ret;
+      return ret;
+    }
+    rtstate.denied = 1;
+  }
+  return pthread_create(t, NULL, fn, arg);
+}
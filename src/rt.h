@@ -0,0 +1,40 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_RT
+#define QRQ_RT
+
+#include <pthread.h>
+
+#define RTPRIO  4        // SCHED_FIFO priority, below the sound server's 5
+
+// what the real-time mode could get
+struct rtstate {
+  int fifo;              // an audio thread runs with SCHED_FIFO
+  int denied;            // no permission for SCHED_FIFO
+  int locked;            // the render buffers are locked in memory
+  long bytes;            // bytes locked or pre-faulted
+};
+
+extern int realtime;                  // 1 = real-time mode, from qrqrc
+extern struct rtstate rtstate;
+
+int rt_init();
+int rt_thread(pthread_t *t, void *(*fn)(void *), void *arg);
+
+#endif
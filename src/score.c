@@ -0,0 +1,251 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <string.h>
+#include <stdint.h>
+
+#include "morse.h"
+#include "score.h"
+#include "utf8.h"
+
+#define PEQSIZE 128                     // > 2 * MAXALIGN, a power of 2
+
+// a call or an answer, its characters and the codes they are sent with
+struct sounded {
+  int n;
+  int c[MAXALIGN];                      // code points
+  int id[MAXALIGN];                     // of the code, see sound()
+};
+
+// the positions of every code in the call, as bit vectors
+struct peqtab {
+  int id[PEQSIZE];                      // 0 = free slot
+  uint64_t eq[PEQSIZE];
+};
+
+int score = 0;                          // session score
+int maxspeed = 0;
+int errornr = 0;                        // number of errors in attempt
+int fixspeed = 0;                       // keep speed fixed, regardless of err
+int scoremode = SCORE_EXACT;            // points for answers with errors
+
+static void sound(const char *s, struct sounded *out);
+static uint64_t *peq_at(struct peqtab *t, int id, int add);
+static int edit_columns(const struct sounded *a, const struct sounded *b,
+                        uint64_t *vp, uint64_t *vn);
+static int distance_at(const uint64_t *vp, const uint64_t *vn, int i, int j);
+static int align(const struct sounded *a, const struct sounded *b,
+                 char *output);
+
+
+// calculate score depending on number of errors and speed
+// writes the correct call and entered call with highlighted errors
+// and returns the score for this call. There are no points
+// in training modes (unlimited attempts/repeats, or fixed speed)
+int calc_score(char *realcall, char *input, int spd, char *output) {
+  struct scorestate st = { score, speed, maxspeed, errornr, fixspeed,
+                           scoremode };
+  int points;
+
+  points = score_call(&st, realcall, input, spd, output);
+  speed = st.speed;
+  maxspeed = st.maxspeed;
+  errornr = st.errornr;
+  return points;
+}
+
+
+// calc_score() on explicit state, st->score is not changed.
+// Characters that sound the same are the same, whatever alphabet
+// they were typed in
+int score_call(struct scorestate *st, const char *realcall, const char *input,
+               int spd, char *output) {
+  struct sounded a, b;
+  int lngth, dist;
+
+  sound(realcall, &a);
+  sound(input, &b);
+  lngth = utf8_len(realcall);
+
+  if ((a.n == b.n) &&
+      !memcmp(a.id, b.id, a.n * sizeof(int))) {   // exact match!
+    output[0] = '*';                        // * == OK, no mistake
+    output[1] = '\0';
+    if (st->speed > st->maxspeed) st->maxspeed = st->speed;
+    if (!st->fixspeed) st->speed += 10;
+    return (int)(2 * lngth * spd);          // score
+  } else {                                  // assemble error string
+    st->errornr += 1;
+    dist = align(&a, &b, output);
+    // slow down if not in fixed speed mode
+    if ((st->speed > 29) && !st->fixspeed) st->speed -= 10;
+    return partial_points(st->mode, lngth, dist, spd);
+  }
+}
+
+
+// points for an answer with dist errors in a call of lngth characters
+int partial_points(int mode, int lngth, int dist, int spd) {
+  switch (mode) {
+  case SCORE_PARTIAL:                       // for every correct character
+    return (dist < lngth) ? 2 * (lngth - dist) * spd : 0;
+  case SCORE_ONEOFF:                        // half for a single error
+    return (dist == 0) ? 2 * lngth * spd : (dist == 1) ? lngth * spd : 0;
+  default:
+    return dist ? 0 : 2 * lngth * spd;
+  }
+}
+
+
+// the characters of s, at most MAXALIGN. The id of a character is the
+// elements of its code as bits behind a 1 (dash = 1), so a Cyrillic A
+// is a Latin A. Characters without a code keep their own: -code point
+static void sound(const char *s, struct sounded *out) {
+  const char *code;
+  int c, n;
+
+  for (n = 0; *s && (n < MAXALIGN); n++) {
+    s += utf8_decode(s, &c);
+    out->c[n] = c;
+    if (qrq_char_alphabet(c) < 0) {
+      out->id[n] = -c;
+      continue;
+    }
+    for (out->id[n] = 1, code = qrq_morse_code(c); *code; code++)
+      if ((*code == '.') || (*code == '-'))
+        out->id[n] = (out->id[n] << 1) | (*code == '-');
+  }
+  out->n = n;
+}
+
+
+// the bit vector of a code in t, NULL if the call doesn't have it
+// and add is 0
+static uint64_t *peq_at(struct peqtab *t, int id, int add) {
+  unsigned int h = ((unsigned int)id * 0x9e3779b9u) >> 25;
+
+  while (t->id[h] && (t->id[h] != id))
+    h = (h + 1) & (PEQSIZE - 1);
+  if (!t->id[h]) {
+    if (!add)
+      return NULL;
+    t->id[h] = id;
+    t->eq[h] = 0;
+  }
+  return &t->eq[h];
+}
+
+
+// Myers' bit-parallel edit distance, the columns of the
+// edit matrix are kept as bit vectors in vp/vn (one per input
+// character plus one), the call has at most 64 characters
+static int edit_columns(const struct sounded *a, const struct sounded *b,
+                        uint64_t *vp, uint64_t *vn) {
+  struct peqtab peq;
+  uint64_t eq, xv, xh, hp, hn, top, *p;
+  int i, j, d, m = a->n, n = b->n;
+
+  memset(peq.id, 0, sizeof(peq.id));
+  for (i = 0; i < m; i++)
+    *peq_at(&peq, a->id[i], 1) |= 1ULL << i;
+
+  top = m ? 1ULL << (m - 1) : 0;
+  vp[0] = (m == 64) ? ~0ULL : (1ULL << m) - 1;       // column 0: D[i][0] = i
+  vn[0] = 0;
+  d = m;
+  for (j = 0; j < n; j++) {
+    eq = (p = peq_at(&peq, b->id[j], 0)) ? *p : 0;
+    xv = eq | vn[j];
+    xh = (((eq & vp[j]) + vp[j]) ^ vp[j]) | eq;
+    hp = vn[j] | ~(xh | vp[j]);
+    hn = vp[j] & xh;
+    if (hp & top)
+      d++;
+    else if (hn & top)
+      d--;
+    hp = (hp << 1) | 1;                     // D[0][j] = j
+    hn <<= 1;
+    vp[j + 1] = hn | ~(xv | hp);
+    vn[j + 1] = hp & xv;
+  }
+  return m ? d : n;
+}
+
+
+// edit distance of input to realcall: insertions, deletions and
+// substitutions
+int edit_distance(const char *realcall, const char *input) {
+  uint64_t vp[MAXALIGN + 1], vn[MAXALIGN + 1];
+  struct sounded a, b;
+
+  sound(realcall, &a);
+  sound(input, &b);
+  return edit_columns(&a, &b, vp, vn);
+}
+
+
+// D[i][j] from the column bit vectors
+static int distance_at(const uint64_t *vp, const uint64_t *vn, int i, int j) {
+  uint64_t mask = (i == 64) ? ~0ULL : (1ULL << i) - 1;
+  return j + __builtin_popcountll(vp[j] & mask) -
+         __builtin_popcountll(vn[j] & mask);
+}
+
+
+// align input to realcall and write it to output: correct characters
+// in upper case, wrong and extra ones in lower case and a '_' for each
+// one left out. returns the edit distance
+int align_call(const char *realcall, const char *input, char *output) {
+  struct sounded a, b;
+
+  sound(realcall, &a);
+  sound(input, &b);
+  return align(&a, &b, output);
+}
+
+
+static int align(const struct sounded *a, const struct sounded *b,
+                 char *output) {
+  uint64_t vp[MAXALIGN + 1], vn[MAXALIGN + 1];
+  int tmp[2 * MAXALIGN];
+  int m = a->n, n = b->n, i, j, d, k = 0, dist;
+
+  dist = edit_columns(a, b, vp, vn);
+
+  // trace back from the end, tmp is built in reverse
+  for (i = m, j = n; (i > 0) || (j > 0); ) {
+    d = (i && j) ? distance_at(vp, vn, i, j) : i + j;
+    if (i && j && (a->id[i - 1] == b->id[j - 1]) &&
+        (distance_at(vp, vn, i - 1, j - 1) == d)) {
+      tmp[k++] = b->c[--j];                 // match
+      i--;
+    } else if (i && j && (distance_at(vp, vn, i - 1, j - 1) == d - 1)) {
+      tmp[k++] = utf8_lower(b->c[--j]);     // substitution
+      i--;
+    } else if (j && (!i || (distance_at(vp, vn, i, j - 1) == d - 1))) {
+      tmp[k++] = utf8_lower(b->c[--j]);     // extra character
+    } else {
+      tmp[k++] = '_';                       // left out
+      i--;
+    }
+  }
+  for (i = k - 1; i >= 0; i--)
+    output += utf8_encode(tmp[i], output);
+  *output = '\0';
+  return dist;
+}
@@ -0,0 +1,51 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_SCORE
+#define QRQ_SCORE
+
+#define SCORE_EXACT   0                 // points only for a correct answer
+#define SCORE_PARTIAL 1                 // points for every correct character
+#define SCORE_ONEOFF  2                 // half the points for one error
+
+#define MAXALIGN 64                     // longest call for the alignment
+
+// scoring state, for callers that keep their own
+struct scorestate {
+  int score;                          // session score
+  int speed;                          // current speed in cpm
+  int maxspeed;
+  int errornr;                        // number of errors in attempt
+  int fixspeed;                       // keep speed fixed, regardless of err
+  int mode;                           // SCORE_EXACT ...
+};
+
+extern int score;                     // session score
+extern int maxspeed;
+extern int errornr;                   // number of errors in attempt
+extern int fixspeed;                  // keep speed fixed, regardless of err
+extern int scoremode;                 // points for answers with errors
+
+int calc_score(char *realcall, char *input, int spd, char *output);
+int score_call(struct scorestate *st, const char *realcall, const char *input,
+               int spd, char *output);
+int partial_points(int mode, int lngth, int dist, int spd);
+int edit_distance(const char *realcall, const char *input);
+int align_call(const char *realcall, const char *input, char *output);
+
+#endif
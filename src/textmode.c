@@ -0,0 +1,363 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Text copy mode: send a text file of any length as one continuous
+// stream and score what the student copies word by word.
+//
+// The file is memory mapped and split into words only when they are
+// needed. A render thread turns the words into samples and puts them
+// into a ring buffer, a play thread streams the ring buffer to the
+// audio device. Pages behind the read position are given back to the
+// kernel, so memory use does not depend on the length of the text.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pulseaudio.h"
+#include "effects.h"
+#include "textmode.h"
+#include "timeline.h"
+#include "attempt.h"
+#include "rt.h"
+
+#define DROPSTEP (1 << 20)       // give back mapped pages every MB
+
+struct textword {
+  char text[MAXWORD + 1];
+  long start;                    // first sample of the word
+};
+
+static struct textstats textstats;      // under the mutex
+
+static unsigned char *map = NULL;
+static size_t maplen = 0, mappos = 0, dropped = 0;
+
+static short ring[RINGLEN];
+static long pushed = 0;          // samples put into the ring, ever
+static long played = 0;          // samples taken out of it
+static struct textword words[WORDQ];
+static int whead = 0, wlen = 0;  // sent words not scored yet
+static int rendered = 0;
+static atomic_int stop = 0, finished = 0;
+static atomic_llong origin;      // when sample 0 is heard, for the timeline
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t renderthread, playthread;
+static struct cwparams params;
+
+static int  next_word(char *word);
+static void *render(void *arg);
+static void *play(void *arg);
+static void push(const int *in, int n);
+static void halt();
+
+
+// map the text file, 0 or -1 if it can't be read
+int text_open(const char *file) {
+  struct stat st;
+  int fd;
+
+  if ((fd = open(file, O_RDONLY)) < 0)
+    return -1;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  maplen = st.st_size;
+  mappos = dropped = 0;
+  map = NULL;
+  if (maplen) {
+    map = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      map = NULL;
+      close(fd);
+      return -1;
+    }
+    madvise(map, maplen, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  return 0;
+}
+
+
+void text_close() {
+  if (map)
+    munmap(map, maplen);
+  map = NULL;
+  maplen = 0;
+}
+
+
+// start sending the text with the settings in cp
+int text_start(const struct cwparams *cp) {
+  memset(&textstats, 0, sizeof(textstats));
+  params = *cp;
+  pushed = played = 0;
+  whead = wlen = 0;
+  stop = rendered = finished = 0;
+  origin = get_ns();
+  cancel_audio(0);
+  if (pthread_create(&renderthread, NULL, render, NULL))
+    return -1;
+  if (rt_thread(&playthread, play, NULL)) {
+    halt();                              // there is no play thread
+    pthread_join(renderthread, NULL);
+    return -1;
+  }
+  return 0;
+}
+
+
+// stop sending and wait for both threads
+void text_stop() {
+  halt();
+  cancel_audio(1);
+  pthread_join(renderthread, NULL);
+  pthread_join(playthread, NULL);
+  cancel_audio(0);
+}
+
+
+// tell the threads to stop and wake them
+static void halt() {
+  pthread_mutex_lock(&mutex);
+  stop = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// compare a copied word with the words already heard. If it matches
+// one of the next few, the ones in front of it were missed.
+int text_score(const char *typed, struct textresult *r) {
+  int i, k, n, ret;
+
+  r->ref[0] = '\0';
+  r->nskipped = 0;
+  pthread_mutex_lock(&mutex);
+  for (n = 0; (n < wlen) && (words[(whead + n) % WORDQ].start <= played); n++)
+    ;                                     // words heard so far
+  if (!n) {
+    textstats.wrong++;
+    pthread_mutex_unlock(&mutex);
+    return TEXT_EXTRA;
+  }
+
+  for (k = 0; (k < n) && (k < 4); k++)
+    if (!strcmp(words[(whead + k) % WORDQ].text, typed))
+      break;
+  if ((k == n) || (k == 4))
+    k = 0;                                // no match, compare with the first
+  for (i = 0; i < k; i++)
+    strcpy(r->skipped[i], words[(whead + i) % WORDQ].text);
+  r->nskipped = k;
+  strcpy(r->ref, words[(whead + k) % WORDQ].text);
+  whead = (whead + k + 1) % WORDQ;
+  wlen -= k + 1;
+
+  // the render thread counts the words too
+  textstats.missed += k;
+  if (!strcmp(r->ref, typed)) {
+    ret = TEXT_OK;
+    textstats.correct++;
+    textstats.chars += strlen(typed);
+    textstats.score += 2 * strlen(typed) * params.speed;
+  } else {
+    ret = TEXT_WRONG;
+    textstats.wrong++;
+  }
+  pthread_mutex_unlock(&mutex);
+  return ret;
+}
+
+
+// the attempt is over, words not copied are missed
+int text_finish() {
+  pthread_mutex_lock(&mutex);
+  textstats.missed += wlen;
+  wlen = 0;
+  pthread_mutex_unlock(&mutex);
+  return 0;
+}
+
+
+// 1 when the whole text was played
+int text_done() {
+  return finished;
+}
+
+
+// a copy of the running totals, the render thread counts them too
+void text_totals(struct textstats *t) {
+  pthread_mutex_lock(&mutex);
+  *t = textstats;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// percent of the text sent
+int text_progress() {
+  return maplen ? (int)(100.0 * mappos / maplen) : 100;
+}
+
+
+// characters morse_code() knows, everything else is left out
+static int text_char(int c) {
+  if (c & 0x80)
+    return 0;                             // UTF-8 sequences
+  if (isalnum(c))
+    return toupper(c);
+  if (strchr("/=.!,;+-?", c))
+    return c;
+  return 0;
+}
+
+
+// the next word of the text, 0 at the end. Words with nothing
+// sendable in them are skipped
+static int next_word(char *word) {
+  int c, n = 0;
+
+  while (!n && (mappos < maplen)) {
+    while ((mappos < maplen) && isspace(map[mappos]))
+      mappos++;
+    while ((mappos < maplen) && !isspace(map[mappos]) && (n < MAXWORD)) {
+      if ((c = text_char(map[mappos++])))
+        word[n++] = c;
+    }
+
+    // give pages already read back
+    while (mappos - dropped >= DROPSTEP) {
+      madvise(map + dropped, DROPSTEP, MADV_DONTNEED);
+      dropped += DROPSTEP;
+    }
+  }
+  word[n] = '\0';
+  return n;
+}
+
+
+// render thread: one synthesizer for the whole text, so the signal
+// goes on across words. Pulls 20 ms at a time into the ring buffer,
+// its events go to the timeline timed by the playback so far.
+static void *render(void *arg) {
+  static int buf[MAXRATE / 50];
+  static struct qrq_synth synth;
+  struct textword *w;
+  struct fxstate fx = { .qrm = NULL };
+  char word[MAXWORD + 2];
+  int n, fxon, chunk = params.samplerate / 50;
+
+  qrq_synth_init(&synth, &params);
+  if ((fxon = fx_active(&effects)))
+    fx_init(&fx, &effects, params.samplerate, params.freq, params.speed);
+
+  while (!stop && next_word(word)) {
+    pthread_mutex_lock(&mutex);
+    if (wlen == WORDQ) {                  // student is far behind
+      whead = (whead + 1) % WORDQ;
+      wlen--;
+      textstats.missed++;
+    }
+    w = &words[(whead + wlen) % WORDQ];
+    strcpy(w->text, word);
+    w->start = pushed;
+    wlen++;
+    textstats.sent++;
+    pthread_mutex_unlock(&mutex);
+
+    strcat(word, " ");
+    qrq_synth_queue(&synth, word);
+    while (!stop && ((n = qrq_synth_render_int(&synth, buf, chunk)) > 0)) {
+      if (fxon)
+        fx_process(&fx, buf, n);
+      push(buf, n);
+      tl_synth(&synth, origin);
+      if (n < chunk)
+        break;
+    }
+  }
+  fx_free(&fx);
+  pthread_mutex_lock(&mutex);
+  rendered = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+  return NULL;
+}
+
+
+// put samples into the ring, waits while it is full
+static void push(const int *in, int n) {
+  int i = 0, space;
+
+  pthread_mutex_lock(&mutex);
+  while ((i < n) && !stop) {
+    while (!stop && ((space = RINGLEN - (pushed - played)) == 0))
+      pthread_cond_wait(&cond, &mutex);
+    for (; (i < n) && (space > 0); i++, space--)
+      ring[pushed++ % RINGLEN] = (short)in[i];
+    pthread_cond_broadcast(&cond);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// play thread: stream the ring in 20 ms chunks until all is sent
+static void *play(void *arg) {
+  short chunk[MAXRATE / 50];
+  int i, n, ret = 0, size = params.samplerate / 50;
+  long latency = 0;
+  void *dsp = open_dsp();
+
+  while (ret == 0) {
+    pthread_mutex_lock(&mutex);
+    while (!stop && !rendered && (pushed - played < size))
+      pthread_cond_wait(&cond, &mutex);
+    n = pushed - played;
+    if (n > size)
+      n = size;
+    for (i = 0; i < n; i++)
+      chunk[i] = ring[(played + i) % RINGLEN];
+    pthread_mutex_unlock(&mutex);
+    if (stop || !n)
+      break;
+
+    ret = stream_audio(dsp, chunk, n);
+    if ((played / size) % 50 == 0)
+      latency = audio_latency(dsp);
+    origin = get_ns() + latency * 1000LL -
+             (played + n) * 1000000000LL / params.samplerate;
+
+    pthread_mutex_lock(&mutex);
+    played += n;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+  if (!stop && !ret)
+    close_audio(dsp);                     // drain
+  finished = 1;
+  return NULL;
+}
@@ -0,0 +1,59 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_TEXTMODE
+#define QRQ_TEXTMODE
+
+#include "morse.h"
+
+#define MAXWORD  24              // longer words are split
+#define WORDQ    256             // words sent but not copied yet
+#define RINGLEN  (2 * MAXRATE)   // rendered samples waiting for playback
+
+#define TEXT_OK    0             // results of text_score()
+#define TEXT_WRONG 1             // copied wrong
+#define TEXT_EXTRA 2             // nothing was sent to compare with
+
+// running totals of a text attempt
+struct textstats {
+  long sent;                     // words
+  long correct;
+  long wrong;
+  long missed;                   // skipped by the student
+  long chars;                    // characters copied correctly
+  long score;
+};
+
+// outcome of one copied word
+struct textresult {
+  char ref[MAXWORD + 1];         // word it was compared with
+  int nskipped;                  // words missed in front of it
+  char skipped[3][MAXWORD + 1];
+};
+
+int  text_open(const char *file);
+void text_close();
+int  text_start(const struct cwparams *cp);
+void text_stop();
+int  text_score(const char *typed, struct textresult *r);
+int  text_finish();
+int  text_done();
+int  text_progress();
+void text_totals(struct textstats *t);
+
+#endif
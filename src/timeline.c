@@ -0,0 +1,106 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// The timeline: when the characters and elements of what is sent are
+// heard. The audio threads turn the events of the synthesizer from
+// sample positions into get_ns() times, with the latency of the sound
+// server, and post them into a lock free queue. The UI thread takes
+// every event once its time has come, so the display stays with the
+// sound however much audio is buffered.
+
+#include <stdatomic.h>
+
+#include "morse.h"
+#include "timeline.h"
+
+static struct tlevent queue[TIMELINEQ];
+static atomic_uint head, tail;
+
+static void post(int type, int c, long long ns);
+
+
+// post the events s has recorded, sample 0 of s is heard at start.
+// One audio thread at a time.
+void tl_synth(struct qrq_synth *s, long long start) {
+  struct qrq_event ev;
+  double ns = 1e9 / s->cp.samplerate;
+
+  while (qrq_synth_event(s, &ev))
+    post(ev.type, ev.c, start + (long long)(ev.pos * ns));
+}
+
+
+// post the events of a call as render_text() renders it, without
+// rendering it again: for calls from the cache as well
+void tl_text(const struct cwparams *cp, const char *text, long long start) {
+  struct qrq_synth s;
+  int n;
+
+  qrq_synth_init(&s, cp);
+  s.pos = LEADIN(cp->samplerate);
+  do {
+    text += qrq_synth_queue(&s, text);
+    n = qrq_synth_skip(&s, 4096);
+    tl_synth(&s, start);
+  } while ((n == 4096) || *text);
+}
+
+
+// the next event that is due at now, returns 0 if there is none
+int tl_next(struct tlevent *ev, long long now) {
+  unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+
+  if ((t == atomic_load_explicit(&head, memory_order_acquire)) ||
+      (queue[t % TIMELINEQ].ns > now))
+    return 0;
+  *ev = queue[t % TIMELINEQ];
+  atomic_store_explicit(&tail, t + 1, memory_order_release);
+  return 1;
+}
+
+
+// ms until the next event is due, for poll(), -1 if none is posted
+int tl_wait(long long now) {
+  unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+  long long ns;
+
+  if (t == atomic_load_explicit(&head, memory_order_acquire))
+    return -1;
+  ns = queue[t % TIMELINEQ].ns - now;
+  return (ns > 0) ? (int)((ns + 999999) / 1000000) : 0;
+}
+
+
+// drop the events not due yet, from the UI thread, e.g. when the
+// call was stopped
+void tl_clear() {
+  atomic_store_explicit(&tail, atomic_load(&head), memory_order_release);
+}
+
+
+// dropped when the queue is full
+static void post(int type, int c, long long ns) {
+  unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+
+  if (h - atomic_load_explicit(&tail, memory_order_acquire) >= TIMELINEQ)
+    return;
+  queue[h % TIMELINEQ].type = type;
+  queue[h % TIMELINEQ].c = c;
+  queue[h % TIMELINEQ].ns = ns;
+  atomic_store_explicit(&head, h + 1, memory_order_release);
+}
@@ -0,0 +1,39 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef QRQ_TIMELINE
+#define QRQ_TIMELINE
+
+#include "qrqsynth.h"
+
+#define TIMELINEQ 1024           // events posted and not due yet
+
+// something the student hears, at a get_ns() time
+struct tlevent {
+  int type;                      // QRQ_EV_* of qrqsynth.h
+  int c;                         // the character, or '.' / '-'
+  long long ns;                  // when it is heard
+};
+
+void tl_synth(struct qrq_synth *s, long long start);
+void tl_text(const struct cwparams *cp, const char *text, long long start);
+int  tl_next(struct tlevent *ev, long long now);
+int  tl_wait(long long now);
+void tl_clear();
+
+#endif
@@ -0,0 +1,168 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// UTF-8 for the calls and the input line: one character at a time,
+// and the case of the scripts that have one. Malformed bytes decode to
+// U+FFFD, one at a time, so nothing is ever skipped.
+
+#ifndef QRQ_UTF8
+#define QRQ_UTF8
+
+#define UTF8_BAD 0xfffd
+
+// bytes of the character that starts with byte b, 0 for a continuation
+static inline int utf8_size(unsigned char b) {
+  return (b < 0x80) ? 1 : (b < 0xc0) ? 0 : (b < 0xe0) ? 2 :
+         (b < 0xf0) ? 3 : (b < 0xf8) ? 4 : 0;
+}
+
+// the character at s into *c, returns the bytes it takes (0 at the end)
+static inline int utf8_decode(const char *s, int *c) {
+  const unsigned char *p = (const unsigned char *)s;
+  int n = utf8_size(p[0]), i, v;
+
+  if (!p[0]) {
+    *c = 0;
+    return 0;
+  }
+  if (!n) {
+    *c = UTF8_BAD;
+    return 1;
+  }
+  v = (n == 1) ? p[0] : p[0] & (0x7f >> n);
+  for (i = 1; i < n; i++) {
+    if ((p[i] & 0xc0) != 0x80) {
+      *c = UTF8_BAD;
+      return i;
+    }
+    v = (v << 6) | (p[i] & 0x3f);
+  }
+  *c = v;
+  return n;
+}
+
+// c as UTF-8 into out (4 bytes at most, not terminated), returns the bytes
+static inline int utf8_encode(int c, char *out) {
+  if (c < 0x80) {
+    out[0] = c;
+    return 1;
+  } else if (c < 0x800) {
+    out[0] = 0xc0 | (c >> 6);
+    out[1] = 0x80 | (c & 0x3f);
+    return 2;
+  } else if (c < 0x10000) {
+    out[0] = 0xe0 | (c >> 12);
+    out[1] = 0x80 | ((c >> 6) & 0x3f);
+    out[2] = 0x80 | (c & 0x3f);
+    return 3;
+  }
+  out[0] = 0xf0 | (c >> 18);
+  out[1] = 0x80 | ((c >> 12) & 0x3f);
+  out[2] = 0x80 | ((c >> 6) & 0x3f);
+  out[3] = 0x80 | (c & 0x3f);
+  return 4;
+}
+
+// start of the character before byte pos of s
+static inline int utf8_prev(const char *s, int pos) {
+  while ((pos > 0) && !utf8_size(s[--pos]))
+    ;
+  return pos;
+}
+
+// characters in s
+static inline int utf8_len(const char *s) {
+  int n = 0;
+
+  for (; *s; s++)
+    n += (utf8_size(*s) != 0);
+  return n;
+}
+
+// the longest start of s with at most max bytes that ends with a
+// whole character, returns its length
+static inline int utf8_fit(const char *s, int max) {
+  int n = 0, k;
+
+  while (s[n] && ((k = utf8_size(s[n])) ? k : 1) + n <= max)
+    n += k ? k : 1;
+  return n;
+}
+
+// screen columns of c: the wide East Asian characters (kana, CJK,
+// Hangul, full width forms) take two, everything else one
+static inline int utf8_width(int c) {
+  return ((c >= 0x1100 && c <= 0x115f) || (c >= 0x2e80 && c <= 0xa4cf) ||
+          (c >= 0xac00 && c <= 0xd7a3) || (c >= 0xf900 && c <= 0xfaff) ||
+          (c >= 0xfe30 && c <= 0xfe4f) || (c >= 0xff00 && c <= 0xff60) ||
+          (c >= 0xffe0 && c <= 0xffe6)) ? 2 : 1;
+}
+
+// screen columns of the first n bytes of s
+static inline int utf8_columns(const char *s, int n) {
+  int i, k, c, w = 0;
+
+  for (i = 0; i < n && s[i]; i += k) {
+    k = utf8_decode(s + i, &c);
+    w += utf8_width(c);
+  }
+  return w;
+}
+
+// Latin Extended-A has its pairs at even or odd code points
+static inline int utf8_latina(int c) {
+  if ((c >= 0x100 && c <= 0x137) || (c >= 0x14a && c <= 0x177))
+    return 0;
+  if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e))
+    return 1;
+  return -1;
+}
+
+// capital letters of Latin, Latin-1, Latin Extended-A, Greek and
+// Cyrillic to small ones and back, everything else is left as it is
+static inline int utf8_lower(int c) {
+  if ((c >= 'A' && c <= 'Z') ||
+      (c >= 0xc0 && c <= 0xde && c != 0xd7) ||
+      (c >= 0x391 && c <= 0x3a9 && c != 0x3a2) ||
+      (c >= 0x410 && c <= 0x42f))
+    return c + 0x20;
+  if (c >= 0x400 && c <= 0x40f)
+    return c + 0x50;
+  if ((utf8_latina(c) >= 0 && (c & 1) == utf8_latina(c)) ||
+      (c >= 0x490 && c <= 0x4bf && !(c & 1)))
+    return c + 1;
+  return c;
+}
+
+static inline int utf8_upper(int c) {
+  if ((c >= 'a' && c <= 'z') ||
+      (c >= 0xe0 && c <= 0xfe && c != 0xf7) ||
+      (c >= 0x3b1 && c <= 0x3c9 && c != 0x3c2) ||
+      (c >= 0x430 && c <= 0x44f))
+    return c - 0x20;
+  if (c >= 0x450 && c <= 0x45f)
+    return c - 0x50;
+  if (c == 0x3c2)                       // final sigma
+    return 0x3a3;
+  if ((utf8_latina(c - 1) >= 0 && ((c - 1) & 1) == utf8_latina(c - 1)) ||
+      (c >= 0x491 && c <= 0x4bf && (c & 1)))
+    return c - 1;
+  return c;
+}
+
+#endif
@@ -0,0 +1,339 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+// The waterfall: the spectrum from WF_LOW to WF_HIGH Hz of what is
+// heard, one row WF_FPS times a second. The audio paths feed every
+// chunk they write with the time its end is heard, the capture thread
+// what it reads. The analysis runs in its own thread on a clock: every
+// row is a Hann windowed FFT of the last two rows of audio, so the
+// windows overlap by half and the picture follows the sound, not the
+// writes that run ahead of it by the latency of the sound server.
+// Nothing is allocated or locked after wf_start(), feeding is a copy
+// that never waits, and the UI thread takes the rows from a queue.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "pulseaudio.h"
+#include "waterfall.h"
+
+union wfbuf {
+  wfvec v[WF_MAXFFT / WF_LANES];
+  float f[WF_MAXFFT];
+};
+
+static atomic_int running = 0;
+static atomic_int output = 0;             // the output is analysed
+static long rate;
+static int nfft, win, cols;
+static int first[WF_MAXCOLS], last[WF_MAXCOLS];   // the bins of a column
+static float fullscale;                   // power of a full scale tone
+
+static union wfbuf re, im;                // the FFT, in place
+static union wfbuf wre, wim;              // twiddles, stage h at h..2h-1
+static float window[WF_MAXFFT];
+static int rev[WF_MAXFFT];                // bit reversed index
+
+static short int ring[WF_RING];
+static atomic_long wpos;                  // samples fed
+static atomic_llong wtime;                // when sample wpos - 1 is heard
+static atomic_uint wseq;                  // odd while the two change
+
+static unsigned char rows[WF_ROWS][WF_MAXCOLS];
+static atomic_uint rhead, rtail;
+static atomic_llong due;                  // when the next row is made
+
+static pthread_t analysethread, capturethread;
+static int capturing = 0;
+
+static void *analyse(void *arg);
+static void *capture(void *arg);
+static void feed(const short int *pcm, int n, long long heard);
+static void frame(long long now);
+static void fft(int n);
+static long long now_ns();
+
+
+// start analysing the audio of source at rate into rows of cols cells.
+// returns 0, -1 if the thread can't be started
+int wf_start(int source, long r, int c) {
+  double f0, f1;
+  int i, j, k, h;
+
+  if ((source == WF_OFF) || atomic_load(&running))
+    return 0;
+  rate = r;
+  cols = (c < WF_MAXCOLS) ? c : WF_MAXCOLS;
+  win = 2 * rate / WF_FPS;
+  for (nfft = WF_LANES; nfft < win; nfft <<= 1)
+    ;
+
+  // Hann, zero padded to nfft. A tone of amplitude A sums to A win / 4
+  for (i = 0; i < nfft; i++)
+    window[i] = (i < win) ? 0.5 - 0.5 * cos(2 * PI * i / win) : 0.0;
+  fullscale = pow(32767.0 * win / 4, 2);
+
+  for (i = 0; i < nfft; i++) {
+    for (k = 0, j = i, h = 1; h < nfft; h <<= 1, j >>= 1)
+      k = (k << 1) | (j & 1);
+    rev[i] = k;
+  }
+  for (h = 1; h < nfft; h <<= 1)
+    for (i = 0; i < h; i++) {
+      wre.f[h + i] = cos(PI * i / h);
+      wim.f[h + i] = -sin(PI * i / h);
+    }
+
+  // the bins of a column, at least the one nearest to its middle
+  for (i = 0; i < cols; i++) {
+    f0 = WF_LOW + (double)(WF_HIGH - WF_LOW) * i / cols;
+    f1 = WF_LOW + (double)(WF_HIGH - WF_LOW) * (i + 1) / cols;
+    first[i] = (int)ceil(f0 * nfft / rate);
+    last[i] = (int)ceil(f1 * nfft / rate) - 1;
+    if (last[i] < first[i])
+      first[i] = last[i] = (int)lround((f0 + f1) / 2 * nfft / rate);
+  }
+
+  atomic_store(&wpos, 0);
+  atomic_store(&wtime, 0);
+  atomic_store(&rhead, 0);
+  atomic_store(&rtail, 0);
+  atomic_store(&running, 1);
+  if (pthread_create(&analysethread, NULL, analyse, NULL)) {
+    atomic_store(&running, 0);
+    return -1;
+  }
+  if (source == WF_CAPTURE)
+    capturing = !pthread_create(&capturethread, NULL, capture, NULL);
+  else
+    atomic_store(&output, 1);
+  return 0;
+}
+
+
+void wf_stop() {
+  if (!atomic_load(&running))
+    return;
+  atomic_store(&output, 0);
+  atomic_store(&running, 0);
+  pthread_join(analysethread, NULL);
+  if (capturing)
+    pthread_join(capturethread, NULL);
+  capturing = 0;
+}
+
+
+// 1 if what is played is analysed, the audio paths only look up when
+// it will be heard then
+int wf_output() {
+  return atomic_load_explicit(&output, memory_order_relaxed);
+}
+
+
+// n samples that are played, the last one is heard at the get_ns()
+// time heard. One audio thread at a time, never blocks
+void wf_feed(const short int *pcm, int n, long long heard) {
+  if (atomic_load_explicit(&output, memory_order_relaxed))
+    feed(pcm, n, heard);
+}
+
+
+// the next row, level[] of every column from 0 to WF_LEVELS - 1.
+// returns 0 if there is none
+int wf_row(unsigned char *level) {
+  unsigned int t = atomic_load_explicit(&rtail, memory_order_relaxed);
+
+  if (t == atomic_load_explicit(&rhead, memory_order_acquire))
+    return 0;
+  memcpy(level, rows[t % WF_ROWS], cols);
+  atomic_store_explicit(&rtail, t + 1, memory_order_release);
+  return 1;
+}
+
+
+// ms until the next row, for poll(), -1 if the waterfall is off
+int wf_wait(long long now) {
+  long long ns;
+
+  if (!atomic_load(&running))
+    return -1;
+  if (atomic_load_explicit(&rtail, memory_order_relaxed) !=
+      atomic_load_explicit(&rhead, memory_order_acquire))
+    return 0;
+  ns = atomic_load(&due) - now;
+  return (ns > 0) ? (int)((ns + 999999) / 1000000) : 0;
+}
+
+
+// a row every 1 / WF_FPS s, on time whatever the audio does
+static void *analyse(void *arg) {
+  long long period = 1000000000LL / WF_FPS;
+  long long next = now_ns();
+  struct timespec ts;
+
+  while (atomic_load(&running)) {
+    next += period;
+    if (next < now_ns())                // fell behind, e.g. suspended
+      next = now_ns() + period;
+    atomic_store(&due, next);
+    ts.tv_sec = next / 1000000000LL;
+    ts.tv_nsec = next % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+    frame(next);
+  }
+  return NULL;
+}
+
+
+// the capture stream in chunks of 20 ms, heard as it is read
+static void *capture(void *arg) {
+  static short int pcm[MAXRATE / 50];
+  int n = rate / 50;
+  void *s;
+
+  if ((s = open_capture(rate)) == NULL)
+    return NULL;
+  while (atomic_load(&running) && !read_capture(s, pcm, n))
+    feed(pcm, n, now_ns());
+  close_capture(s);
+  return NULL;
+}
+
+
+// into the ring, then the position and its time change together
+static void feed(const short int *pcm, int n, long long heard) {
+  long pos = atomic_load_explicit(&wpos, memory_order_relaxed);
+  unsigned int seq = atomic_load_explicit(&wseq, memory_order_relaxed);
+  int i, k;
+
+  for (i = 0; i < n; i += k) {
+    k = WF_RING - ((pos + i) & (WF_RING - 1));
+    if (k > n - i)
+      k = n - i;
+    memcpy(&ring[(pos + i) & (WF_RING - 1)], pcm + i, k * sizeof(short int));
+  }
+  atomic_store_explicit(&wseq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&wpos, pos + n, memory_order_relaxed);
+  atomic_store_explicit(&wtime, heard, memory_order_relaxed);
+  atomic_store_explicit(&wseq, seq + 2, memory_order_release);
+}
+
+
+// the row of the audio heard until now. Samples not fed yet, or so
+// long ago that the ring has been refilled since, are silence
+static void frame(long long now) {
+  unsigned int seq, h;
+  unsigned char *row;
+  long pos, end, k;
+  long long t;
+  float p, max;
+  int i, c, b, lvl, sound = 0;
+
+  do {
+    seq = atomic_load_explicit(&wseq, memory_order_acquire);
+    pos = atomic_load_explicit(&wpos, memory_order_relaxed);
+    t = atomic_load_explicit(&wtime, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while ((seq & 1) || (seq != atomic_load_explicit(&wseq, memory_order_relaxed)));
+
+  h = atomic_load_explicit(&rhead, memory_order_relaxed);
+  if (h - atomic_load_explicit(&rtail, memory_order_acquire) >= WF_ROWS)
+    return;                             // nobody looks
+  row = rows[h % WF_ROWS];
+
+  // loaded in bit reversed order, for the FFT
+  end = pos - (t - now) * rate / 1000000000LL;
+  for (i = 0; i < nfft; i++) {
+    k = end - win + rev[i];
+    if ((rev[i] < win) && (k >= 0) && (k < pos) &&
+        (k >= pos - WF_RING + MAXRATE)) {
+      re.f[i] = ring[k & (WF_RING - 1)] * window[rev[i]];
+      sound |= (re.f[i] != 0.0f);
+    } else {
+      re.f[i] = 0.0f;
+    }
+    im.f[i] = 0.0f;
+  }
+
+  if (sound)
+    fft(nfft);
+  for (c = 0; c < cols; c++) {
+    max = 0.0f;
+    for (b = first[c]; sound && (b <= last[c]); b++) {
+      p = re.f[b] * re.f[b] + im.f[b] * im.f[b];
+      max = (p > max) ? p : max;
+    }
+    lvl = (max > 0.0f) ? (int)((10.0f * log10f(max / fullscale) + WF_RANGE) *
+                               WF_LEVELS / WF_RANGE) : 0;
+    row[c] = (lvl < 0) ? 0 : (lvl >= WF_LEVELS) ? WF_LEVELS - 1 : lvl;
+  }
+  atomic_store_explicit(&rhead, h + 1, memory_order_release);
+}
+
+
+// radix 2 FFT of re + i im in place, n a power of 2 of at least
+// WF_LANES, the input in bit reversed order. The first stages are
+// shorter than a vector and run per sample, the rest on whole vectors
+static void fft(int n) {
+  wfvec tr, ti, wr, wi, *ar, *ai, *br, *bi;
+  float sr, si;
+  int h, j, k, a, b;
+
+  for (h = 1; h < WF_LANES; h <<= 1)
+    for (k = 0; k < n; k += 2 * h)
+      for (j = 0; j < h; j++) {
+        a = k + j;
+        b = a + h;
+        sr = wre.f[h + j] * re.f[b] - wim.f[h + j] * im.f[b];
+        si = wre.f[h + j] * im.f[b] + wim.f[h + j] * re.f[b];
+        re.f[b] = re.f[a] - sr;
+        im.f[b] = im.f[a] - si;
+        re.f[a] += sr;
+        im.f[a] += si;
+      }
+
+  for (; h < n; h <<= 1)
+    for (k = 0; k < n; k += 2 * h)
+      for (j = 0; j < h; j += WF_LANES) {
+        ar = &re.v[(k + j) / WF_LANES];
+        ai = &im.v[(k + j) / WF_LANES];
+        br = &re.v[(k + j + h) / WF_LANES];
+        bi = &im.v[(k + j + h) / WF_LANES];
+        wr = wre.v[(h + j) / WF_LANES];
+        wi = wim.v[(h + j) / WF_LANES];
+        tr = wr * *br - wi * *bi;
+        ti = wr * *bi + wi * *br;
+        *br = *ar - tr;
+        *bi = *ai - ti;
+        *ar += tr;
+        *ai += ti;
+      }
+}
+
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
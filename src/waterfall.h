@@ -0,0 +1,47 @@
+
+// qrq - High speed morse trainer, similar to the DOS program Rufz
+// original Copyright (c) 2006-2013  Fabian Kurz DJ1YFK
+// modifications Copyright (c) 2021  Scott L. Baker
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+// PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51 Franklin
+// Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#ifndef QRQ_WATERFALL
+#define QRQ_WATERFALL
+
+#include "morse.h"
+
+#define WF_LOW     300           // Hz at the left edge
+#define WF_HIGH    1000          // Hz at the right edge
+#define WF_FPS     25            // rows per second, every window is 2 rows long
+#define WF_LEVELS  8             // shades of a cell
+#define WF_RANGE   48            // dB from the darkest to the brightest shade
+#define WF_MAXCOLS 256
+#define WF_ROWS    64            // rows made and not shown yet
+#define WF_RING    (1 << 20)     // samples fed, a few seconds at MAXRATE
+#define WF_MAXFFT  16384         // a power of 2, 2 rows at MAXRATE
+#define WF_LANES   8             // floats per vector
+
+#define WF_OFF     0             // sources of the audio
+#define WF_OUTPUT  1             // what qrq plays
+#define WF_CAPTURE 2             // the capture stream
+
+typedef float wfvec __attribute__((vector_size(WF_LANES * sizeof(float))));
+
+int  wf_start(int source, long rate, int cols);
+void wf_stop();
+int  wf_output();
+void wf_feed(const short int *pcm, int n, long long heard);
+int  wf_row(unsigned char *level);
+int  wf_wait(long long now);
+
+#endif